@@ -0,0 +1,172 @@
+// TriangleBvh rays per second for closest and any hit queries on a
+// bumpy grid, checked against brute force, plus a degenerate chain of
+// triangles deep enough to need the heap traversal stack. Fails on
+// any mismatch. Run with: make bench-bvh
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "../src/TriangleBvh.h"
+
+static const unsigned int STRIDE = 8;
+static const int GRID_QUADS = 700;
+static const int CHECK_RAYS = 200;
+static const int TIMED_RAYS = 1000000;
+static const int CHAIN_TRIANGLES = 2000;
+
+static float random01() {
+  return rand() / (float)RAND_MAX;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static void addVertex(std::vector<GLfloat> &vertices, float x, float y, float z) {
+  GLfloat vertex[STRIDE] = {x, y, z, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+  vertices.insert(vertices.end(), vertex, vertex + STRIDE);
+}
+
+// closest hit distance over every triangle, FLT_MAX-like when none
+static float bruteForce(const std::vector<GLfloat> &vertices, const std::vector<unsigned int> &indices,
+			const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) {
+  float closest = 1e30f;
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    const GLfloat *p0 = &vertices[indices[t] * STRIDE];
+    const GLfloat *p1 = &vertices[indices[t + 1] * STRIDE];
+    const GLfloat *p2 = &vertices[indices[t + 2] * STRIDE];
+    glm::vec3 v0(p0[0], p0[1], p0[2]);
+    glm::vec3 e1 = glm::vec3(p1[0], p1[1], p1[2]) - v0, e2 = glm::vec3(p2[0], p2[1], p2[2]) - v0;
+    glm::vec3 p = glm::cross(direction, e2);
+    float determinant = glm::dot(e1, p);
+    if (fabsf(determinant) < 1e-12f) {
+      continue;
+    }
+    float inverse = 1.0f / determinant;
+    glm::vec3 s = origin - v0;
+    float u = glm::dot(s, p) * inverse;
+    if (u < 0.0f || u > 1.0f) {
+      continue;
+    }
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(direction, q) * inverse;
+    if (v < 0.0f || u + v > 1.0f) {
+      continue;
+    }
+    float distance = glm::dot(e2, q) * inverse;
+    if (distance >= 0.0f && distance <= maxDistance && distance < closest) {
+      closest = distance;
+    }
+  }
+  return closest;
+}
+
+// both queries against brute force; returns the number of disagreements
+static int check(const TriangleBvh &bvh, const std::vector<GLfloat> &vertices, const std::vector<unsigned int> &indices,
+		 const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) {
+  RayHit hit;
+  bool found = bvh.intersect(origin, direction, maxDistance, hit);
+  float expected = bruteForce(vertices, indices, origin, direction, maxDistance);
+  int mismatches = 0;
+  if (found != (expected <= maxDistance) || (found && fabsf(hit.distance - expected) > 1e-4f * fmaxf(1.0f, expected))) {
+    mismatches ++;
+  }
+  if (found != bvh.occluded(origin, direction, maxDistance)) {
+    mismatches ++;
+  }
+  return mismatches;
+}
+
+int main() {
+  srand(1);
+  int failures = 0;
+
+  std::vector<GLfloat> vertices;
+  std::vector<unsigned int> indices;
+  for (int y = 0; y <= GRID_QUADS; y ++) {
+    for (int x = 0; x <= GRID_QUADS; x ++) {
+      float px = x / (float)GRID_QUADS * 20.0f - 10.0f, pz = y / (float)GRID_QUADS * 20.0f - 10.0f;
+      addVertex(vertices, px, sinf(px * 1.3f) * cosf(pz * 0.7f), pz);
+    }
+  }
+  for (int y = 0; y < GRID_QUADS; y ++) {
+    for (int x = 0; x < GRID_QUADS; x ++) {
+      unsigned int a = y * (GRID_QUADS + 1) + x, b = a + 1, c = a + GRID_QUADS + 1, d = c + 1;
+      unsigned int quad[6] = {a, c, b, b, c, d};
+      indices.insert(indices.end(), quad, quad + 6);
+    }
+  }
+
+  TriangleBvh bvh;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  bvh.build(&vertices[0], STRIDE, &indices[0], indices.size());
+  printf("grid: %u triangles, %u nodes, built in %.1f ms\n", bvh.getTriangleCount(), bvh.getNodeCount(),
+	 elapsedMs(start));
+
+  int mismatches = 0;
+  for (int r = 0; r < CHECK_RAYS; r ++) {
+    glm::vec3 origin(random01() * 20.0f - 10.0f, 5.0f, random01() * 20.0f - 10.0f);
+    glm::vec3 direction = glm::normalize(glm::vec3(random01() - 0.5f, -1.0f, random01() - 0.5f));
+    mismatches += check(bvh, vertices, indices, origin, direction, 100.0f);
+  }
+  printf("  %d of %d rays disagree with brute force\n", mismatches, CHECK_RAYS);
+  failures += mismatches;
+
+  std::vector<glm::vec3> origins(TIMED_RAYS), directions(TIMED_RAYS);
+  for (int i = 0; i < TIMED_RAYS; i ++) {
+    origins[i] = glm::vec3(random01() * 20.0f - 10.0f, 5.0f, random01() * 20.0f - 10.0f);
+    directions[i] = glm::normalize(glm::vec3(random01() - 0.5f, -1.0f + random01() * 0.8f, random01() - 0.5f));
+  }
+  int hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < TIMED_RAYS; i ++) {
+    RayHit hit;
+    hits += bvh.intersect(origins[i], directions[i], 100.0f, hit);
+  }
+  double ms = elapsedMs(start);
+  printf("  closest hit: %.2f Mrays/s, %d hits\n", TIMED_RAYS / ms / 1000.0, hits);
+  hits = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < TIMED_RAYS; i ++) {
+    hits += bvh.occluded(origins[i], directions[i], 100.0f);
+  }
+  ms = elapsedMs(start);
+  printf("  any hit:     %.2f Mrays/s, %d hits\n", TIMED_RAYS / ms / 1000.0, hits);
+
+  // triangles growing geometrically with their distance: SAH keeps
+  // peeling off the largest few, so the tree is far deeper than a mesh's
+  std::vector<GLfloat> chainVertices;
+  std::vector<unsigned int> chainIndices;
+  float x = 1.0f;
+  for (int i = 0; i < CHAIN_TRIANGLES; i ++, x *= 1.02f) {
+    float size = x * 0.5f;
+    addVertex(chainVertices, x, -size, -size);
+    addVertex(chainVertices, x, 2.0f * size, -size);
+    addVertex(chainVertices, x, -size, 2.0f * size);
+    for (int corner = 0; corner < 3; corner ++) {
+      chainIndices.push_back(i * 3 + corner);
+    }
+  }
+  TriangleBvh chain;
+  chain.build(&chainVertices[0], STRIDE, &chainIndices[0], chainIndices.size());
+  mismatches = 0;
+  for (int r = 0; r < CHECK_RAYS; r ++) {
+    glm::vec3 offset(0.0f, random01() * 0.9f, random01() * 0.9f);
+    // from either end, and from the middle both ways
+    float startX = r % 3 == 0 ? 0.0f : r % 3 == 1 ? x : x * random01();
+    glm::vec3 direction(r % 3 == 0 ? 1.0f : r % 3 == 1 ? -1.0f : (r % 2 ? 1.0f : -1.0f), 0.0f, 0.0f);
+    mismatches += check(chain, chainVertices, chainIndices, glm::vec3(startX, 0.0f, 0.0f) + offset, direction,
+			x * 2.0f);
+  }
+  printf("chain: %u triangles, %u nodes, %d of %d rays disagree with brute force\n", chain.getTriangleCount(),
+	 chain.getNodeCount(), mismatches, CHECK_RAYS);
+  failures += mismatches;
+
+  return failures ? 1 : 0;
+}
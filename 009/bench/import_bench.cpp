@@ -0,0 +1,146 @@
+// Times ObjLoader against Assimp (with the flags Model uses) on
+// models/x-wing.obj and on a generated OBJ of the given size in MB,
+// default 100. Run from the project directory: make bench-import
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "../src/ObjLoader.h"
+
+static const unsigned int ASSIMP_FLAGS = aiProcess_Triangulate |
+  aiProcess_FlipUVs |
+  aiProcess_GenSmoothNormals |
+  aiProcess_JoinIdenticalVertices;
+// grid blocks the synthetic file is made of
+static const int BLOCK_QUADS = 256;
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static size_t fileSize(const std::string &fileName) {
+  struct stat info;
+  return stat(fileName.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+// Blocks of a bumpy grid with positions, uv and normals, each quad a
+// polygon face, two materials alternating per block, until the file
+// reaches targetBytes
+static bool writeSyntheticObj(const std::string &fileName, size_t targetBytes) {
+  std::string mtlName = fileName.substr(0, fileName.size() - 4) + ".mtl";
+  FILE *mtl = fopen(mtlName.c_str(), "w");
+  if (!mtl) {
+    return false;
+  }
+  fprintf(mtl, "newmtl even\nKd 0.8 0.8 0.8\nnewmtl odd\nKd 0.4 0.4 0.4\n");
+  fclose(mtl);
+
+  FILE *obj = fopen(fileName.c_str(), "w");
+  if (!obj) {
+    return false;
+  }
+  size_t slash = mtlName.find_last_of('/');
+  fprintf(obj, "mtllib %s\n", mtlName.substr(slash == std::string::npos ? 0 : slash + 1).c_str());
+  const int side = BLOCK_QUADS + 1;
+  long base = 1;
+  for (int block = 0; ftell(obj) < (long)targetBytes; block ++) {
+    fprintf(obj, "o block%d\n", block);
+    for (int y = 0; y < side; y ++) {
+      for (int x = 0; x < side; x ++) {
+	float px = block * BLOCK_QUADS + x, pz = y;
+	fprintf(obj, "v %.4f %.4f %.4f\n", px * 0.1f, 0.1f * ((x * 7 + y * 13) % 5), pz * 0.1f);
+      }
+    }
+    for (int y = 0; y < side; y ++) {
+      for (int x = 0; x < side; x ++) {
+	fprintf(obj, "vt %.4f %.4f\n", x / (float)BLOCK_QUADS, y / (float)BLOCK_QUADS);
+      }
+    }
+    for (int y = 0; y < side; y ++) {
+      for (int x = 0; x < side; x ++) {
+	fprintf(obj, "vn 0.0 1.0 0.0\n");
+      }
+    }
+    fprintf(obj, "usemtl %s\n", block % 2 ? "odd" : "even");
+    for (int y = 0; y < BLOCK_QUADS; y ++) {
+      for (int x = 0; x < BLOCK_QUADS; x ++) {
+	long a = base + y * side + x, b = a + 1, c = a + side, d = c + 1;
+	fprintf(obj, "f %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld %ld/%ld/%ld\n", a, a, a, b, b, b, d, d, d, c, c, c);
+      }
+    }
+    base += side * side;
+  }
+  fclose(obj);
+  return true;
+}
+
+static void benchFile(const std::string &fileName, int runs) {
+  double best = 0.0;
+  size_t triangles = 0, meshCount = 0;
+  for (int run = 0; run < runs; run ++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ObjLoader loader;
+    std::vector<BakedMesh> meshes;
+    std::vector<std::string> texturePaths;
+    if (!loader.load(fileName, meshes, texturePaths)) {
+      printf("%s: ObjLoader failed\n", fileName.c_str());
+      return;
+    }
+    double ms = elapsedMs(start);
+    best = run == 0 || ms < best ? ms : best;
+    triangles = 0;
+    for (size_t i = 0; i < meshes.size(); i ++) {
+      triangles += meshes[i].indices.size() / 3;
+    }
+    meshCount = meshes.size();
+  }
+  printf("%s (%.1f MB)\n", fileName.c_str(), fileSize(fileName) / 1048576.0);
+  printf("  ObjLoader %9.1f ms  %zu meshes, %zu triangles\n", best, meshCount, triangles);
+
+  best = 0.0;
+  for (int run = 0; run < runs; run ++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(fileName, ASSIMP_FLAGS);
+    if (!scene) {
+      printf("  Assimp failed: %s\n", importer.GetErrorString());
+      return;
+    }
+    double ms = elapsedMs(start);
+    best = run == 0 || ms < best ? ms : best;
+    triangles = 0;
+    for (unsigned int i = 0; i < scene->mNumMeshes; i ++) {
+      triangles += scene->mMeshes[i]->mNumFaces;
+    }
+    meshCount = scene->mNumMeshes;
+  }
+  printf("  Assimp    %9.1f ms  %zu meshes, %zu triangles\n", best, meshCount, triangles);
+}
+
+int main(int argc, char *argv[]) {
+  size_t megabytes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+
+  // best of several runs on the small model, one on the large file
+  benchFile("models/x-wing.obj", 5);
+
+  char syntheticName[64];
+  snprintf(syntheticName, sizeof(syntheticName), "bench/synthetic_%zumb.obj", megabytes);
+  if (fileSize(syntheticName) < megabytes * 1000000) {
+    printf("writing %s\n", syntheticName);
+    if (!writeSyntheticObj(syntheticName, megabytes * 1000000)) {
+      printf("failed to write %s\n", syntheticName);
+      return 1;
+    }
+  }
+  benchFile(syntheticName, 1);
+  return 0;
+}
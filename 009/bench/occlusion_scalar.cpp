@@ -0,0 +1,11 @@
+// OcclusionCuller built without SSE, renamed so it links next to the
+// SSE build in occlusion_test
+#undef __SSE__
+#define OcclusionCuller ScalarOcclusionCuller
+#include "../src/OcclusionCuller.cpp"
+#include "occlusion_scene.h"
+
+void renderScalarCubeField(std::vector<float> &depth, std::vector<unsigned char> &visible) {
+  ScalarOcclusionCuller culler;
+  renderCubeField(culler, depth, visible);
+}
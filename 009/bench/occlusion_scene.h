@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdlib.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+// A field of cube occluders rendered into a culler and a grid of boxes
+// tested against it. A template so occlusion_test.cpp can run it through
+// the SSE build and occlusion_scalar.cpp through the scalar one.
+template <class Culler>
+void renderCubeField(Culler &culler, std::vector<float> &depth, std::vector<unsigned char> &visible) {
+  static const unsigned int cubeIndices[36] = {
+    0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1,
+    2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3
+  };
+  float cube[24];
+  for (int i = 0; i < 8; i ++) {
+    cube[i * 3] = i & 1 ? 1.0f : -1.0f;
+    cube[i * 3 + 1] = i & 2 ? 1.0f : -1.0f;
+    cube[i * 3 + 2] = i & 4 ? 1.0f : -1.0f;
+  }
+
+  culler.init(256, 192, 1);
+  unsigned int mesh = culler.addOccluderMesh(cube, 3, 8, cubeIndices, 36);
+  glm::mat4 viewProjection = glm::perspective(0.785f, 4.0f / 3.0f, 0.1f, 100.0f) *
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  culler.beginFrame(viewProjection);
+  srand(1);
+  for (int i = 0; i < 500; i ++) {
+    glm::vec3 position(rand() % 40 - 20, rand() % 30 - 15, -(rand() % 60));
+    float angle = rand() % 628 * 0.01f;
+    culler.addOccluder(mesh, glm::rotate(glm::translate(glm::mat4(1.0f), position), angle,
+					 glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f))));
+  }
+  culler.finish();
+
+  const float *level = culler.getDepth();
+  depth.assign(level, level + culler.getWidth() * culler.getHeight());
+  visible.clear();
+  for (int z = 0; z < 80; z += 2) {
+    for (int y = -15; y < 15; y += 2) {
+      for (int x = -20; x < 20; x += 2) {
+	glm::vec3 center(x, y, -z);
+	visible.push_back(culler.isVisible(center - glm::vec3(0.5f), center + glm::vec3(0.5f)));
+      }
+    }
+  }
+}
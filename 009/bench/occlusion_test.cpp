@@ -0,0 +1,78 @@
+// OcclusionCuller without GL: boxes behind, in front of, beside and
+// straddling an occluder, near plane clipping, and the SSE rasterizer
+// against the scalar one on a field of cubes. Fails on any wrong
+// answer. Run with: make test-occlusion
+#include <stdio.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../src/OcclusionCuller.h"
+#include "occlusion_scene.h"
+
+void renderScalarCubeField(std::vector<float> &depth, std::vector<unsigned char> &visible);
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  printf("%-48s %s\n", what, condition ? "ok" : "FAILED");
+  if (!condition) {
+    failures ++;
+  }
+}
+
+int main() {
+  OcclusionCuller culler;
+  culler.init(256, 192);
+  const float quad[12] = {-1.0f, -1.0f, 0.0f, 1.0f, -1.0f, 0.0f, -1.0f, 1.0f, 0.0f, 1.0f, 1.0f, 0.0f};
+  const unsigned int quadIndices[6] = {0, 1, 2, 1, 3, 2};
+  unsigned int mesh = culler.addOccluderMesh(quad, 3, 4, quadIndices, 6);
+  glm::mat4 viewProjection = glm::perspective(0.785f, 4.0f / 3.0f, 0.1f, 100.0f) *
+    glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+  // a 2 by 2 wall through the origin, facing the camera; the box behind
+  // it is only occluded if no pixel along the quad's diagonal is missed
+  culler.beginFrame(viewProjection);
+  culler.addOccluder(mesh, glm::mat4(1.0f));
+  culler.finish();
+  expect(!culler.isVisible(glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, -2.0f)), "box behind the wall is occluded");
+  expect(culler.isVisible(glm::vec3(-0.5f, -0.5f, 1.0f), glm::vec3(0.5f, 0.5f, 2.0f)), "box in front of the wall is visible");
+  expect(culler.isVisible(glm::vec3(2.5f, -0.5f, -3.0f), glm::vec3(3.5f, 0.5f, -2.0f)), "box beside the wall is visible");
+  expect(culler.isVisible(glm::vec3(-1.0f, -1.0f, 4.0f), glm::vec3(1.0f, 1.0f, 6.0f)), "box around the camera is visible");
+  expect(culler.getOccludedCount() == 1 && culler.getTestedCount() == 4, "occluded and tested counts");
+
+  // a larger wall turned almost edge on, reaching behind the camera,
+  // so it covers the screen left of its far edge
+  culler.beginFrame(viewProjection);
+  culler.addOccluder(mesh, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 4.0f)) *
+		     glm::rotate(glm::mat4(1.0f), 1.4f, glm::vec3(0.0f, 1.0f, 0.0f)) *
+		     glm::scale(glm::mat4(1.0f), glm::vec3(3.0f)));
+  culler.finish();
+  expect(culler.getTriangleCount() > 2, "near plane clipping splits the wall");
+  expect(!culler.isVisible(glm::vec3(-4.0f, -0.5f, -3.0f), glm::vec3(-3.0f, 0.5f, -2.0f)), "box behind a clipped wall is occluded");
+  expect(culler.isVisible(glm::vec3(3.0f, -0.5f, -3.0f), glm::vec3(4.0f, 0.5f, -2.0f)), "box right of a clipped wall is visible");
+
+  std::vector<float> depth, scalarDepth;
+  std::vector<unsigned char> visible, scalarVisible;
+  OcclusionCuller fieldCuller;
+  renderCubeField(fieldCuller, depth, visible);
+  renderScalarCubeField(scalarDepth, scalarVisible);
+  unsigned int covered = 0;
+  for (size_t i = 0; i < depth.size(); i ++) {
+    covered += depth[i] < 1.0f;
+  }
+  unsigned int visibleCount = 0;
+  for (size_t i = 0; i < visible.size(); i ++) {
+    visibleCount += visible[i];
+  }
+  printf("cube field: %u of %zu pixels covered, %u of %zu boxes visible\n", covered, depth.size(), visibleCount,
+	 visible.size());
+  // both evaluate the same planes per pixel, so they match exactly
+  expect(covered > 0 && depth == scalarDepth, "SSE and scalar depth agree");
+  expect(visible == scalarVisible, "SSE and scalar visibility agree");
+  expect(visibleCount > 0 && visibleCount < visible.size(), "cube field occludes some boxes but not all");
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+// LooseOctree frustum queries against brute force Frustum::cullBoxes over
+// 1k to 1M random boxes, plus a sphere query check and the cost of
+// moving every object. Fails if the octree misses a box brute force
+// keeps. Run with: make bench-octree
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../src/LooseOctree.h"
+
+static const float WORLD_HALF_SIZE = 1000.0f;
+static const int QUERY_REPEATS = 20;
+
+static float random01() {
+  return rand() / (float)RAND_MAX;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main() {
+  const unsigned int counts[] = {1000, 10000, 100000, 1000000};
+  glm::mat4 viewProjection = glm::perspective(0.8f, 4.0f / 3.0f, 0.1f, 200.0f) *
+    glm::lookAt(glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(1.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  Frustum frustum(viewProjection);
+  int failures = 0;
+
+  printf("%8s %12s %10s %14s %12s %10s %12s\n", "objects", "octree ms", "visible", "nodes visited",
+	 "brute ms", "visible", "update ms");
+  for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c ++) {
+    unsigned int count = counts[c];
+    srand(1);
+
+    // flat scattering, one box in a hundred much larger
+    LooseOctree tree;
+    tree.init(glm::vec3(0.0f), WORLD_HALF_SIZE, 8);
+    std::vector<glm::vec3> boundsMin(count), boundsMax(count);
+    std::vector<unsigned int> handles(count);
+    for (unsigned int i = 0; i < count; i ++) {
+      glm::vec3 center((random01() * 2.0f - 1.0f) * WORLD_HALF_SIZE, (random01() * 2.0f - 1.0f) * 50.0f,
+		       (random01() * 2.0f - 1.0f) * WORLD_HALF_SIZE);
+      glm::vec3 extent(0.5f + random01() * 2.0f);
+      if (i % 100 == 0) {
+	extent *= 40.0f;
+      }
+      boundsMin[i] = center - extent;
+      boundsMax[i] = center + extent;
+      handles[i] = tree.insert(boundsMin[i], boundsMax[i], i);
+    }
+
+    std::vector<unsigned int> result;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int r = 0; r < QUERY_REPEATS; r ++) {
+      result.clear();
+      tree.queryFrustum(frustum, result);
+    }
+    double treeMs = elapsedMs(start) / QUERY_REPEATS;
+    unsigned int nodesVisited = tree.getNodesVisited();
+
+    std::vector<float> centerX(count), centerY(count), centerZ(count);
+    std::vector<float> extentX(count), extentY(count), extentZ(count);
+    for (unsigned int i = 0; i < count; i ++) {
+      glm::vec3 center = (boundsMin[i] + boundsMax[i]) * 0.5f;
+      glm::vec3 extent = (boundsMax[i] - boundsMin[i]) * 0.5f;
+      centerX[i] = center.x; centerY[i] = center.y; centerZ[i] = center.z;
+      extentX[i] = extent.x; extentY[i] = extent.y; extentZ[i] = extent.z;
+    }
+    std::vector<uint8_t> visible(count);
+    start = std::chrono::steady_clock::now();
+    for (int r = 0; r < QUERY_REPEATS; r ++) {
+      frustum.cullBoxes(&centerX[0], &centerY[0], &centerZ[0], &extentX[0], &extentY[0], &extentZ[0],
+			count, &visible[0]);
+    }
+    double bruteMs = elapsedMs(start) / QUERY_REPEATS;
+
+    std::sort(result.begin(), result.end());
+    unsigned int bruteVisible = 0, missed = 0;
+    for (unsigned int i = 0; i < count; i ++) {
+      bruteVisible += visible[i];
+      if (visible[i] && !std::binary_search(result.begin(), result.end(), i)) {
+	missed ++;
+      }
+    }
+
+    // the sphere query has to agree exactly with a box-sphere distance test
+    glm::vec3 sphereCenter(10.0f, 0.0f, 10.0f);
+    float sphereRadius = 30.0f;
+    std::vector<unsigned int> sphereResult;
+    tree.querySphere(sphereCenter, sphereRadius, sphereResult);
+    unsigned int sphereExpected = 0;
+    for (unsigned int i = 0; i < count; i ++) {
+      glm::vec3 outside = glm::max(glm::max(boundsMin[i] - sphereCenter, sphereCenter - boundsMax[i]), glm::vec3(0.0f));
+      if (glm::dot(outside, outside) <= sphereRadius * sphereRadius) {
+	sphereExpected ++;
+      }
+    }
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < count; i ++) {
+      glm::vec3 step(random01() - 0.5f, 0.0f, random01() - 0.5f);
+      boundsMin[i] += step;
+      boundsMax[i] += step;
+      tree.update(handles[i], boundsMin[i], boundsMax[i]);
+    }
+    double updateMs = elapsedMs(start);
+
+    printf("%8u %12.3f %10zu %14u %12.3f %10u %12.1f\n", count, treeMs, result.size(), nodesVisited,
+	   bruteMs, bruteVisible, updateMs);
+    if (missed > 0 || sphereResult.size() != sphereExpected) {
+      printf("  FAILED: %u boxes missed, sphere query %zu of %u\n", missed, sphereResult.size(), sphereExpected);
+      failures ++;
+    }
+  }
+
+  return failures ? 1 : 0;
+}
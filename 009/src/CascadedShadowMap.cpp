@@ -0,0 +1,151 @@
+#include "CascadedShadowMap.h"
+#include "GLState.h"
+
+CascadedShadowMap::CascadedShadowMap(unsigned int layers) : ShadowMap() {
+  layerCount = layers;
+}
+
+bool CascadedShadowMap::init(GLuint width, GLuint height) {
+  shadowWidth = width; shadowHeight = height;
+  return createLayeredTarget(FBO, shadowMap, layerFBOs);
+}
+
+bool CascadedShadowMap::createLayeredTarget(GLuint &framebuffer, GLuint &texture,
+					    std::vector<GLuint> &layerFramebuffers) {
+  glGenTextures(1, &texture);
+  GLState::bindTexture(0, texture, GL_TEXTURE_2D_ARRAY);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT, shadowWidth, shadowHeight, layerCount, 0,
+	       GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  float bColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, bColor);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+  // layer -1 is the layered framebuffer
+  layerFramebuffers.resize(layerCount);
+  for (int layer = -1; layer < (int)layerCount; layer ++) {
+    GLuint &target = layer < 0 ? framebuffer : layerFramebuffers[layer];
+    glGenFramebuffers(1, &target);
+    GLState::bindFramebuffer(target);
+    if (layer < 0) {
+      glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0);
+    } else {
+      glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+    }
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+      printf("Framebuffer Error: %i\n", status);
+      GLState::bindFramebuffer(0);
+      return false;
+    }
+  }
+
+  GLState::bindFramebuffer(0);
+
+  return true;
+}
+
+bool CascadedShadowMap::initStaticCache() {
+  if (staticFBO) {
+    return true;
+  }
+  if (!createLayeredTarget(staticFBO, staticMap, staticLayerFBOs)) {
+    deleteLayerFramebuffers(staticLayerFBOs);
+    glDeleteFramebuffers(1, &staticFBO);
+    GLState::framebufferDeleted(staticFBO);
+    glDeleteTextures(1, &staticMap);
+    GLState::textureDeleted(staticMap);
+    staticFBO = 0;
+    staticMap = 0;
+    return false;
+  }
+  staticTransforms.assign(layerCount, glm::mat4(0.0f));
+  staticDirty = true;
+  return true;
+}
+
+void CascadedShadowMap::write() {
+  writeLayers((1u << layerCount) - 1);
+}
+
+void CascadedShadowMap::writeLayers(unsigned int mask) {
+  dynamicWritten = true;
+  for (unsigned int layer = 0; layer < layerCount; layer ++) {
+    if (mask & (1u << layer)) {
+      GLState::bindFramebuffer(layerFBOs[layer]);
+      glClear(GL_DEPTH_BUFFER_BIT);
+    }
+  }
+  GLState::bindFramebuffer(FBO);
+}
+
+// An invalidated cache redraws every layer, due or not, so no cascade
+// keeps showing a static caster that has moved
+unsigned int CascadedShadowMap::writeStaticLayers(const glm::mat4 *transforms, unsigned int mask) {
+  if (staticDirty) {
+    mask = (1u << layerCount) - 1;
+  }
+  unsigned int redraw = 0;
+  for (unsigned int layer = 0; layer < layerCount; layer ++) {
+    if ((mask & (1u << layer)) && (staticDirty || transforms[layer] != staticTransforms[layer])) {
+      staticTransforms[layer] = transforms[layer];
+      GLState::bindFramebuffer(staticLayerFBOs[layer]);
+      glClear(GL_DEPTH_BUFFER_BIT);
+      redraw |= 1u << layer;
+      staticUpdates ++;
+    }
+  }
+  staticDirty = false;
+  if (redraw) {
+    GLState::bindFramebuffer(staticFBO);
+  }
+  return redraw;
+}
+
+// Copies go layer framebuffer to layer framebuffer; the read binding is
+// put back so both targets are FBO, as GLState expects
+unsigned int CascadedShadowMap::writeDynamicLayers(unsigned int mask) {
+  if (!dynamicWritten) {
+    mask = (1u << layerCount) - 1;
+  }
+  dynamicWritten = true;
+  for (unsigned int layer = 0; layer < layerCount; layer ++) {
+    if (mask & (1u << layer)) {
+      GLState::bindFramebuffer(layerFBOs[layer]);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, staticLayerFBOs[layer]);
+      glBlitFramebuffer(0, 0, shadowWidth, shadowHeight, 0, 0, shadowWidth, shadowHeight,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+      glBindFramebuffer(GL_READ_FRAMEBUFFER, layerFBOs[layer]);
+    }
+  }
+  GLState::bindFramebuffer(FBO);
+  return mask;
+}
+
+void CascadedShadowMap::read(GLenum textureUnit) {
+  GLState::bindTexture(textureUnit - GL_TEXTURE0, staticMap && !dynamicWritten ? staticMap : shadowMap,
+		       GL_TEXTURE_2D_ARRAY);
+}
+
+void CascadedShadowMap::deleteLayerFramebuffers(std::vector<GLuint> &layerFramebuffers) {
+  for (size_t i = 0; i < layerFramebuffers.size(); i ++) {
+    if (layerFramebuffers[i]) {
+      glDeleteFramebuffers(1, &layerFramebuffers[i]);
+      GLState::framebufferDeleted(layerFramebuffers[i]);
+    }
+  }
+  layerFramebuffers.clear();
+}
+
+// the base class deletes the layered framebuffers and the arrays
+CascadedShadowMap::~CascadedShadowMap() {
+  deleteLayerFramebuffers(layerFBOs);
+  deleteLayerFramebuffers(staticLayerFBOs);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+
+#include "ShadowMap.h"
+
+// Shadow map as a 2D texture array, one layer per cascade. All layers are
+// attached to one layered framebuffer so a geometry shader can route each
+// triangle to the cascades it touches through gl_Layer, and every layer
+// also has its own framebuffer for clearing and copying just that layer.
+//
+// Calls take a mask of the layers to touch, so cascades that aren't due
+// for an update keep last frame's depth. With the static cache each layer
+// tracks the transform its static casters were drawn with.
+class CascadedShadowMap : public ShadowMap {
+public:
+  explicit CascadedShadowMap(unsigned int layers);
+
+  bool init(GLuint width, GLuint height);
+  bool initStaticCache();
+  // every layer
+  void write();
+  void read(GLenum textureUnit);
+
+  unsigned int getLayerCount() {return layerCount;}
+
+  // clears the layers in mask and binds the layered framebuffer
+  void writeLayers(unsigned int mask);
+  // the layers whose static casters have to be redrawn, cleared and with
+  // the layered static framebuffer bound; 0 binds nothing. These are the
+  // layers in mask with a new transform, or all of them after
+  // invalidateStatic()
+  unsigned int writeStaticLayers(const glm::mat4 *transforms, unsigned int mask);
+  // copies the static layers in mask into the map and binds it for the
+  // dynamic casters; returns the layers to draw them into, which is all
+  // of them the first time since the others were never filled
+  unsigned int writeDynamicLayers(unsigned int mask);
+  // once the map has dynamic casters, read() samples it rather than the
+  // static layers, so it has to be kept up to date from then on
+  bool hasDynamicLayers() {return dynamicWritten;}
+
+  ~CascadedShadowMap();
+
+private:
+  unsigned int layerCount;
+  std::vector<GLuint> layerFBOs, staticLayerFBOs;
+  std::vector<glm::mat4> staticTransforms;
+
+  bool createLayeredTarget(GLuint &framebuffer, GLuint &texture, std::vector<GLuint> &layerFramebuffers);
+  void deleteLayerFramebuffers(std::vector<GLuint> &layerFramebuffers);
+};
@@ -1,31 +1,171 @@
 #include "DirectionalLight.h"
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <float.h>
+#include <math.h>
+
+// blend of logarithmic (1) and uniform (0) cascade splits
+static const float CASCADE_SPLIT_LAMBDA = 0.75f;
+// extra size per frame between a cascade's updates
+static const float CASCADE_SLACK = 0.1f;
+
 DirectionalLight::DirectionalLight() : Light() {
   direction = glm::vec3(0.0f, -1.0f, 0.0f);
   lightProj = glm::ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 20.0f);
+  lightView = glm::lookAt(-direction, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  cascadeMap = nullptr;
+  initCascades();
 }
 
 DirectionalLight::DirectionalLight(GLfloat shadowWidth, GLfloat shadowHeight,
 				   GLfloat red, GLfloat green, GLfloat blue,
 				   GLfloat aIntensity, GLfloat dIntensity,
 				   GLfloat xDir, GLfloat yDir, GLfloat zDir)
-  : Light(shadowWidth, shadowHeight, red, green, blue, aIntensity, dIntensity) {
+  : Light(new CascadedShadowMap(MAX_SHADOW_CASCADES), shadowWidth, shadowHeight,
+	  red, green, blue, aIntensity, dIntensity) {
   direction = glm::vec3(xDir, yDir, zDir);
   lightProj = glm::ortho(-20.0f, 20.0f, -20.0f, 20.0f, 0.1f, 100.0f);
+  lightView = glm::lookAt(-direction, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  cascadeMap = static_cast<CascadedShadowMap*>(shadowMap);
+  initCascades();
 }
 
-void DirectionalLight::useLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-		     GLuint diffuseIntensityLocation, GLuint directionLocation) {
-  glUniform3f(ambientColorLocation, color.x, color.y, color.z);
-  glUniform1f(ambientIntensityLocation, ambientIntensity);
+// empty boxes, so the first update fits every cascade
+void DirectionalLight::initCascades() {
+  for (unsigned int i = 0; i < MAX_SHADOW_CASCADES; i ++) {
+    cascadeTransforms[i] = lightProj * lightView;
+    cascadeMin[i] = glm::vec3(FLT_MAX);
+    cascadeMax[i] = glm::vec3(-FLT_MAX);
+    cascadeIntervals[i] = 1;
+  }
+  cascadeUpdateMask = 0;
+  frameIndex = 0;
+}
+
+void DirectionalLight::fillLightData(DirectionalLightData &data) {
+  Light::fillLightData(data.base);
+  data.direction = direction;
+}
+
+void DirectionalLight::setCascadeInterval(unsigned int cascade, unsigned int frames) {
+  if (cascade < MAX_SHADOW_CASCADES) {
+    cascadeIntervals[cascade] = frames > 0 ? frames : 1;
+  }
+}
+
+// Light space box of the receivers in a slice of the camera frustum,
+// sliceNear to sliceFar in view depth from the near plane. False when the
+// slice holds no scene geometry.
+bool DirectionalLight::fitSlice(const glm::mat4 &cameraInverse, const glm::vec3 &viewDirection,
+				float sliceNear, float sliceFar, const glm::vec3 &casterMin, const glm::vec3 &casterMax,
+				glm::vec3 &fitMin, glm::vec3 &fitMax) {
+  glm::vec3 viewMin(FLT_MAX), viewMax(-FLT_MAX);
+  for (int corner = 0; corner < 8; corner ++) {
+    glm::vec4 nearCorner = cameraInverse * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, -1.0f, 1.0f);
+    glm::vec4 farCorner = cameraInverse * glm::vec4(corner & 1 ? 1.0f : -1.0f, corner & 2 ? 1.0f : -1.0f, 1.0f, 1.0f);
+    glm::vec3 world = glm::vec3(nearCorner) / nearCorner.w;
+    // along the frustum edge to the slice's depth
+    glm::vec3 edge = glm::vec3(farCorner) / farCorner.w - world;
+    float depth = corner & 4 ? sliceFar : sliceNear;
+    world += edge * glm::min(1.0f, depth / glm::dot(edge, viewDirection));
+    glm::vec3 view = glm::vec3(lightView * glm::vec4(world, 1.0f));
+    viewMin = glm::min(viewMin, view);
+    viewMax = glm::max(viewMax, view);
+  }
+
+  fitMin = glm::max(viewMin, casterMin);
+  fitMax = glm::min(viewMax, casterMax);
+  return fitMin.x <= fitMax.x && fitMin.y <= fitMax.y && fitMin.z <= fitMax.z;
+}
+
+// The view is a pure rotation about the world origin, so light space x
+// and y are fixed world axes and snapping to texels there holds still as
+// the camera moves
+void DirectionalLight::updateCascades(const glm::mat4 &cameraViewProjection, float cameraNear, float shadowDistance,
+				      const glm::vec3 &sceneMin, const glm::vec3 &sceneMax) {
+  glm::vec3 forward = glm::normalize(direction);
+  glm::vec3 up = fabsf(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::mat4 previousView = lightView;
+  lightView = glm::lookAt(glm::vec3(0.0f), forward, up);
+  // a turned light invalidates every cascade box
+  bool turned = lightView != previousView;
+
+  glm::vec3 casterMin(FLT_MAX), casterMax(-FLT_MAX);
+  for (int corner = 0; corner < 8; corner ++) {
+    glm::vec3 scene(corner & 1 ? sceneMax.x : sceneMin.x,
+		    corner & 2 ? sceneMax.y : sceneMin.y,
+		    corner & 4 ? sceneMax.z : sceneMin.z);
+    glm::vec3 caster = glm::vec3(lightView * glm::vec4(scene, 1.0f));
+    casterMin = glm::min(casterMin, caster);
+    casterMax = glm::max(casterMax, caster);
+  }
+
+  glm::mat4 cameraInverse = glm::inverse(cameraViewProjection);
+  glm::vec4 nearCenter = cameraInverse * glm::vec4(0.0f, 0.0f, -1.0f, 1.0f);
+  glm::vec4 farCenter = cameraInverse * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+  glm::vec3 viewDirection = glm::normalize(glm::vec3(farCenter) / farCenter.w - glm::vec3(nearCenter) / nearCenter.w);
+
+  float resolution = shadowMap ? shadowMap->getShadowWidth() : 0.0f;
+  float farDistance = glm::max(shadowDistance, cameraNear * 1.01f);
+  cascadeUpdateMask = 0;
+  float sliceNear = cameraNear;
+  for (unsigned int i = 0; i < MAX_SHADOW_CASCADES; i ++) {
+    float t = (float)(i + 1) / MAX_SHADOW_CASCADES;
+    float sliceFar = CASCADE_SPLIT_LAMBDA * cameraNear * powf(farDistance / cameraNear, t) +
+      (1.0f - CASCADE_SPLIT_LAMBDA) * (cameraNear + (farDistance - cameraNear) * t);
+
+    glm::vec3 fitMin, fitMax;
+    if (!fitSlice(cameraInverse, viewDirection, sliceNear - cameraNear, sliceFar - cameraNear,
+		  casterMin, casterMax, fitMin, fitMax)) {
+      fitMin = casterMin;
+      fitMax = casterMax;
+    }
+    sliceNear = sliceFar;
+
+    bool due = frameIndex % cascadeIntervals[i] == i % cascadeIntervals[i];
+    bool covered = glm::min(fitMin, cascadeMin[i]) == cascadeMin[i] && glm::max(fitMax, cascadeMax[i]) == cascadeMax[i];
+    if (!due && covered && !turned) {
+      continue;
+    }
+
+    // cascades refreshed less often get slack to stay covering their
+    // slice until they are next due
+    float slack = 1.02f + CASCADE_SLACK * (cascadeIntervals[i] - 1);
+    float size = glm::max(fitMax.x - fitMin.x, fitMax.y - fitMin.y) * slack;
+    size = powf(2.0f, ceilf(log2f(glm::max(size, 1e-3f)) * 4.0f) / 4.0f);
+    float left = (fitMin.x + fitMax.x) * 0.5f - size * 0.5f;
+    float bottom = (fitMin.y + fitMax.y) * 0.5f - size * 0.5f;
+    if (resolution > 0.0f) {
+      float texel = size / resolution;
+      left = floorf(left / texel) * texel;
+      bottom = floorf(bottom / texel) * texel;
+    }
+    // the view looks down -z; near reaches every caster between the
+    // receivers and the light
+    float nearPlane = floorf(-casterMax.z) - 1.0f;
+    float farPlane = ceilf(-fitMin.z) + 1.0f;
 
-  glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-  glUniform1f(diffuseIntensityLocation, diffuseIntensity);
+    cascadeMin[i] = glm::vec3(left, bottom, -farPlane);
+    cascadeMax[i] = glm::vec3(left + size, bottom + size, -nearPlane);
+    cascadeTransforms[i] = glm::ortho(left, left + size, bottom, bottom + size, nearPlane, farPlane) * lightView;
+    cascadeUpdateMask |= 1u << i;
+  }
+  frameIndex ++;
 }
 
-glm::mat4 DirectionalLight::calculateLightTransform() {
-  return lightProj * glm::lookAt(-direction, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+// The cascades share the light view, so their union is one more ortho box
+glm::mat4 DirectionalLight::calculateLightTransform(unsigned int mask) {
+  glm::vec3 unionMin(FLT_MAX), unionMax(-FLT_MAX);
+  for (unsigned int i = 0; i < MAX_SHADOW_CASCADES; i ++) {
+    if ((mask & (1u << i)) && cascadeMin[i].x <= cascadeMax[i].x) {
+      unionMin = glm::min(unionMin, cascadeMin[i]);
+      unionMax = glm::max(unionMax, cascadeMax[i]);
+    }
+  }
+  if (unionMin.x > unionMax.x) {
+    return lightProj * lightView;
+  }
+  return glm::ortho(unionMin.x, unionMax.x, unionMin.y, unionMax.y, -unionMax.z, -unionMin.z) * lightView;
 }
 
 DirectionalLight::~DirectionalLight() {
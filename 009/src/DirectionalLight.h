@@ -1,22 +1,63 @@
 #pragma once
 #include "Light.h"
+#include "CascadedShadowMap.h"
+#include "constants.h"
 
+#include <float.h>
+
+// Sun light with cascaded shadows. The first shadowDistance of the camera's
+// view is split into cascades, each fitted by its own orthographic
+// projection and rendered into a layer of one CascadedShadowMap.
 class DirectionalLight : public Light {
 public:
   DirectionalLight();
 
+  // the shadow size is per cascade
   DirectionalLight(GLfloat shadowWidth, GLfloat shadowHeight,
 		   GLfloat red, GLfloat green, GLfloat blue,
 		   GLfloat aIntensity, GLfloat dIntensity,
 		   GLfloat xDir, GLfloat yDir, GLfloat zDir);
 
-  void useLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-		GLuint diffuseIntensityLocation, GLuint directionLocation);
+  void fillLightData(DirectionalLightData &data);
+
+  // Refits the cascades due this frame. Each one covers the part of its
+  // slice of the view that holds scene geometry and reaches back toward
+  // the light to every caster in the scene. Sizes grow in quarter octaves
+  // and corners snap to whole shadow map texels, so the maps only shimmer
+  // when a size steps. A cascade that isn't due is refitted anyway once
+  // its slice has moved out of what it covers.
+  void updateCascades(const glm::mat4 &cameraViewProjection, float cameraNear, float shadowDistance,
+		      const glm::vec3 &sceneMin, const glm::vec3 &sceneMax);
+  // cascade is refreshed every frames frames, staggered against the others
+  void setCascadeInterval(unsigned int cascade, unsigned int frames);
+
+  unsigned int getCascadeCount() {return MAX_SHADOW_CASCADES;}
+  // the transforms each layer was last rendered with
+  const glm::mat4 *getCascadeTransforms() {return cascadeTransforms;}
+  // cascades refitted by the last updateCascades()
+  unsigned int getCascadeUpdateMask() {return cascadeUpdateMask;}
+  CascadedShadowMap *getCascadedShadowMap() {return cascadeMap;}
 
-  glm::mat4 calculateLightTransform();
+  // covers every cascade updated this frame, for culling their casters
+  glm::mat4 calculateLightTransform() {return calculateLightTransform(cascadeUpdateMask);}
+  // covers the cascades in mask
+  glm::mat4 calculateLightTransform(unsigned int mask);
   
   ~DirectionalLight();
   
 private:
   glm::vec3 direction;
+  glm::mat4 lightView;
+
+  CascadedShadowMap *cascadeMap;
+  glm::mat4 cascadeTransforms[MAX_SHADOW_CASCADES];
+  // light space box of each cascade's projection
+  glm::vec3 cascadeMin[MAX_SHADOW_CASCADES], cascadeMax[MAX_SHADOW_CASCADES];
+  unsigned int cascadeIntervals[MAX_SHADOW_CASCADES];
+  unsigned int cascadeUpdateMask;
+  unsigned int frameIndex;
+
+  void initCascades();
+  bool fitSlice(const glm::mat4 &cameraInverse, const glm::vec3 &viewDirection, float sliceNear, float sliceFar,
+		const glm::vec3 &casterMin, const glm::vec3 &casterMax, glm::vec3 &fitMin, glm::vec3 &fitMax);
 };
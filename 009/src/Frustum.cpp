@@ -0,0 +1,94 @@
+#include "Frustum.h"
+
+#include <math.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+// Planes from the rows of the matrix (Gribb and Hartmann). They aren't
+// normalized since only the sign matters.
+Frustum::Frustum(const glm::mat4 &m) {
+  glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+  planes[0] = row3 + row0;
+  planes[1] = row3 - row0;
+  planes[2] = row3 + row1;
+  planes[3] = row3 - row1;
+  planes[4] = row3 + row2;
+  planes[5] = row3 - row2;
+}
+
+// A box is outside a plane when even its corner furthest along the
+// normal is behind it, dot(n, c) + dot(|n|, e) + w < 0, and inside when
+// the nearest corner is in front, dot(n, c) - dot(|n|, e) + w >= 0
+FrustumTest Frustum::testBox(const glm::vec3 &center, const glm::vec3 &extent) const {
+  FrustumTest result = FRUSTUM_INSIDE;
+  for (int p = 0; p < 6; p ++) {
+    glm::vec3 normal(planes[p]);
+    float distance = glm::dot(normal, center) + planes[p].w;
+    float radius = glm::dot(glm::abs(normal), extent);
+    if (distance + radius < 0.0f) {
+      return FRUSTUM_OUTSIDE;
+    }
+    if (distance - radius < 0.0f) {
+      result = FRUSTUM_INTERSECTS;
+    }
+  }
+  return result;
+}
+
+void Frustum::cullBoxes(const float *centerX, const float *centerY, const float *centerZ,
+			const float *extentX, const float *extentY, const float *extentZ,
+			size_t count, uint8_t *visible) const {
+  size_t i = 0;
+#ifdef __SSE__
+  for (; i + 4 <= count; i += 4) {
+    __m128 cx = _mm_loadu_ps(centerX + i);
+    __m128 cy = _mm_loadu_ps(centerY + i);
+    __m128 cz = _mm_loadu_ps(centerZ + i);
+    __m128 ex = _mm_loadu_ps(extentX + i);
+    __m128 ey = _mm_loadu_ps(extentY + i);
+    __m128 ez = _mm_loadu_ps(extentZ + i);
+    __m128 outside = _mm_setzero_ps();
+    for (int p = 0; p < 6; p ++) {
+      __m128 nx = _mm_set1_ps(planes[p].x);
+      __m128 ny = _mm_set1_ps(planes[p].y);
+      __m128 nz = _mm_set1_ps(planes[p].z);
+      __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+				   _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(planes[p].w)));
+      __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fabsf(planes[p].x)), ex),
+					    _mm_mul_ps(_mm_set1_ps(fabsf(planes[p].y)), ey)),
+				 _mm_mul_ps(_mm_set1_ps(fabsf(planes[p].z)), ez));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()));
+    }
+    int mask = _mm_movemask_ps(outside);
+    for (int lane = 0; lane < 4; lane ++) {
+      visible[i + lane] = !(mask & (1 << lane));
+    }
+  }
+#endif
+  for (; i < count; i ++) {
+    bool outside = false;
+    for (int p = 0; p < 6 && !outside; p ++) {
+      float distance = planes[p].x * centerX[i] + planes[p].y * centerY[i] + planes[p].z * centerZ[i] + planes[p].w;
+      float radius = fabsf(planes[p].x) * extentX[i] + fabsf(planes[p].y) * extentY[i] + fabsf(planes[p].z) * extentZ[i];
+      outside = distance + radius < 0.0f;
+    }
+    visible[i] = !outside;
+  }
+}
+
+void transformBox(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &transform,
+		  glm::vec3 &center, glm::vec3 &extent) {
+  glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+  glm::vec3 localExtent = (boundsMax - boundsMin) * 0.5f;
+  center = glm::vec3(transform * glm::vec4(localCenter, 1.0f));
+  // each world axis gets the absolute contribution of every local axis
+  extent =
+    glm::abs(glm::vec3(transform[0])) * localExtent.x +
+    glm::abs(glm::vec3(transform[1])) * localExtent.y +
+    glm::abs(glm::vec3(transform[2])) * localExtent.z;
+}
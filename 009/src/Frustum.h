@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <glm/glm.hpp>
+
+enum FrustumTest {
+  FRUSTUM_OUTSIDE,
+  FRUSTUM_INTERSECTS,
+  FRUSTUM_INSIDE
+};
+
+// The six planes of a view-projection matrix. A point is inside when
+// dot(plane.xyz, p) + plane.w >= 0 for every plane.
+struct Frustum {
+  glm::vec4 planes[6];
+
+  Frustum() {}
+  explicit Frustum(const glm::mat4 &viewProjection);
+
+  FrustumTest testBox(const glm::vec3 &center, const glm::vec3 &extent) const;
+  // boxes as structure of arrays (centre and half extent per axis), four
+  // at a time with SSE; visible[i] is 1 unless box i is outside
+  void cullBoxes(const float *centerX, const float *centerY, const float *centerZ,
+		 const float *extentX, const float *extentY, const float *extentZ,
+		 size_t count, uint8_t *visible) const;
+};
+
+// Box containing a local box after transform (Arvo)
+void transformBox(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, const glm::mat4 &transform,
+		  glm::vec3 &center, glm::vec3 &extent);
@@ -0,0 +1,189 @@
+#include "GLState.h"
+
+#include <stdio.h>
+
+// ~0u marks a binding we don't know, so the next bind always goes through
+static const GLuint UNKNOWN = ~0u;
+
+// only these buffer targets are shadowed
+static const GLenum BUFFER_TARGETS[] = {
+  GL_ARRAY_BUFFER,
+  GL_UNIFORM_BUFFER,
+  GL_COPY_READ_BUFFER,
+  GL_COPY_WRITE_BUFFER,
+  GL_DRAW_INDIRECT_BUFFER
+};
+static const unsigned int BUFFER_TARGET_COUNT = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0]);
+
+static struct {
+  GLuint program;
+  GLuint vertexArray;
+  GLuint buffers[BUFFER_TARGET_COUNT];
+  GLuint activeUnit;
+  GLuint textures[GLState::MAX_TEXTURE_UNITS];
+  GLuint framebuffer;
+  GLint viewport[4];
+
+  unsigned int issued, elided;
+  unsigned int lastIssued, lastElided;
+} state = {
+  UNKNOWN, UNKNOWN,
+  {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN},
+  UNKNOWN,
+  {UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN,
+   UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN, UNKNOWN},
+  UNKNOWN,
+  {-1, -1, -1, -1},
+  0, 0, 0, 0
+};
+
+// true when the call has to be made
+static bool update(GLuint &shadow, GLuint value) {
+  if (shadow == value) {
+    state.elided ++;
+    return false;
+  }
+  shadow = value;
+  state.issued ++;
+  return true;
+}
+
+static int bufferSlot(GLenum target) {
+  for (unsigned int i = 0; i < BUFFER_TARGET_COUNT; i ++) {
+    if (BUFFER_TARGETS[i] == target) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void GLState::useProgram(GLuint program) {
+  if (update(state.program, program)) {
+    glUseProgram(program);
+  }
+}
+
+void GLState::bindVertexArray(GLuint vertexArray) {
+  if (update(state.vertexArray, vertexArray)) {
+    glBindVertexArray(vertexArray);
+  }
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+  int slot = bufferSlot(target);
+  if (slot < 0) {
+    state.issued ++;
+    glBindBuffer(target, buffer);
+  } else if (update(state.buffers[slot], buffer)) {
+    glBindBuffer(target, buffer);
+  }
+}
+
+void GLState::bindTexture(GLuint unit, GLuint texture, GLenum target) {
+  if (unit >= MAX_TEXTURE_UNITS) {
+    state.issued += 2;
+    state.activeUnit = unit;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, texture);
+    return;
+  }
+  if (state.textures[unit] == texture) {
+    state.elided ++;
+    return;
+  }
+  if (update(state.activeUnit, unit)) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+  }
+  state.textures[unit] = texture;
+  state.issued ++;
+  glBindTexture(target, texture);
+}
+
+void GLState::bindFramebuffer(GLuint framebuffer) {
+  if (update(state.framebuffer, framebuffer)) {
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+  }
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  if (state.viewport[0] == x && state.viewport[1] == y &&
+      state.viewport[2] == width && state.viewport[3] == height) {
+    state.elided ++;
+    return;
+  }
+  state.viewport[0] = x;
+  state.viewport[1] = y;
+  state.viewport[2] = width;
+  state.viewport[3] = height;
+  state.issued ++;
+  glViewport(x, y, width, height);
+}
+
+void GLState::programDeleted(GLuint program) {
+  if (state.program == program) {
+    state.program = UNKNOWN;
+  }
+}
+
+void GLState::vertexArrayDeleted(GLuint vertexArray) {
+  if (state.vertexArray == vertexArray) {
+    state.vertexArray = UNKNOWN;
+  }
+}
+
+void GLState::bufferDeleted(GLuint buffer) {
+  for (unsigned int i = 0; i < BUFFER_TARGET_COUNT; i ++) {
+    if (state.buffers[i] == buffer) {
+      state.buffers[i] = UNKNOWN;
+    }
+  }
+}
+
+void GLState::textureDeleted(GLuint texture) {
+  for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i ++) {
+    if (state.textures[i] == texture) {
+      state.textures[i] = UNKNOWN;
+    }
+  }
+}
+
+void GLState::framebufferDeleted(GLuint framebuffer) {
+  if (state.framebuffer == framebuffer) {
+    state.framebuffer = UNKNOWN;
+  }
+}
+
+void GLState::invalidate() {
+  state.program = UNKNOWN;
+  state.vertexArray = UNKNOWN;
+  for (unsigned int i = 0; i < BUFFER_TARGET_COUNT; i ++) {
+    state.buffers[i] = UNKNOWN;
+  }
+  state.activeUnit = UNKNOWN;
+  for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i ++) {
+    state.textures[i] = UNKNOWN;
+  }
+  state.framebuffer = UNKNOWN;
+  state.viewport[2] = -1;
+}
+
+void GLState::endFrame() {
+  state.lastIssued = state.issued;
+  state.lastElided = state.elided;
+  state.issued = 0;
+  state.elided = 0;
+}
+
+unsigned int GLState::getIssuedCalls() {
+  return state.lastIssued;
+}
+
+unsigned int GLState::getElidedCalls() {
+  return state.lastElided;
+}
+
+void GLState::printStats() {
+  unsigned int total = state.lastIssued + state.lastElided;
+  printf("GL state: %u binds issued, %u elided (%.0f%%) last frame\n", state.lastIssued, state.lastElided,
+	 total ? 100.0f * state.lastElided / total : 0.0f);
+}
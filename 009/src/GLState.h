@@ -0,0 +1,37 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Shadow copy of the GL binding state the engine touches. Every bind
+// goes through here and calls that wouldn't change anything are dropped.
+// Anything that binds behind its back has to call invalidate().
+//
+// Element array buffers are VAO state and aren't shadowed; bind them only
+// while building a VAO.
+class GLState {
+public:
+  static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+  static void useProgram(GLuint program);
+  static void bindVertexArray(GLuint vertexArray);
+  static void bindBuffer(GLenum target, GLuint buffer);
+  // texture names are unique across targets, so only the name is tracked
+  static void bindTexture(GLuint unit, GLuint texture, GLenum target = GL_TEXTURE_2D);
+  static void bindFramebuffer(GLuint framebuffer);
+  static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+  // GL unbinds deleted objects and may hand their names out again
+  static void programDeleted(GLuint program);
+  static void vertexArrayDeleted(GLuint vertexArray);
+  static void bufferDeleted(GLuint buffer);
+  static void textureDeleted(GLuint texture);
+  static void framebufferDeleted(GLuint framebuffer);
+
+  static void invalidate();
+
+  // counters cover the frame before the last endFrame()
+  static void endFrame();
+  static unsigned int getIssuedCalls();
+  static unsigned int getElidedCalls();
+  static void printStats();
+};
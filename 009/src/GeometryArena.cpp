@@ -0,0 +1,351 @@
+#include "GeometryArena.h"
+#include "GLState.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// elements a pool starts with; pools double from there
+static const GLuint INITIAL_POOL_ELEMENTS = 1 << 16;
+
+FreeListAllocator::FreeListAllocator() {
+  capacity = 0;
+}
+
+void FreeListAllocator::init(GLuint newCapacity) {
+  capacity = newCapacity;
+  freeRanges.clear();
+  if (capacity > 0) {
+    freeRanges[0] = capacity;
+  }
+}
+
+bool FreeListAllocator::allocate(GLuint count, GLuint &first) {
+  for (std::map<GLuint, GLuint>::iterator it = freeRanges.begin(); it != freeRanges.end(); ++ it) {
+    if (it->second < count) {
+      continue;
+    }
+    first = it->first;
+    GLuint remaining = it->second - count;
+    freeRanges.erase(it);
+    if (remaining > 0) {
+      freeRanges[first + count] = remaining;
+    }
+    return true;
+  }
+  return false;
+}
+
+void FreeListAllocator::release(GLuint first, GLuint count) {
+  if (count == 0) {
+    return;
+  }
+  std::map<GLuint, GLuint>::iterator next = freeRanges.lower_bound(first);
+  if (next != freeRanges.end() && first + count == next->first) {
+    count += next->second;
+    next = freeRanges.erase(next);
+  }
+  if (next != freeRanges.begin()) {
+    std::map<GLuint, GLuint>::iterator previous = next;
+    -- previous;
+    if (previous->first + previous->second == first) {
+      previous->second += count;
+      return;
+    }
+  }
+  freeRanges[first] = count;
+}
+
+void FreeListAllocator::grow(GLuint newCapacity) {
+  if (newCapacity > capacity) {
+    GLuint oldCapacity = capacity;
+    capacity = newCapacity;
+    release(oldCapacity, newCapacity - oldCapacity);
+  }
+}
+
+FreeListAllocator::~FreeListAllocator() {
+  
+}
+
+GeometryArena::GeometryArena() {
+  active = false;
+  for (unsigned int f = 0; f < FORMAT_COUNT; f ++) {
+    vertexPools[f].buffer = 0;
+    vertexPools[f].elementSize = vertexFormatStride(static_cast<VertexFormat>(f));
+    for (unsigned int t = 0; t < INDEX_TYPE_COUNT; t ++) {
+      vertexArrays[f][t] = 0;
+      vertexArrayDrawData[f][t] = 0;
+    }
+  }
+  indexPools[0].buffer = 0;
+  indexPools[0].elementSize = sizeof(GLushort);
+  indexPools[1].buffer = 0;
+  indexPools[1].elementSize = sizeof(GLuint);
+  drawDataBuffer = 0;
+  indirectBuffer = 0;
+  ringBuffer = nullptr;
+  multiDrawCalls = 0;
+  commandCount = 0;
+  lastMultiDrawCalls = 0;
+  lastCommands = 0;
+}
+
+bool GeometryArena::init() {
+  clear();
+  active = GLEW_VERSION_4_3 ||
+    (GLEW_ARB_vertex_attrib_binding && GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+  if (!active) {
+    printf("Geometry arena unavailable, meshes keep their own buffers\n");
+    return false;
+  }
+  glGenBuffers(1, &drawDataBuffer);
+  glGenBuffers(1, &indirectBuffer);
+  return true;
+}
+
+unsigned int GeometryArena::indexTypeSlot(GLenum indexType) {
+  return indexType == GL_UNSIGNED_SHORT ? 0 : 1;
+}
+
+bool GeometryArena::reserve(Pool &pool, GLuint count, GLuint &first) {
+  if (pool.allocator.allocate(count, first)) {
+    return true;
+  }
+
+  GLuint oldCapacity = pool.allocator.getCapacity();
+  GLuint newCapacity = oldCapacity ? oldCapacity * 2 : INITIAL_POOL_ELEMENTS;
+  while (newCapacity < oldCapacity + count) {
+    newCapacity *= 2;
+  }
+
+  // copy buffers are the only targets that touch no VAO state
+  GLuint buffer = 0;
+  glGenBuffers(1, &buffer);
+  GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(newCapacity) * pool.elementSize, nullptr, GL_STATIC_DRAW);
+  if (pool.buffer) {
+    GLState::bindBuffer(GL_COPY_READ_BUFFER, pool.buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, GLsizeiptr(oldCapacity) * pool.elementSize);
+    glDeleteBuffers(1, &pool.buffer);
+    GLState::bufferDeleted(pool.buffer);
+  }
+  pool.buffer = buffer;
+  if (oldCapacity) {
+    pool.allocator.grow(newCapacity);
+  } else {
+    pool.allocator.init(newCapacity);
+  }
+  // VAOs point at the old buffers
+  resetVertexArrays();
+
+  return pool.allocator.allocate(count, first);
+}
+
+bool GeometryArena::upload(VertexFormat format, const std::vector<unsigned char> &vertices, GLuint vertexCount,
+			   const void *indices, GLuint indexCount, GLenum indexType, ArenaMesh &mesh) {
+  if (!active || vertexCount == 0 || indexCount == 0) {
+    return false;
+  }
+  Pool &vertexPool = vertexPools[format];
+  Pool &indexPool = indexPools[indexTypeSlot(indexType)];
+
+  mesh.format = format;
+  mesh.indexType = indexType;
+  mesh.vertexCount = vertexCount;
+  mesh.indexCount = indexCount;
+  if (!reserve(vertexPool, vertexCount, mesh.firstVertex)) {
+    return false;
+  }
+  if (!reserve(indexPool, indexCount, mesh.firstIndex)) {
+    vertexPool.allocator.release(mesh.firstVertex, vertexCount);
+    return false;
+  }
+
+  GLState::bindBuffer(GL_COPY_WRITE_BUFFER, vertexPool.buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(mesh.firstVertex) * vertexPool.elementSize,
+		  GLsizeiptr(vertexCount) * vertexPool.elementSize, &vertices[0]);
+  GLState::bindBuffer(GL_COPY_WRITE_BUFFER, indexPool.buffer);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(mesh.firstIndex) * indexPool.elementSize,
+		  GLsizeiptr(indexCount) * indexPool.elementSize, indices);
+  return true;
+}
+
+void GeometryArena::release(const ArenaMesh &mesh) {
+  vertexPools[mesh.format].allocator.release(mesh.firstVertex, mesh.vertexCount);
+  indexPools[indexTypeSlot(mesh.indexType)].allocator.release(mesh.firstIndex, mesh.indexCount);
+}
+
+void GeometryArena::resetVertexArrays() {
+  for (unsigned int f = 0; f < FORMAT_COUNT; f ++) {
+    for (unsigned int t = 0; t < INDEX_TYPE_COUNT; t ++) {
+      if (vertexArrays[f][t]) {
+	glDeleteVertexArrays(1, &vertexArrays[f][t]);
+	GLState::vertexArrayDeleted(vertexArrays[f][t]);
+	vertexArrays[f][t] = 0;
+      }
+    }
+  }
+}
+
+GLuint GeometryArena::getVertexArray(unsigned int format, unsigned int indexType) {
+  GLuint &vertexArray = vertexArrays[format][indexType];
+  if (vertexArray) {
+    return vertexArray;
+  }
+
+  glGenVertexArrays(1, &vertexArray);
+  GLState::bindVertexArray(vertexArray);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexPools[indexType].buffer);
+
+  setVertexFormatBinding(static_cast<VertexFormat>(format), 0);
+  glBindVertexBuffer(0, vertexPools[format].buffer, 0, vertexPools[format].elementSize);
+
+  glVertexAttribFormat(3, 3, GL_FLOAT, GL_FALSE, offsetof(DrawData, positionScale));
+  glVertexAttribFormat(4, 3, GL_FLOAT, GL_FALSE, offsetof(DrawData, positionOffset));
+  glVertexAttribFormat(5, 4, GL_FLOAT, GL_FALSE, offsetof(DrawData, texCoordTransform));
+  for (GLuint column = 0; column < 4; column ++) {
+    glVertexAttribFormat(6 + column, 4, GL_FLOAT, GL_FALSE, offsetof(DrawData, model) + sizeof(glm::vec4) * column);
+  }
+  glVertexAttribIFormat(10, 1, GL_INT, offsetof(DrawData, materialIndex));
+  glVertexAttribFormat(11, 2, GL_FLOAT, GL_FALSE, offsetof(DrawData, material));
+  for (GLuint column = 0; column < 3; column ++) {
+    glVertexAttribFormat(12 + column, 3, GL_FLOAT, GL_FALSE, offsetof(DrawData, normalMatrix) + sizeof(glm::vec3) * column);
+  }
+  for (GLuint attribute = 3; attribute <= 14; attribute ++) {
+    glVertexAttribBinding(attribute, 1);
+    glEnableVertexAttribArray(attribute);
+  }
+  glVertexBindingDivisor(1, 1);
+  // bound in flush()
+  vertexArrayDrawData[format][indexType] = 0;
+
+  return vertexArray;
+}
+
+void GeometryArena::addDraw(const ArenaMesh &mesh, GLuint firstIndex, GLuint indexCount,
+			    const DrawData *draws, GLuint drawCount) {
+  if (drawCount == 0 || indexCount == 0) {
+    return;
+  }
+  IndirectCommand command;
+  command.count = indexCount;
+  command.instanceCount = drawCount;
+  command.firstIndex = mesh.firstIndex + firstIndex;
+  command.baseVertex = mesh.firstVertex;
+  command.baseInstance = drawData.size();
+  commands[mesh.format][indexTypeSlot(mesh.indexType)].push_back(command);
+  drawData.insert(drawData.end(), draws, draws + drawCount);
+}
+
+void GeometryArena::flush() {
+  if (drawData.empty()) {
+    return;
+  }
+
+  allCommands.clear();
+  size_t groupStart[FORMAT_COUNT][INDEX_TYPE_COUNT];
+  for (unsigned int f = 0; f < FORMAT_COUNT; f ++) {
+    for (unsigned int t = 0; t < INDEX_TYPE_COUNT; t ++) {
+      groupStart[f][t] = allCommands.size();
+      allCommands.insert(allCommands.end(), commands[f][t].begin(), commands[f][t].end());
+    }
+  }
+
+  GLsizeiptr drawDataSize = sizeof(DrawData) * drawData.size();
+  GLsizeiptr commandsSize = sizeof(IndirectCommand) * allCommands.size();
+  GLuint drawDataSource = drawDataBuffer;
+  GLuint commandSource = indirectBuffer;
+  GLintptr commandOffset = 0;
+  GLintptr drawDataOffset = 0;
+  void *drawDataTarget = nullptr;
+  void *commandTarget = nullptr;
+  if (ringBuffer && ringBuffer->isActive()) {
+    // draw data aligned to whole entries, so baseInstance can absorb the
+    // offset and the VAOs keep reading from the start of the ring
+    drawDataTarget = ringBuffer->allocate(drawDataSize, sizeof(DrawData), drawDataOffset);
+    commandTarget = ringBuffer->allocate(commandsSize, sizeof(GLuint), commandOffset);
+  }
+  if (drawDataTarget && commandTarget) {
+    GLuint baseInstance = drawDataOffset / sizeof(DrawData);
+    for (size_t i = 0; i < allCommands.size(); i ++) {
+      allCommands[i].baseInstance += baseInstance;
+    }
+    memcpy(drawDataTarget, &drawData[0], drawDataSize);
+    memcpy(commandTarget, &allCommands[0], commandsSize);
+    drawDataSource = commandSource = ringBuffer->getBuffer();
+  } else {
+    commandOffset = 0;
+    GLState::bindBuffer(GL_ARRAY_BUFFER, drawDataBuffer);
+    glBufferData(GL_ARRAY_BUFFER, drawDataSize, &drawData[0], GL_STREAM_DRAW);
+    GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, commandsSize, &allCommands[0], GL_STREAM_DRAW);
+  }
+  GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, commandSource);
+
+  for (unsigned int f = 0; f < FORMAT_COUNT; f ++) {
+    for (unsigned int t = 0; t < INDEX_TYPE_COUNT; t ++) {
+      if (commands[f][t].empty()) {
+	continue;
+      }
+      GLState::bindVertexArray(getVertexArray(f, t));
+      if (vertexArrayDrawData[f][t] != drawDataSource) {
+	glBindVertexBuffer(1, drawDataSource, 0, sizeof(DrawData));
+	vertexArrayDrawData[f][t] = drawDataSource;
+      }
+      glMultiDrawElementsIndirect(GL_TRIANGLES, t == 0 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+				  (const GLvoid*)(commandOffset + groupStart[f][t] * sizeof(IndirectCommand)),
+				  commands[f][t].size(), 0);
+      multiDrawCalls ++;
+      commandCount += commands[f][t].size();
+      commands[f][t].clear();
+    }
+  }
+  drawData.clear();
+}
+
+void GeometryArena::endFrame() {
+  lastMultiDrawCalls = multiDrawCalls;
+  lastCommands = commandCount;
+  multiDrawCalls = 0;
+  commandCount = 0;
+}
+
+void GeometryArena::clear() {
+  resetVertexArrays();
+  for (unsigned int f = 0; f < FORMAT_COUNT; f ++) {
+    if (vertexPools[f].buffer) {
+      glDeleteBuffers(1, &vertexPools[f].buffer);
+      GLState::bufferDeleted(vertexPools[f].buffer);
+      vertexPools[f].buffer = 0;
+    }
+    vertexPools[f].allocator.init(0);
+    for (unsigned int t = 0; t < INDEX_TYPE_COUNT; t ++) {
+      commands[f][t].clear();
+    }
+  }
+  for (unsigned int t = 0; t < INDEX_TYPE_COUNT; t ++) {
+    if (indexPools[t].buffer) {
+      glDeleteBuffers(1, &indexPools[t].buffer);
+      GLState::bufferDeleted(indexPools[t].buffer);
+      indexPools[t].buffer = 0;
+    }
+    indexPools[t].allocator.init(0);
+  }
+  if (drawDataBuffer) {
+    glDeleteBuffers(1, &drawDataBuffer);
+    GLState::bufferDeleted(drawDataBuffer);
+    drawDataBuffer = 0;
+  }
+  if (indirectBuffer) {
+    glDeleteBuffers(1, &indirectBuffer);
+    GLState::bufferDeleted(indirectBuffer);
+    indirectBuffer = 0;
+  }
+  drawData.clear();
+  active = false;
+}
+
+GeometryArena::~GeometryArena() {
+  
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+#include "RingBuffer.h"
+
+// First-fit free list over a range of elements, merging neighbours on
+// release
+class FreeListAllocator {
+public:
+  FreeListAllocator();
+
+  void init(GLuint capacity);
+  bool allocate(GLuint count, GLuint &first);
+  void release(GLuint first, GLuint count);
+  // adds the new tail to the free list
+  void grow(GLuint newCapacity);
+  GLuint getCapacity() {return capacity;}
+
+  ~FreeListAllocator();
+
+private:
+  GLuint capacity;
+  std::map<GLuint, GLuint> freeRanges;   // first -> count
+};
+
+// Where a mesh lives in the arena, in vertices and indices
+struct ArenaMesh {
+  VertexFormat format;
+  GLenum indexType;
+  GLuint firstVertex, vertexCount;
+  GLuint firstIndex, indexCount;
+};
+
+// Per draw (or per instance) data, read at attributes 3-14 with divisor 1
+// and selected by the indirect command's baseInstance. Same attributes
+// Mesh otherwise sets as constants.
+struct DrawData {
+  glm::vec3 positionScale;
+  glm::vec3 positionOffset;
+  glm::vec4 texCoordTransform;
+  glm::mat4 model;
+  glm::mat3 normalMatrix;
+  GLint materialIndex;
+  glm::vec2 material;       // specular intensity, shininess
+};
+
+// Shared vertex and index buffers for every mesh, one of each per vertex
+// format and index type, sub-allocated from free lists and grown by
+// copying when full. Draws are collected with addDraw() and go out in
+// flush() as one glMultiDrawElementsIndirect per format/index type pair
+// in use, each through a VAO set up with glVertexAttribFormat. Draw data
+// and commands are copied into the RingBuffer when one is set, and into
+// orphaned buffers otherwise.
+//
+// Needs GL 4.3 (or the vertex_attrib_binding, multi_draw_indirect and
+// base_instance extensions); init() returns false otherwise and meshes
+// keep their own buffers.
+class GeometryArena {
+public:
+  GeometryArena();
+
+  bool init();
+  bool isActive() {return active;}
+  void setRingBuffer(RingBuffer *ring) {ringBuffer = ring;}
+
+  bool upload(VertexFormat format, const std::vector<unsigned char> &vertices, GLuint vertexCount,
+	      const void *indices, GLuint indexCount, GLenum indexType, ArenaMesh &mesh);
+  void release(const ArenaMesh &mesh);
+
+  // firstIndex is relative to the mesh
+  void addDraw(const ArenaMesh &mesh, GLuint firstIndex, GLuint indexCount,
+	       const DrawData *draws, GLuint drawCount);
+  void flush();
+
+  // multi-draw calls and the commands they carried since the last endFrame()
+  void endFrame();
+  unsigned int getMultiDrawCalls() {return lastMultiDrawCalls;}
+  unsigned int getCommands() {return lastCommands;}
+
+  void clear();
+
+  ~GeometryArena();
+
+private:
+  struct Pool {
+    GLuint buffer;
+    GLuint elementSize;
+    FreeListAllocator allocator;
+  };
+
+  struct IndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+  };
+
+  static const unsigned int FORMAT_COUNT = 4;
+  static const unsigned int INDEX_TYPE_COUNT = 2;
+
+  bool active;
+  Pool vertexPools[FORMAT_COUNT];
+  Pool indexPools[INDEX_TYPE_COUNT];
+  GLuint vertexArrays[FORMAT_COUNT][INDEX_TYPE_COUNT];
+  // buffer each VAO reads draw data from
+  GLuint vertexArrayDrawData[FORMAT_COUNT][INDEX_TYPE_COUNT];
+  GLuint drawDataBuffer, indirectBuffer;
+  RingBuffer *ringBuffer;
+
+  std::vector<DrawData> drawData;
+  std::vector<IndirectCommand> commands[FORMAT_COUNT][INDEX_TYPE_COUNT];
+  std::vector<IndirectCommand> allCommands;
+
+  unsigned int multiDrawCalls, commandCount;
+  unsigned int lastMultiDrawCalls, lastCommands;
+
+  bool reserve(Pool &pool, GLuint count, GLuint &first);
+  void resetVertexArrays();
+  GLuint getVertexArray(unsigned int format, unsigned int indexType);
+  static unsigned int indexTypeSlot(GLenum indexType);
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// 64-bit FNV-1a; pass a previous result as seed to hash several buffers
+inline uint64_t hashBytes(const void *data, size_t size, uint64_t seed = 14695981039346656037ULL) {
+  const unsigned char *bytes = static_cast<const unsigned char*>(data);
+  uint64_t hash = seed;
+  for (size_t i = 0; i < size; i ++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
@@ -0,0 +1,155 @@
+#include "InstancedMesh.h"
+#include "GLState.h"
+#include "NormalMatrix.h"
+#include "Frustum.h"
+
+#include <stddef.h>
+#include <float.h>
+
+InstancedMesh::InstancedMesh() {
+  mesh = nullptr;
+  VAO = 0;
+  instanceBuffer = 0;
+  normalBuffer = 0;
+  instanceCount = 0;
+  instanceCapacity = 0;
+  boundsMin = glm::vec3(0.0f);
+  boundsMax = glm::vec3(0.0f);
+}
+
+void InstancedMesh::createInstancedMesh(Mesh *sharedMesh) {
+  clearInstancedMesh();
+  mesh = sharedMesh;
+  if (mesh->isInArena()) {
+    return;
+  }
+
+  VAO = mesh->createVertexArray();
+
+  glGenBuffers(1, &instanceBuffer);
+  GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  GLsizei stride = sizeof(InstanceData);
+  for (GLuint column = 0; column < 4; column ++) {
+    glVertexAttribPointer(6 + column, 4, GL_FLOAT, GL_FALSE, stride,
+			  (void*)(offsetof(InstanceData, model) + sizeof(glm::vec4) * column));
+    glVertexAttribDivisor(6 + column, 1);
+    glEnableVertexAttribArray(6 + column);
+  }
+  glVertexAttribIPointer(10, 1, GL_INT, stride, (void*)offsetof(InstanceData, materialIndex));
+  glVertexAttribDivisor(10, 1);
+  glEnableVertexAttribArray(10);
+
+  glGenBuffers(1, &normalBuffer);
+  GLState::bindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+  for (GLuint column = 0; column < 3; column ++) {
+    glVertexAttribPointer(12 + column, 3, GL_FLOAT, GL_FALSE, sizeof(glm::mat3),
+			  (void*)(sizeof(glm::vec3) * column));
+    glVertexAttribDivisor(12 + column, 1);
+    glEnableVertexAttribArray(12 + column);
+  }
+
+  GLState::bindVertexArray(0);
+}
+
+void InstancedMesh::setInstances(const InstanceData *instances, unsigned int count) {
+  instanceModels.resize(count);
+  instanceNormals.resize(count);
+  for (unsigned int i = 0; i < count; i ++) {
+    instanceModels[i] = instances[i].model;
+  }
+  if (count > 0) {
+    normalMatrices(&instanceModels[0], &instanceNormals[0], count);
+  }
+  updateBounds();
+
+  if (mesh && mesh->isInArena()) {
+    instanceList.assign(instances, instances + count);
+    instanceCount = count;
+    return;
+  }
+
+  GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+  if (count > instanceCapacity) {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * count, instances, GL_DYNAMIC_DRAW);
+  } else if (count > 0) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstanceData) * count, instances);
+  }
+  GLState::bindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+  if (count > instanceCapacity) {
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::mat3) * count, &instanceNormals[0], GL_DYNAMIC_DRAW);
+    instanceCapacity = count;
+  } else if (count > 0) {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::mat3) * count, &instanceNormals[0]);
+  }
+  instanceCount = count;
+}
+
+void InstancedMesh::updateBounds() {
+  boundsMin = glm::vec3(0.0f);
+  boundsMax = glm::vec3(0.0f);
+  if (!mesh || instanceModels.empty()) {
+    return;
+  }
+  boundsMin = glm::vec3(FLT_MAX);
+  boundsMax = glm::vec3(-FLT_MAX);
+  for (size_t i = 0; i < instanceModels.size(); i ++) {
+    glm::vec3 instanceCenter, instanceExtent;
+    transformBox(mesh->getBoundsMin(), mesh->getBoundsMax(), instanceModels[i], instanceCenter, instanceExtent);
+    boundsMin = glm::min(boundsMin, instanceCenter - instanceExtent);
+    boundsMax = glm::max(boundsMax, instanceCenter + instanceExtent);
+  }
+}
+
+void InstancedMesh::setInstances(const std::vector<InstanceData> &instances) {
+  setInstances(instances.empty() ? nullptr : &instances[0], instances.size());
+}
+
+void InstancedMesh::renderInstancedMesh(unsigned int lod) {
+  if (mesh && mesh->isInArena()) {
+    addToBatch(glm::mat4(1.0f), lod);
+    Mesh::getGeometryArena()->flush();
+  } else if (mesh) {
+    mesh->renderMeshInstanced(VAO, instanceCount, lod);
+  }
+}
+
+void InstancedMesh::addToBatch(const glm::mat4 &transform, unsigned int lod) {
+  // (AB)^-T = A^-T B^-T, so only the batch transform needs a new normal matrix
+  glm::mat3 normal = normalMatrix(transform);
+  drawData.resize(instanceList.size());
+  for (size_t i = 0; i < instanceList.size(); i ++) {
+    mesh->fillDrawData(drawData[i], transform * instanceList[i].model, normal * instanceNormals[i],
+		       instanceList[i].materialIndex);
+  }
+  if (!drawData.empty()) {
+    mesh->addToBatch(&drawData[0], drawData.size(), lod);
+  }
+}
+
+void InstancedMesh::clearInstancedMesh() {
+  if (instanceBuffer != 0) {
+    glDeleteBuffers(1, &instanceBuffer);
+    GLState::bufferDeleted(instanceBuffer);
+    instanceBuffer = 0;
+  }
+  if (normalBuffer != 0) {
+    glDeleteBuffers(1, &normalBuffer);
+    GLState::bufferDeleted(normalBuffer);
+    normalBuffer = 0;
+  }
+  if (VAO != 0) {
+    glDeleteVertexArrays(1, &VAO);
+    GLState::vertexArrayDeleted(VAO);
+    VAO = 0;
+  }
+  mesh = nullptr;
+  instanceList.clear();
+  instanceModels.clear();
+  instanceNormals.clear();
+  instanceCount = 0;
+  instanceCapacity = 0;
+}
+
+InstancedMesh::~InstancedMesh() {
+  clearInstancedMesh();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Mesh.h"
+
+// What the vertex shader reads per instance: the model matrix at
+// attributes 6-9 and an index into the shader's instance materials at 10.
+// The normal matrix at 12-14 is computed from model by setInstances().
+struct InstanceData {
+  glm::mat4 model;
+  GLint materialIndex;
+};
+
+// Draws one shared Mesh many times with glDrawElementsInstanced. The mesh
+// isn't owned and has to outlive this.
+class InstancedMesh {
+public:
+  InstancedMesh();
+
+  void createInstancedMesh(Mesh *sharedMesh);
+  void setInstances(const InstanceData *instances, unsigned int count);
+  void setInstances(const std::vector<InstanceData> &instances);
+  void renderInstancedMesh(unsigned int lod = 0);
+  // arena meshes only; instances are placed relative to transform
+  void addToBatch(const glm::mat4 &transform, unsigned int lod = 0);
+  void clearInstancedMesh();
+  unsigned int getInstanceCount() {return instanceCount;}
+  bool isInArena() {return mesh && mesh->isInArena();}
+  // box around every instance, relative to the transform it's drawn with
+  glm::vec3 getBoundsMin() {return boundsMin;}
+  glm::vec3 getBoundsMax() {return boundsMax;}
+
+  ~InstancedMesh();
+
+private:
+  Mesh *mesh;
+  GLuint VAO, instanceBuffer, normalBuffer;
+  unsigned int instanceCount;
+  unsigned int instanceCapacity;
+  glm::vec3 boundsMin, boundsMax;
+
+  // arena meshes rebuild their draw data from these each batch
+  std::vector<InstanceData> instanceList;
+  std::vector<glm::mat4> instanceModels;
+  std::vector<glm::mat3> instanceNormals;
+  std::vector<DrawData> drawData;
+
+  void updateBounds();
+};
@@ -1,13 +1,27 @@
 #include "Light.h"
 
 Light::Light() {
+  shadowMap = nullptr;
   color = glm::vec3(1.0f, 1.0f, 1.0f);
   ambientIntensity = 1.0f;
   diffuseIntensity = 0.0f;
 }
 
-Light::Light(GLfloat shadowWidth, GLfloat shadowHeight, GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity) {
-  shadowMap = new ShadowMap();
+Light::Light(GLfloat shadowWidth, GLfloat shadowHeight, GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity)
+  : Light(new ShadowMap(), shadowWidth, shadowHeight, red, green, blue, aIntensity, dIntensity) {
+  
+}
+
+Light::Light(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity) {
+  shadowMap = nullptr;
+  color = glm::vec3(red, green, blue);
+  ambientIntensity = aIntensity;
+  diffuseIntensity = dIntensity;
+}
+
+Light::Light(ShadowMap *map, GLfloat shadowWidth, GLfloat shadowHeight,
+	     GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity) {
+  shadowMap = map;
   shadowMap->init(shadowWidth, shadowHeight);
   
   color = glm::vec3(red, green, blue);
@@ -15,6 +29,12 @@ Light::Light(GLfloat shadowWidth, GLfloat shadowHeight, GLfloat red, GLfloat gre
   diffuseIntensity = dIntensity;
 }
 
+void Light::fillLightData(LightData &data) {
+  data.color = color;
+  data.ambientIntensity = ambientIntensity;
+  data.diffuseIntensity = diffuseIntensity;
+}
+
 Light::~Light() {
   
 }
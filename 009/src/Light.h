@@ -4,6 +4,7 @@
 #include <glm/glm.hpp>
 
 #include "ShadowMap.h"
+#include "LightData.h"
 
 class Light {
 public:
@@ -11,9 +12,19 @@ public:
   Light(GLfloat shadowWidth, GLfloat shadowHeight,
 	GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity);
   ShadowMap* getShadowMap() {return shadowMap;}
+  // the cached static casters have to be redrawn; changes to the light
+  // transform are picked up without this
+  void invalidateShadow() {if (shadowMap) shadowMap->invalidateStatic();}
+  void fillLightData(LightData &data);
   ~Light();
   
 protected:
+  // for lights whose shadows live elsewhere (the shadow atlas)
+  Light(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity);
+  // for lights that bring their own kind of shadow map
+  Light(ShadowMap *map, GLfloat shadowWidth, GLfloat shadowHeight,
+	GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity);
+
   glm::vec3 color;
   GLfloat ambientIntensity;
   GLfloat diffuseIntensity;
@@ -0,0 +1,78 @@
+#include "LightBuffer.h"
+#include "GLState.h"
+
+#include <string.h>
+
+LightBuffer::LightBuffer() {
+  buffer = 0;
+  uploaded = false;
+  uploads = 0;
+  directionalLight = nullptr;
+  pointLights = nullptr;
+  spotLights = nullptr;
+  pointLightCount = 0;
+  spotLightCount = 0;
+  // padding takes part in the comparison, so it has to start out zeroed
+  memset(static_cast<void*>(&data), 0, sizeof(data));
+  memset(static_cast<void*>(&lastData), 0, sizeof(lastData));
+}
+
+void LightBuffer::init() {
+  clear();
+  glGenBuffers(1, &buffer);
+  GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(LightBlockData), nullptr, GL_DYNAMIC_DRAW);
+  // also sets the generic binding, which GLState already has as buffer
+  glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, buffer);
+}
+
+void LightBuffer::setDirectionalLight(DirectionalLight *dLight) {
+  directionalLight = dLight;
+}
+
+void LightBuffer::setPointLights(PointLight *pLight, unsigned int lightCount) {
+  pointLights = pLight;
+  pointLightCount = lightCount < MAX_POINT_LIGHTS ? lightCount : MAX_POINT_LIGHTS;
+}
+
+void LightBuffer::setSpotLights(SpotLight *sLight, unsigned int lightCount) {
+  spotLights = sLight;
+  spotLightCount = lightCount < MAX_SPOT_LIGHTS ? lightCount : MAX_SPOT_LIGHTS;
+}
+
+void LightBuffer::update() {
+  if (directionalLight) {
+    directionalLight->fillLightData(data.directionalLight);
+  }
+  for (unsigned int i = 0; i < pointLightCount; i ++) {
+    pointLights[i].fillLightData(data.pointLights[i]);
+  }
+  for (unsigned int i = 0; i < spotLightCount; i ++) {
+    spotLights[i].fillLightData(data.spotLights[i]);
+  }
+  data.pointLightCount = pointLightCount;
+  data.spotLightCount = spotLightCount;
+
+  if (uploaded && memcmp(&data, &lastData, sizeof(data)) == 0) {
+    return;
+  }
+  GLState::bindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data), &data);
+  lastData = data;
+  uploaded = true;
+  uploads ++;
+}
+
+void LightBuffer::clear() {
+  if (buffer != 0) {
+    glDeleteBuffers(1, &buffer);
+    GLState::bufferDeleted(buffer);
+    buffer = 0;
+  }
+  uploaded = false;
+  uploads = 0;
+}
+
+LightBuffer::~LightBuffer() {
+  
+}
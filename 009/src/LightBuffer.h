@@ -0,0 +1,43 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include "LightData.h"
+#include "DirectionalLight.h"
+#include "PointLight.h"
+#include "SpotLight.h"
+
+// Every light in the scene in one uniform buffer bound at
+// LIGHT_BLOCK_BINDING, which all programs share. update() rebuilds the
+// CPU copy and uploads it only when something changed, so the uniform
+// traffic doesn't grow with light or shader count.
+class LightBuffer {
+public:
+  LightBuffer();
+
+  void init();
+
+  void setDirectionalLight(DirectionalLight *dLight);
+  void setPointLights(PointLight *pLight, unsigned int lightCount);
+  void setSpotLights(SpotLight *sLight, unsigned int lightCount);
+  // once per frame, after the lights have moved
+  void update();
+
+  unsigned int getUploads() {return uploads;}
+  void clear();
+
+  ~LightBuffer();
+
+private:
+  GLuint buffer;
+  bool uploaded;
+  unsigned int uploads;
+
+  DirectionalLight *directionalLight;
+  PointLight *pointLights;
+  SpotLight *spotLights;
+  unsigned int pointLightCount, spotLightCount;
+
+  LightBlockData data;
+  LightBlockData lastData;
+};
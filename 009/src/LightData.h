@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "constants.h"
+
+// CPU mirror of the std140 LightBlock in basics.fsh. Every struct there
+// is padded to a multiple of 16 bytes and a vec3 followed by a float
+// shares one 16 byte slot, hence the explicit padding.
+
+struct LightData {
+  glm::vec3 color;
+  GLfloat ambientIntensity;
+  GLfloat diffuseIntensity;
+  GLfloat padding[3];
+};
+
+struct DirectionalLightData {
+  LightData base;
+  glm::vec3 direction;
+  GLfloat padding;
+};
+
+struct PointLightData {
+  LightData base;
+  glm::vec3 position;
+  GLfloat constant;
+  GLfloat linear;
+  GLfloat exponent;
+  // first shadow atlas tile, -1 for none
+  GLint shadowTile;
+  GLfloat padding;
+};
+
+struct SpotLightData {
+  PointLightData base;
+  glm::vec3 direction;
+  GLfloat edge;
+};
+
+struct LightBlockData {
+  DirectionalLightData directionalLight;
+  PointLightData pointLights[MAX_POINT_LIGHTS];
+  SpotLightData spotLights[MAX_SPOT_LIGHTS];
+  GLint pointLightCount;
+  GLint spotLightCount;
+  GLint padding[2];
+};
+
+static_assert(sizeof(LightData) == 32, "LightData doesn't match std140");
+static_assert(sizeof(DirectionalLightData) == 48, "DirectionalLightData doesn't match std140");
+static_assert(sizeof(PointLightData) == 64, "PointLightData doesn't match std140");
+static_assert(sizeof(SpotLightData) == 80, "SpotLightData doesn't match std140");
+static_assert(offsetof(LightBlockData, pointLightCount) ==
+	      48 + 64 * MAX_POINT_LIGHTS + 80 * MAX_SPOT_LIGHTS, "LightBlockData doesn't match std140");
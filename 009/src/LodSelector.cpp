@@ -0,0 +1,29 @@
+#include "LodSelector.h"
+
+static const float LOD_HYSTERESIS = 0.15f;
+
+LodSelector::LodSelector() {
+  level = 0;
+}
+
+unsigned int LodSelector::select(float screenSize, unsigned int levelCount) {
+  unsigned int target = 0;
+  while (target < LOD_THRESHOLD_COUNT && screenSize < LOD_SCREEN_SIZES[target]) {
+    target ++;
+  }
+
+  // moving to a coarser level needs the size to drop well below the
+  // threshold, moving back needs it to rise well above
+  if (target > level && screenSize > LOD_SCREEN_SIZES[target - 1] * (1.0f - LOD_HYSTERESIS)) {
+    target --;
+  } else if (target < level && screenSize < LOD_SCREEN_SIZES[target] * (1.0f + LOD_HYSTERESIS)) {
+    target ++;
+  }
+  level = target;
+
+  return levelCount && level >= levelCount ? levelCount - 1 : level;
+}
+
+LodSelector::~LodSelector() {
+  
+}
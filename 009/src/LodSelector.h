@@ -0,0 +1,24 @@
+#pragma once
+
+// Smallest projected diameter in pixels each level is drawn at; below the
+// last entry the next level is used. Level n + 1 is simplified to about a
+// pixel of error at LOD_SCREEN_SIZES[n].
+const float LOD_SCREEN_SIZES[] = {400.0f, 150.0f, 60.0f};
+const unsigned int LOD_THRESHOLD_COUNT = sizeof(LOD_SCREEN_SIZES) / sizeof(LOD_SCREEN_SIZES[0]);
+
+// Per instance LOD state. Levels switch on the projected diameter of the
+// model's bounding sphere in pixels; a level is only left once the size
+// has moved past its threshold by the hysteresis margin, so an instance
+// sitting right on a threshold doesn't flicker between two levels.
+class LodSelector {
+public:
+  LodSelector();
+
+  unsigned int select(float screenSize, unsigned int levelCount);
+  unsigned int getLevel() {return level;}
+
+  ~LodSelector();
+
+private:
+  unsigned int level;
+};
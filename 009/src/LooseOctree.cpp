@@ -0,0 +1,305 @@
+#include "LooseOctree.h"
+
+LooseOctree::LooseOctree() {
+  maxDepth = 0;
+  objectCount = 0;
+  nodesVisited = 0;
+}
+
+void LooseOctree::init(const glm::vec3 &center, float halfSize, unsigned int depth) {
+  clear();
+  maxDepth = depth;
+  nodes.push_back(Node());
+  Node &root = nodes.back();
+  root.center = center;
+  root.halfSize = halfSize;
+  root.depth = 0;
+  root.parent = NO_NODE;
+  for (int i = 0; i < 8; i ++) {
+    root.children[i] = NO_NODE;
+  }
+  root.subtreeCount = 0;
+}
+
+uint32_t LooseOctree::child(uint32_t node, unsigned int octant) {
+  if (nodes[node].children[octant] != NO_NODE) {
+    return nodes[node].children[octant];
+  }
+  // push_back may move the parent, so everything goes through indices
+  Node newNode;
+  float half = nodes[node].halfSize * 0.5f;
+  newNode.center = nodes[node].center + glm::vec3(octant & 1 ? half : -half,
+						  octant & 2 ? half : -half,
+						  octant & 4 ? half : -half);
+  newNode.halfSize = half;
+  newNode.depth = nodes[node].depth + 1;
+  newNode.parent = node;
+  for (int i = 0; i < 8; i ++) {
+    newNode.children[i] = NO_NODE;
+  }
+  newNode.subtreeCount = 0;
+  uint32_t index = nodes.size();
+  nodes.push_back(newNode);
+  nodes[node].children[octant] = index;
+  return index;
+}
+
+// centre inside the cell and the box inside the loose bounds
+bool LooseOctree::fits(const Node &node, const glm::vec3 &center, float extent) {
+  glm::vec3 offset = glm::abs(center - node.center);
+  return extent <= node.halfSize &&
+    offset.x <= node.halfSize && offset.y <= node.halfSize && offset.z <= node.halfSize;
+}
+
+uint32_t LooseOctree::findNode(const glm::vec3 &center, const glm::vec3 &extent) {
+  float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+  uint32_t node = 0;
+  if (!fits(nodes[0], center, largest)) {
+    return node;
+  }
+  while (nodes[node].depth < maxDepth && largest <= nodes[node].halfSize * 0.5f) {
+    const glm::vec3 &nodeCenter = nodes[node].center;
+    unsigned int octant = (center.x >= nodeCenter.x ? 1 : 0) |
+      (center.y >= nodeCenter.y ? 2 : 0) | (center.z >= nodeCenter.z ? 4 : 0);
+    node = child(node, octant);
+  }
+  return node;
+}
+
+void LooseOctree::link(uint32_t handle, uint32_t node, const glm::vec3 &center, const glm::vec3 &extent) {
+  Node &target = nodes[node];
+  objects[handle].node = node;
+  objects[handle].slot = target.handles.size();
+  target.centerX.push_back(center.x);
+  target.centerY.push_back(center.y);
+  target.centerZ.push_back(center.z);
+  target.extentX.push_back(extent.x);
+  target.extentY.push_back(extent.y);
+  target.extentZ.push_back(extent.z);
+  target.handles.push_back(handle);
+  for (uint32_t n = node; n != NO_NODE; n = nodes[n].parent) {
+    nodes[n].subtreeCount ++;
+  }
+}
+
+// the node's last object takes the freed slot
+void LooseOctree::unlink(uint32_t handle) {
+  uint32_t node = objects[handle].node;
+  uint32_t slot = objects[handle].slot;
+  Node &target = nodes[node];
+  uint32_t last = target.handles.size() - 1;
+  target.centerX[slot] = target.centerX[last];
+  target.centerY[slot] = target.centerY[last];
+  target.centerZ[slot] = target.centerZ[last];
+  target.extentX[slot] = target.extentX[last];
+  target.extentY[slot] = target.extentY[last];
+  target.extentZ[slot] = target.extentZ[last];
+  target.handles[slot] = target.handles[last];
+  objects[target.handles[slot]].slot = slot;
+  target.centerX.pop_back();
+  target.centerY.pop_back();
+  target.centerZ.pop_back();
+  target.extentX.pop_back();
+  target.extentY.pop_back();
+  target.extentZ.pop_back();
+  target.handles.pop_back();
+  for (uint32_t n = node; n != NO_NODE; n = nodes[n].parent) {
+    nodes[n].subtreeCount --;
+  }
+  objects[handle].node = NO_NODE;
+}
+
+unsigned int LooseOctree::insert(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, unsigned int userData) {
+  uint32_t handle;
+  if (!freeHandles.empty()) {
+    handle = freeHandles.back();
+    freeHandles.pop_back();
+  } else {
+    handle = objects.size();
+    objects.push_back(Object());
+  }
+  objects[handle].userData = userData;
+
+  glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+  glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+  link(handle, findNode(center, extent), center, extent);
+  objectCount ++;
+  return handle;
+}
+
+void LooseOctree::update(unsigned int handle, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+  glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+  glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+  float largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+
+  // small moves stay in the node, which is the common case; an object
+  // that shrank enough to go deeper is relinked too
+  uint32_t node = objects[handle].node;
+  const Node &current = nodes[node];
+  bool stays = fits(current, center, largest) &&
+    (current.depth == maxDepth || largest > current.halfSize * 0.5f);
+  if (!stays) {
+    unlink(handle);
+    link(handle, findNode(center, extent), center, extent);
+    return;
+  }
+  uint32_t slot = objects[handle].slot;
+  Node &target = nodes[node];
+  target.centerX[slot] = center.x;
+  target.centerY[slot] = center.y;
+  target.centerZ[slot] = center.z;
+  target.extentX[slot] = extent.x;
+  target.extentY[slot] = extent.y;
+  target.extentZ[slot] = extent.z;
+}
+
+void LooseOctree::remove(unsigned int handle) {
+  if (handle >= objects.size() || objects[handle].node == NO_NODE) {
+    return;
+  }
+  unlink(handle);
+  freeHandles.push_back(handle);
+  objectCount --;
+}
+
+void LooseOctree::addSubtree(uint32_t node, std::vector<unsigned int> &result) {
+  const Node &current = nodes[node];
+  nodesVisited ++;
+  for (size_t i = 0; i < current.handles.size(); i ++) {
+    result.push_back(objects[current.handles[i]].userData);
+  }
+  for (int i = 0; i < 8; i ++) {
+    if (current.children[i] != NO_NODE && nodes[current.children[i]].subtreeCount > 0) {
+      addSubtree(current.children[i], result);
+    }
+  }
+}
+
+void LooseOctree::queryFrustum(const Frustum &frustum, std::vector<unsigned int> &result) {
+  nodesVisited = 0;
+  if (!nodes.empty() && nodes[0].subtreeCount > 0) {
+    queryFrustum(0, frustum, false, result);
+  }
+}
+
+// inside means the node's loose bounds are already known to be inside, so
+// everything below is visible without further tests
+void LooseOctree::queryFrustum(uint32_t node, const Frustum &frustum, bool inside, std::vector<unsigned int> &result) {
+  if (inside) {
+    addSubtree(node, result);
+    return;
+  }
+  nodesVisited ++;
+  const Node &current = nodes[node];
+  // the root's objects may stick out of its loose bounds
+  if (node != 0) {
+    FrustumTest test = frustum.testBox(current.center, glm::vec3(current.halfSize * 2.0f));
+    if (test == FRUSTUM_OUTSIDE) {
+      return;
+    }
+    if (test == FRUSTUM_INSIDE) {
+      nodesVisited --;
+      addSubtree(node, result);
+      return;
+    }
+  }
+
+  size_t count = current.handles.size();
+  if (count > 0) {
+    visible.resize(count);
+    frustum.cullBoxes(&current.centerX[0], &current.centerY[0], &current.centerZ[0],
+		      &current.extentX[0], &current.extentY[0], &current.extentZ[0], count, &visible[0]);
+    for (size_t i = 0; i < count; i ++) {
+      if (visible[i]) {
+	result.push_back(objects[current.handles[i]].userData);
+      }
+    }
+  }
+  for (int i = 0; i < 8; i ++) {
+    uint32_t next = nodes[node].children[i];
+    if (next != NO_NODE && nodes[next].subtreeCount > 0) {
+      queryFrustum(next, frustum, false, result);
+    }
+  }
+}
+
+void LooseOctree::querySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &result) {
+  nodesVisited = 0;
+  if (!nodes.empty() && nodes[0].subtreeCount > 0) {
+    querySphere(0, center, radius, result);
+  }
+}
+
+// box to sphere by the distance from the centre to the nearest point
+static inline bool sphereOverlapsBox(const glm::vec3 &center, float radius2,
+				     const glm::vec3 &boxCenter, const glm::vec3 &boxExtent) {
+  glm::vec3 outside = glm::max(glm::abs(center - boxCenter) - boxExtent, glm::vec3(0.0f));
+  return glm::dot(outside, outside) <= radius2;
+}
+
+void LooseOctree::querySphere(uint32_t node, const glm::vec3 &center, float radius, std::vector<unsigned int> &result) {
+  nodesVisited ++;
+  const Node &current = nodes[node];
+  float radius2 = radius * radius;
+  if (node != 0 && !sphereOverlapsBox(center, radius2, current.center, glm::vec3(current.halfSize * 2.0f))) {
+    return;
+  }
+  for (size_t i = 0; i < current.handles.size(); i ++) {
+    glm::vec3 boxCenter(current.centerX[i], current.centerY[i], current.centerZ[i]);
+    glm::vec3 boxExtent(current.extentX[i], current.extentY[i], current.extentZ[i]);
+    if (sphereOverlapsBox(center, radius2, boxCenter, boxExtent)) {
+      result.push_back(objects[current.handles[i]].userData);
+    }
+  }
+  for (int i = 0; i < 8; i ++) {
+    uint32_t next = current.children[i];
+    if (next != NO_NODE && nodes[next].subtreeCount > 0) {
+      querySphere(next, center, radius, result);
+    }
+  }
+}
+
+void LooseOctree::queryBox(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<unsigned int> &result) {
+  nodesVisited = 0;
+  if (!nodes.empty() && nodes[0].subtreeCount > 0) {
+    queryBox(0, boundsMin, boundsMax, result);
+  }
+}
+
+void LooseOctree::queryBox(uint32_t node, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<unsigned int> &result) {
+  nodesVisited ++;
+  const Node &current = nodes[node];
+  glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+  glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+  if (node != 0) {
+    glm::vec3 gap = glm::abs(center - current.center) - extent - glm::vec3(current.halfSize * 2.0f);
+    if (gap.x > 0.0f || gap.y > 0.0f || gap.z > 0.0f) {
+      return;
+    }
+  }
+  for (size_t i = 0; i < current.handles.size(); i ++) {
+    glm::vec3 gap = glm::abs(center - glm::vec3(current.centerX[i], current.centerY[i], current.centerZ[i])) -
+      extent - glm::vec3(current.extentX[i], current.extentY[i], current.extentZ[i]);
+    if (gap.x <= 0.0f && gap.y <= 0.0f && gap.z <= 0.0f) {
+      result.push_back(objects[current.handles[i]].userData);
+    }
+  }
+  for (int i = 0; i < 8; i ++) {
+    uint32_t next = current.children[i];
+    if (next != NO_NODE && nodes[next].subtreeCount > 0) {
+      queryBox(next, boundsMin, boundsMax, result);
+    }
+  }
+}
+
+void LooseOctree::clear() {
+  nodes.clear();
+  objects.clear();
+  freeHandles.clear();
+  objectCount = 0;
+  nodesVisited = 0;
+}
+
+LooseOctree::~LooseOctree() {
+  
+}
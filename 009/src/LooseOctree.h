@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.h"
+
+// Loose octree over world space boxes. Every node's bounds are twice its
+// cell, so an object goes straight to the deepest node whose cell holds
+// its centre and whose cell half size is at least its largest half
+// extent, without looking at any other object. Objects are kept per node
+// as structure of arrays so the frustum query tests a partially visible
+// node's objects four at a time.
+//
+// insert() hands out a handle; update() moves the object in place while
+// it still belongs to the same node and relinks it otherwise. Queries
+// return the userData given at insert().
+class LooseOctree {
+public:
+  LooseOctree();
+
+  // objects outside the root's cell live in the root
+  void init(const glm::vec3 &center, float halfSize, unsigned int maxDepth);
+
+  unsigned int insert(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, unsigned int userData);
+  void update(unsigned int handle, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+  void remove(unsigned int handle);
+
+  // results are appended
+  void queryFrustum(const Frustum &frustum, std::vector<unsigned int> &result);
+  void querySphere(const glm::vec3 &center, float radius, std::vector<unsigned int> &result);
+  void queryBox(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<unsigned int> &result);
+
+  unsigned int getObjectCount() {return objectCount;}
+  unsigned int getNodeCount() {return nodes.size();}
+  // nodes the last query looked at
+  unsigned int getNodesVisited() {return nodesVisited;}
+
+  void clear();
+
+  ~LooseOctree();
+
+private:
+  static const uint32_t NO_NODE = 0xffffffff;
+
+  struct Node {
+    glm::vec3 center;
+    float halfSize;         // of the cell; the loose bounds are twice that
+    unsigned int depth;
+    uint32_t parent;
+    uint32_t children[8];
+    unsigned int subtreeCount;
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> extentX, extentY, extentZ;
+    std::vector<uint32_t> handles;
+  };
+
+  struct Object {
+    uint32_t node;          // NO_NODE once removed
+    uint32_t slot;
+    unsigned int userData;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<Object> objects;
+  std::vector<uint32_t> freeHandles;
+  std::vector<uint8_t> visible;
+  unsigned int maxDepth;
+  unsigned int objectCount;
+  unsigned int nodesVisited;
+
+  uint32_t findNode(const glm::vec3 &center, const glm::vec3 &extent);
+  uint32_t child(uint32_t node, unsigned int octant);
+  bool fits(const Node &node, const glm::vec3 &center, float extent);
+  void link(uint32_t handle, uint32_t node, const glm::vec3 &center, const glm::vec3 &extent);
+  void unlink(uint32_t handle);
+  void addSubtree(uint32_t node, std::vector<unsigned int> &result);
+  void queryFrustum(uint32_t node, const Frustum &frustum, bool inside, std::vector<unsigned int> &result);
+  void querySphere(uint32_t node, const glm::vec3 &center, float radius, std::vector<unsigned int> &result);
+  void queryBox(uint32_t node, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::vector<unsigned int> &result);
+};
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <float.h>
 #include <cmath>
 #include <vector>
 
@@ -14,51 +15,128 @@
 #include "constants.h"
 #include "Window.h"
 #include "Mesh.h"
+#include "InstancedMesh.h"
 #include "Shader.h"
 #include "Camera.h"
 #include "Texture.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
 #include "DirectionalLight.h"
 #include "PointLight.h"
 #include "SpotLight.h"
+#include "LightBuffer.h"
 #include "Material.h"
 #include "Model.h"
+#include "RenderQueue.h"
+#include "GLState.h"
+#include "GeometryArena.h"
+#include "RingBuffer.h"
+#include "LooseOctree.h"
+#include "OcclusionCuller.h"
+#include "ShadowAtlas.h"
 #include "Timer.h"
 
 // Window dimensions
 const float toRadians = 3.1415926f / 180.0f;
+const float nearPlane = 0.1f;
+const float farPlane = 100.0f;
+// receivers further from the camera than this go unshadowed
+const float shadowDistance = 60.0f;
 
 GLuint uniformProjection = 0;
-GLuint uniformModel = 0;
 GLuint uniformView = 0;
 GLuint uniformEyePosition = 0;
-GLuint uniformSpecularIntensity = 0;
-GLuint uniformShininess = 0;
 
 Window mainWindow;
 Timer *timer;
 std::vector<Mesh*> meshList;
+GeometryArena geometryArena;
+RingBuffer frameRing;
+// per-frame draw data and indirect commands
+const GLsizeiptr FRAME_RING_SIZE = 1 << 20;
+InstancedMesh brickCubes;
+InstancedMesh steelCubes;
+RenderQueue renderQueue;
+// what renderScene() draws, stored in the octree by world bounds
+enum SceneObject {
+  SCENE_FLOOR,
+  SCENE_BRICK_CUBES,
+  SCENE_STEEL_CUBES,
+  SCENE_X_WING,
+  SCENE_OBJECT_COUNT
+};
+// which objects a renderScene call draws, by whether they move
+enum SceneSubset {
+  SCENE_ALL,
+  SCENE_STATIC,
+  SCENE_DYNAMIC
+};
+LooseOctree sceneTree;
+unsigned int sceneHandles[SCENE_OBJECT_COUNT];
+glm::vec3 sceneBoundsMin[SCENE_OBJECT_COUNT], sceneBoundsMax[SCENE_OBJECT_COUNT];
+// dynamic objects are redrawn into the shadow map every frame; static
+// ones come from its cached layer
+bool sceneDynamic[SCENE_OBJECT_COUNT];
+unsigned int dynamicObjectCount = 0;
+// around every placed object, for fitting the shadow projection
+glm::vec3 worldBoundsMin(FLT_MAX), worldBoundsMax(-FLT_MAX);
+bool sceneVisible[SCENE_OBJECT_COUNT];
+std::vector<unsigned int> visibleObjects;
+glm::mat4 floorTransform, xWingTransform;
+// objects culled in each RenderPass last frame, summed over every view
+// the pass drew
+unsigned int culledObjects[2] = {0, 0};
+// the floor and cubes, rasterized on the CPU from each pass's view to
+// hide what is behind them
+OcclusionCuller occlusionCuller;
+const unsigned int OCCLUSION_WIDTH = SCREEN_WIDTH / 4;
+const unsigned int OCCLUSION_HEIGHT = SCREEN_HEIGHT / 4;
+std::vector<unsigned int> occluderMeshes;
+std::vector<glm::mat4> occluderTransforms;
+// of those left after frustum culling, summed the same way
+unsigned int occludedObjects[2] = {0, 0};
 std::vector<Shader> shaderList;
 Shader directionalShadowShader;
+Shader atlasShadowShader;
+// kernel shaderList[0] filters the directional shadow map with; Gather
+// falls back to 5x5 PCF where the driver can't gather with a reference
+ShadowFilter shadowFilter = SHADOW_FILTER_GATHER;
+const char *shadowFilterNames[SHADOW_FILTER_COUNT] = {"1-tap", "Gather", "Poisson", "5x5 PCF"};
 
 Camera camera;
 
-Texture brickTexture;
-Texture steelTexture;
-Texture concreteTexture;
-Texture floorTexture;
+TextureLoader textureLoader;
+TextureCache textureCache;
+Texture *brickTexture;
+Texture *steelTexture;
+Texture *concreteTexture;
+Texture *floorTexture;
 
 Material shinyMaterial;
 Material dullMaterial;
+// indexed by InstanceData::materialIndex
+Material instanceMaterials[2];
 
-Model tie_fighter;
 Model x_wing;
+LodSelector xWingLod;
+// SCREEN_HEIGHT / (2 * tan(fovy / 2)) for the 45 degree projection below
+const float lodProjectionScale = SCREEN_HEIGHT / (2.0f * tanf(22.5f * toRadians));
 
 DirectionalLight mainLight;
 PointLight pointLights[MAX_POINT_LIGHTS];
 SpotLight spotLights[MAX_SPOT_LIGHTS];
+// spot and point light shadows, handed out as tiles every frame
+ShadowAtlas shadowAtlas;
+const GLuint SHADOW_ATLAS_SIZE = 2048;
+const GLuint SHADOW_TILE_MIN = 64;
+const GLuint SHADOW_TILE_MAX = 512;
+// enough for the two point lights and the spot light; a third point
+// light would go without when it matters least
+const unsigned int SHADOW_TILE_BUDGET = 16;
 
 unsigned int pointLightCount = 0;
 unsigned int spotLightCount = 0;
+LightBuffer lightBuffer;
 
 GLfloat deltaTime = 0.0f;
 GLfloat lastTime = 0.0f;
@@ -102,6 +180,37 @@ void calcAverageNormals(unsigned int *indices, unsigned int indiceCount, GLfloat
   }
 }
 
+void placeObject(SceneObject object, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+		 const glm::mat4 &transform, bool dynamic = false) {
+  glm::vec3 center, extent;
+  transformBox(boundsMin, boundsMax, transform, center, extent);
+  sceneBoundsMin[object] = center - extent;
+  sceneBoundsMax[object] = center + extent;
+  worldBoundsMin = glm::min(worldBoundsMin, center - extent);
+  worldBoundsMax = glm::max(worldBoundsMax, center + extent);
+  sceneHandles[object] = sceneTree.insert(center - extent, center + extent, object);
+  sceneDynamic[object] = dynamic;
+  dynamicObjectCount += dynamic ? 1 : 0;
+  if (!dynamic) {
+    mainLight.invalidateShadow();
+  }
+}
+
+// for objects that have already been placed and whose transform changed
+void moveObject(SceneObject object, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax,
+		const glm::mat4 &transform) {
+  glm::vec3 center, extent;
+  transformBox(boundsMin, boundsMax, transform, center, extent);
+  sceneBoundsMin[object] = center - extent;
+  sceneBoundsMax[object] = center + extent;
+  worldBoundsMin = glm::min(worldBoundsMin, center - extent);
+  worldBoundsMax = glm::max(worldBoundsMax, center + extent);
+  sceneTree.update(sceneHandles[object], center - extent, center + extent);
+  if (!sceneDynamic[object]) {
+    mainLight.invalidateShadow();
+  }
+}
+
 void createObjects() {
   unsigned int floorIndices[] = {
 				 0, 2, 1,
@@ -179,155 +288,290 @@ void createObjects() {
   obj0->createMesh(floorVertices, floorIndices, 32, 6);
   meshList.push_back(obj0);
   
-  Mesh *obj1 = new Mesh();
-  obj1->createMesh(vertices, indices, 32, 12);
-  meshList.push_back(obj1);
-
-  Mesh *obj2 = new Mesh();
-  obj2->createMesh(vertices, indices, 32, 12);
-  meshList.push_back(obj2);
+  Mesh *pyramid = new Mesh();
+  pyramid->createMesh(vertices, indices, 32, 12);
+  meshList.push_back(pyramid);
   
-  Mesh *cube1 = new Mesh();
-  cube1->createMesh(cubeVertices, cubeIndices, 192, 36);
-  meshList.push_back(cube1);
+  Mesh *cube = new Mesh();
+  cube->createMesh(cubeVertices, cubeIndices, 192, 36);
+  meshList.push_back(cube);
+
+  std::vector<InstanceData> instances;
+  const glm::vec3 brickPositions[] = {
+				      glm::vec3(0.0f, 4.0f, -10.0f),
+				      glm::vec3(2.0f, 4.0f, -10.0f),
+				      glm::vec3(4.0f, 4.0f, -8.0f),
+				      glm::vec3(4.0f, 4.0f, -6.0f),
+				      glm::vec3(4.0f, 4.0f, -4.0f)
+  };
+  for (size_t i = 0; i < 5; i ++) {
+    InstanceData instance;
+    instance.model = glm::translate(glm::mat4(1.0), brickPositions[i]);
+    instance.materialIndex = 0;
+    instances.push_back(instance);
+  }
+  brickCubes.createInstancedMesh(cube);
+  brickCubes.setInstances(instances);
+
+  instances.clear();
+  InstanceData steel;
+  steel.model = glm::translate(glm::mat4(1.0), glm::vec3(0.0f, 4.0f, -2.0f));
+  steel.materialIndex = 1;
+  instances.push_back(steel);
+  steelCubes.createInstancedMesh(cube);
+  steelCubes.setInstances(instances);
+
+  // nothing moves yet, so objects are placed once
+  sceneTree.init(glm::vec3(0.0f), 64.0f, 6);
+  floorTransform = glm::translate(glm::mat4(1.0), glm::vec3(0.0f, -1.0f, 0.0f));
+  placeObject(SCENE_FLOOR, obj0->getBoundsMin(), obj0->getBoundsMax(), floorTransform);
+  placeObject(SCENE_BRICK_CUBES, brickCubes.getBoundsMin(), brickCubes.getBoundsMax(), glm::mat4(1.0));
+  placeObject(SCENE_STEEL_CUBES, steelCubes.getBoundsMin(), steelCubes.getBoundsMax(), glm::mat4(1.0));
+
+  occlusionCuller.init(OCCLUSION_WIDTH, OCCLUSION_HEIGHT);
+  unsigned int floorOccluder = occlusionCuller.addOccluderMesh(floorVertices, 8, 4, floorIndices, 6);
+  unsigned int cubeOccluder = occlusionCuller.addOccluderMesh(cubeVertices, 8, 24, cubeIndices, 36);
+  occluderMeshes.push_back(floorOccluder);
+  occluderTransforms.push_back(floorTransform);
+  for (size_t i = 0; i < 5; i ++) {
+    occluderMeshes.push_back(cubeOccluder);
+    occluderTransforms.push_back(glm::translate(glm::mat4(1.0), brickPositions[i]));
+  }
+  occluderMeshes.push_back(cubeOccluder);
+  occluderTransforms.push_back(steel.model);
+}
 
-  Mesh *cube2 = new Mesh();
-  cube2->createMesh(cubeVertices, cubeIndices, 192, 36);
-  meshList.push_back(cube2);
+bool shadowFilterSupported(ShadowFilter filter) {
+  return filter != SHADOW_FILTER_GATHER || GLEW_VERSION_4_0 || GLEW_ARB_gpu_shader5;
+}
 
-  Mesh *cube3 = new Mesh();
-  cube3->createMesh(cubeVertices, cubeIndices, 192, 36);
-  meshList.push_back(cube3);
-  
-  Mesh *cube4 = new Mesh();
-  cube4->createMesh(cubeVertices, cubeIndices, 192, 36);
-  meshList.push_back(cube4);
-  
-  Mesh *cube5 = new Mesh();
-  cube5->createMesh(cubeVertices, cubeIndices, 192, 36);
-  meshList.push_back(cube5);
-  
-  Mesh *cube6 = new Mesh();
-  cube6->createMesh(cubeVertices, cubeIndices, 192, 36);
-  meshList.push_back(cube6);
+// (re)builds shaderList[0] around a shadow filter kernel
+void buildMainShader(ShadowFilter filter) {
+  char defines[64];
+  snprintf(defines, sizeof(defines), "#define SHADOW_FILTER %d\n", (int)filter);
+  shaderList[0].clearShader();
+  shaderList[0].setDefines(defines);
+  shaderList[0].createFromFiles(vShader, fShader);
+  // locations are fixed once the program is linked
+  uniformProjection = shaderList[0].getProjectionLocation();
+  uniformView = shaderList[0].getViewLocation();
+  uniformEyePosition = shaderList[0].getEyePositionLocation();
 }
 
 void createShaders() {
   Shader *shader1 = new Shader();
-  shader1->createFromFiles(vShader, fShader);
   shaderList.push_back(*shader1);
+  if (!shadowFilterSupported(shadowFilter)) {
+    shadowFilter = SHADOW_FILTER_PCF5X5;
+  }
+  buildMainShader(shadowFilter);
+
+  atlasShadowShader.createFromFiles("shaders/shadow_atlas.vsh", "shaders/shadow_atlas.fsh");
 
   directionalShadowShader = Shader();
-  directionalShadowShader.createFromFiles("shaders/directional_shadow_map.vsh", "shaders/directional_shadow_map.fsh");
+  directionalShadowShader.createFromFiles("shaders/directional_shadow_map.vsh", "shaders/directional_shadow_map.gsh",
+					  "shaders/directional_shadow_map.fsh");
 }
 
-void renderScene() {
+// normalized distance from the camera, for the queue's front-to-back order
+float viewDepth(const glm::vec3 &position) {
+  return glm::length(position - camera.getCameraPosition()) / farPlane;
+}
+
+float viewDepth(const glm::mat4 &model) {
+  return viewDepth(glm::vec3(model[3]));
+}
+
+// from the middle of a placed object's world bounds
+float viewDepth(SceneObject object) {
+  return viewDepth((sceneBoundsMin[object] + sceneBoundsMax[object]) * 0.5f);
+}
+
+void resetCullingStats() {
+  for (int pass = RENDER_PASS_SHADOW; pass <= RENDER_PASS_OPAQUE; pass ++) {
+    culledObjects[pass] = 0;
+    occludedObjects[pass] = 0;
+  }
+}
+
+// occlusion false skips the CPU occlusion test, for views drawn too
+// often per frame to be worth rasterizing the occluders for
+void renderScene(RenderPass pass, Shader *shader, const glm::mat4 &viewProjection,
+		 SceneSubset subset = SCENE_ALL, bool occlusion = true) {
+  // the shadow pass only needs depth
+  bool shading = pass != RENDER_PASS_SHADOW;
   glm::mat4 model(1.0);
-    
-    model = glm::translate(model, glm::vec3(0.0f, -1.0f, 0.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    floorTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);
-    meshList[0]->renderMesh();
-    
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(0.0f, 0.0f, -2.5f));
-    // model = glm::rotate(model, curAngle * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
-    // model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);
-    // meshList[1]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(0.0f, 4.0f, -2.5f));
-    // model = glm::rotate(model, curAngle * toRadians, glm::vec3(0.0f, 1.0f, 0.0f));
-    // model = glm::scale(model, glm::vec3(0.4f, 0.4f, 1.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));    
-    concreteTexture.useTexture();
-    shinyMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);
-    // meshList[2]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(0.0f, 4.0f, -10.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);
-    meshList[3]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(2.0f, 4.0f, -10.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);    
-    meshList[4]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(0.0f, 4.0f, -2.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    steelTexture.useTexture();
-    shinyMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);    
-    meshList[5]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(4.0f, 4.0f, -8.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);    
-    meshList[6]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(4.0f, 4.0f, -6.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);    
-    meshList[7]->renderMesh();
-
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(4.0f, 4.0f, -4.0f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    brickTexture.useTexture();
-    dullMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);    
-    meshList[8]->renderMesh();
-    /*
-    model = glm::mat4(1.0);
-    model = glm::translate(model, glm::vec3(-7.0f, 0.0f, 10.0f));
-    model = glm::scale(model, glm::vec3(0.06f, 0.06f, 0.06f));
-    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(model));
-    shinyMaterial.useMaterial(uniformSpecularIntensity, uniformShininess);
-    x_wing.renderModel();
-    */
+
+  visibleObjects.clear();
+  sceneTree.queryFrustum(Frustum(viewProjection), visibleObjects);
+  for (int i = 0; i < SCENE_OBJECT_COUNT; i ++) {
+    sceneVisible[i] = false;
+  }
+  for (size_t i = 0; i < visibleObjects.size(); i ++) {
+    unsigned int object = visibleObjects[i];
+    sceneVisible[object] = subset == SCENE_ALL || sceneDynamic[object] == (subset == SCENE_DYNAMIC);
+  }
+  culledObjects[pass] += sceneTree.getObjectCount() - visibleObjects.size();
+
+  // from the light's view too: a caster hidden behind other casters
+  // adds nothing to the shadow map
+  if (occlusion) {
+    occlusionCuller.beginFrame(viewProjection);
+    for (size_t i = 0; i < occluderMeshes.size(); i ++) {
+      occlusionCuller.addOccluder(occluderMeshes[i], occluderTransforms[i]);
+    }
+    occlusionCuller.finish();
+    for (size_t i = 0; i < visibleObjects.size(); i ++) {
+      unsigned int object = visibleObjects[i];
+      if (!occlusionCuller.isVisible(sceneBoundsMin[object], sceneBoundsMax[object])) {
+	sceneVisible[object] = false;
+      }
+    }
+    occludedObjects[pass] += occlusionCuller.getOccludedCount();
+  }
+
+  if (sceneVisible[SCENE_FLOOR]) {
+    DrawItem &floor = renderQueue.submit(pass, shader, floorTransform, viewDepth(floorTransform));
+    floor.texture = shading ? floorTexture : nullptr;
+    floor.material = shading ? &dullMaterial : nullptr;
+    floor.mesh = meshList[0];
+  }
+
+  // model = glm::translate(glm::mat4(1.0), glm::vec3(0.0f, 0.0f, -2.5f));
+  // DrawItem &pyramid = renderQueue.submit(pass, shader, model, viewDepth(model));
+  // pyramid.texture = shading ? brickTexture : nullptr;
+  // pyramid.material = shading ? &dullMaterial : nullptr;
+  // pyramid.mesh = meshList[1];
+
+  // cubes carry their transforms and materials per instance, and are
+  // culled as a group
+  if (sceneVisible[SCENE_BRICK_CUBES]) {
+    DrawItem &bricks = renderQueue.submit(pass, shader, model, viewDepth(SCENE_BRICK_CUBES));
+    bricks.texture = shading ? brickTexture : nullptr;
+    bricks.instancedMesh = &brickCubes;
+  }
+
+  if (sceneVisible[SCENE_STEEL_CUBES]) {
+    DrawItem &steel = renderQueue.submit(pass, shader, model, viewDepth(SCENE_STEEL_CUBES));
+    steel.texture = shading ? steelTexture : nullptr;
+    steel.instancedMesh = &steelCubes;
+  }
+
+  if (sceneVisible[SCENE_X_WING]) {
+    x_wing.submit(renderQueue, pass, shader, &shinyMaterial, xWingTransform, viewDepth(xWingTransform),
+		  x_wing.selectLod(xWingLod, xWingTransform, camera.getCameraPosition(), lodProjectionScale));
+  }
+
+  renderQueue.sort();
+  renderQueue.execute();
+  renderQueue.clear();
 }
 
 void directionalShaderMapPass(DirectionalLight* light) {
   directionalShadowShader.useShader();
   
-  glViewport(0, 0, light->getShadowMap()->getShadowWidth(),
-	     light->getShadowMap()->getShadowHeight());
+  GLState::viewport(0, 0, light->getShadowMap()->getShadowWidth(),
+		    light->getShadowMap()->getShadowHeight());
   
-  light->getShadowMap()->write();
-  glClear(GL_DEPTH_BUFFER_BIT);
-  
-  uniformModel = directionalShadowShader.getModelLocation();
-  glm::mat4 temp = light->calculateLightTransform();
-  directionalShadowShader.setDirectionalLightTransform(&temp);
+  // every cascade is drawn in one pass; casters are culled against the
+  // box around the cascades being drawn
+  directionalShadowShader.setCascadeTransforms(light->getCascadeTransforms(), light->getCascadeCount());
+  unsigned int updateMask = light->getCascadeUpdateMask();
+
+  CascadedShadowMap *shadowMap = light->getCascadedShadowMap();
+  if (!shadowMap->hasStaticCache()) {
+    if (updateMask) {
+      shadowMap->writeLayers(updateMask);
+      directionalShadowShader.setCascadeMask(updateMask);
+      renderScene(RENDER_PASS_SHADOW, &directionalShadowShader, light->calculateLightTransform(updateMask));
+    }
+    GLState::bindFramebuffer(0);
+    return;
+  }
 
-  renderScene();
+  unsigned int staticMask = shadowMap->writeStaticLayers(light->getCascadeTransforms(), updateMask);
+  if (staticMask) {
+    directionalShadowShader.setCascadeMask(staticMask);
+    renderScene(RENDER_PASS_SHADOW, &directionalShadowShader, light->calculateLightTransform(staticMask),
+		SCENE_STATIC);
+  }
+  // with nothing moving the static layers are sampled as they are
+  if ((updateMask | staticMask) && (dynamicObjectCount > 0 || shadowMap->hasDynamicLayers())) {
+    unsigned int dynamicMask = shadowMap->writeDynamicLayers(updateMask | staticMask);
+    directionalShadowShader.setCascadeMask(dynamicMask);
+    renderScene(RENDER_PASS_SHADOW, &directionalShadowShader, light->calculateLightTransform(dynamicMask),
+		SCENE_DYNAMIC);
+  }
+
+  GLState::bindFramebuffer(0);
+}
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Asks the atlas for tiles for every light whose range reaches into the
+// view, then gives the granted tiles their light transforms
+void updateShadowAtlas(const glm::mat4 &projection, const glm::mat4 &view) {
+  Frustum frustum(projection * view);
+  glm::vec3 eye = camera.getCameraPosition();
+  unsigned int lightCount = pointLightCount + spotLightCount;
+  float ranges[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+  int requests[MAX_POINT_LIGHTS + MAX_SPOT_LIGHTS];
+
+  shadowAtlas.beginFrame();
+  for (unsigned int i = 0; i < lightCount; i ++) {
+    // spot lights are point lights underneath
+    PointLight *light = i < pointLightCount ? &pointLights[i] : &spotLights[i - pointLightCount];
+    ranges[i] = light->getRange(farPlane);
+    requests[i] = -1;
+    if (frustum.testBox(light->getPosition(), glm::vec3(ranges[i])) != FRUSTUM_OUTSIDE) {
+      float importance = ShadowAtlas::screenImportance(light->getPosition(), ranges[i], eye, projection[1][1]);
+      requests[i] = shadowAtlas.request(importance, i < pointLightCount ? 6 : 1);
+    }
+  }
+  shadowAtlas.allocate();
+
+  for (unsigned int i = 0; i < lightCount; i ++) {
+    PointLight *light = i < pointLightCount ? &pointLights[i] : &spotLights[i - pointLightCount];
+    int tile = requests[i] < 0 ? -1 : shadowAtlas.getFirstTile(requests[i]);
+    light->setShadowTile(tile);
+    if (tile < 0) {
+      continue;
+    }
+    if (i < pointLightCount) {
+      for (unsigned int face = 0; face < 6; face ++) {
+	shadowAtlas.setTileTransform(tile + face, pointLights[i].calculateFaceTransform(face, ranges[i]));
+      }
+    } else {
+      shadowAtlas.setTileTransform(tile, spotLights[i - pointLightCount].calculateShadowTransform(ranges[i]));
+    }
+  }
+}
+
+// every granted tile, with casters culled against its own projection
+void shadowAtlasPass() {
+  if (shadowAtlas.getTileCount() == 0) {
+    return;
+  }
+  atlasShadowShader.useShader();
+  shadowAtlas.write();
+
+  // slope scaled, as a constant bias is uneven over perspective depth
+  glEnable(GL_POLYGON_OFFSET_FILL);
+  glPolygonOffset(2.0f, 4.0f);
+  // up to a tile per light and cube face: rasterizing the occluders for
+  // each would cost more than the few casters it could hide
+  for (unsigned int tile = 0; tile < shadowAtlas.getTileCount(); tile ++) {
+    shadowAtlas.writeTile(tile);
+    atlasShadowShader.setLightTransform(shadowAtlas.getTileViewProjection(tile));
+    renderScene(RENDER_PASS_SHADOW, &atlasShadowShader, shadowAtlas.getTileViewProjection(tile), SCENE_ALL, false);
+  }
+  glDisable(GL_POLYGON_OFFSET_FILL);
+
+  GLState::bindFramebuffer(0);
 }
 
 void renderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix) {
   shaderList[0].useShader();
-  
-  uniformModel = shaderList[0].getModelLocation();
-  uniformProjection = shaderList[0].getProjectionLocation();
-  uniformView = shaderList[0].getViewLocation();
-  uniformEyePosition = shaderList[0].getEyePositionLocation();
-  uniformSpecularIntensity = shaderList[0].getSpecularIntensityLocation();
-  uniformShininess = shaderList[0].getShininessLocation();
 
-  glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+  GLState::viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
   
   // clear window
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -337,52 +581,119 @@ void renderPass(glm::mat4 projectionMatrix, glm::mat4 viewMatrix) {
   glUniformMatrix4fv(uniformView, 1, GL_FALSE, glm::value_ptr(viewMatrix));
   glUniform3f(uniformEyePosition, camera.getCameraPosition().x, camera.getCameraPosition().y, camera.getCameraPosition().z);
     
-  shaderList[0].setDirectionalLight(&mainLight);
-  shaderList[0].setPointLights(pointLights, pointLightCount);
-  shaderList[0].setSpotLights(spotLights, spotLightCount);
-  glm::mat4 temp = mainLight.calculateLightTransform();
-  shaderList[0].setDirectionalLightTransform(&temp);
-  //    mainLight.useLight(uniformAmbientIntensity, uniformAmbientColor,
-  //		       uniformDiffuseIntensity, uniformDirection);
+  shaderList[0].setInstanceMaterials(instanceMaterials, 2);
+  shaderList[0].setCascadeTransforms(mainLight.getCascadeTransforms(), mainLight.getCascadeCount());
 
   mainLight.getShadowMap()->read(GL_TEXTURE1);
   shaderList[0].setTexture(0);
   shaderList[0].setDirectionalShadowMap(1);
+  shadowAtlas.read(GL_TEXTURE2);
+  shaderList[0].setShadowAtlas(2);
+  shaderList[0].setShadowTiles(shadowAtlas.getTileTransforms(), shadowAtlas.getTileRects(),
+			       shadowAtlas.getTileCount());
   
   glm::vec3 lowerLight = camera.getCameraPosition();
   lowerLight.y -= 0.3f;
   //  spotLights[0].setFlash(lowerLight, camera.getCameraDirection());
+  lightBuffer.update();
 
-  renderScene();
+  renderScene(RENDER_PASS_OPAQUE, &shaderList[0], projectionMatrix * viewMatrix);
+}
+
+// Renders the starting view with every shadow filter the driver supports
+// and prints the GPU time per frame (shadow and main pass) for each
+void benchmarkShadowFilters(const glm::mat4 &projection) {
+  const unsigned int warmupFrames = 30;
+  const unsigned int timedFrames = 300;
+  GLuint query;
+  glGenQueries(1, &query);
+  glm::mat4 view = camera.calculateView();
+
+  for (int filter = 0; filter < SHADOW_FILTER_COUNT; filter ++) {
+    if (!shadowFilterSupported((ShadowFilter)filter)) {
+      printf("Shadow filter %s: not supported\n", shadowFilterNames[filter]);
+      continue;
+    }
+    buildMainShader((ShadowFilter)filter);
+
+    GLuint64 totalTime = 0;
+    for (unsigned int frame = 0; frame < warmupFrames + timedFrames; frame ++) {
+      glBeginQuery(GL_TIME_ELAPSED, query);
+      resetCullingStats();
+      mainLight.updateCascades(projection * view, nearPlane, shadowDistance, worldBoundsMin, worldBoundsMax);
+      directionalShaderMapPass(&mainLight);
+      updateShadowAtlas(projection, view);
+      shadowAtlasPass();
+      renderPass(projection, view);
+      glEndQuery(GL_TIME_ELAPSED);
+
+      mainWindow.swapBuffers();
+      GLState::endFrame();
+      geometryArena.endFrame();
+      frameRing.endFrame();
+
+      GLuint64 elapsed = 0;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+      if (frame >= warmupFrames) {
+	totalTime += elapsed;
+      }
+    }
+    printf("Shadow filter %s: %.3f ms per frame\n", shadowFilterNames[filter],
+	   totalTime / (double)timedFrames * 1e-6);
+  }
+
+  glDeleteQueries(1, &query);
+  buildMainShader(shadowFilter);
 }
 
 int main(int argc, char *argv[])
 {
+  // --shadow-benchmark times each shadow filter in a hidden window and
+  // exits; --verbose prints LOD and vertex cache stats for models baked
+  bool shadowBenchmark = false, verbose = false;
+  for (int i = 1; i < argc; i ++) {
+    shadowBenchmark = shadowBenchmark || strcmp(argv[i], "--shadow-benchmark") == 0;
+    verbose = verbose || strcmp(argv[i], "--verbose") == 0;
+  }
+
   mainWindow = Window(SCREEN_WIDTH, SCREEN_HEIGHT);
+  mainWindow.setVisible(!shadowBenchmark);
   mainWindow.initialize();
   timer = new Timer();
 
+  // meshes fall back to their own buffers if the arena can't start
+  if (geometryArena.init()) {
+    Mesh::setGeometryArena(&geometryArena);
+    if (frameRing.init(FRAME_RING_SIZE)) {
+      geometryArena.setRingBuffer(&frameRing);
+    }
+  }
   createObjects();
   createShaders();
 
   camera = Camera(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), -90.0f, 0.0f, 5.0f, 0.3f);
 
-  brickTexture = Texture("textures/brick.png");
-  brickTexture.loadTextureAlpha();
-  steelTexture = Texture("textures/steel.png");
-  steelTexture.loadTextureAlpha();
-  concreteTexture = Texture("textures/clay-pixel.png");
-  concreteTexture.loadTextureAlpha();
-  floorTexture = Texture("textures/floor.png");
-  floorTexture.loadTextureAlpha();
+  textureLoader.init("textures/plain.png");
+
+  textureCache.setTextureLoader(&textureLoader);
+
+  brickTexture = textureCache.acquire("textures/brick.png", true);
+  steelTexture = textureCache.acquire("textures/steel.png", true);
+  concreteTexture = textureCache.acquire("textures/clay-pixel.png", true);
+  floorTexture = textureCache.acquire("textures/floor.png", true);
 
   shinyMaterial = Material(4.0f, 256);
   dullMaterial = Material(0.3f, 4);
+  instanceMaterials[0] = dullMaterial;
+  instanceMaterials[1] = shinyMaterial;
 
-  tie_fighter = Model();
-  tie_fighter.loadModel("models/TIE-fighter.obj");
   x_wing = Model();
-  //  x_wing.loadModel("models/x-wing.obj");
+  x_wing.setTextureCache(&textureCache);
+  x_wing.setVerbose(verbose);
+  x_wing.loadModel("models/x-wing.obj");
+  xWingTransform = glm::translate(glm::mat4(1.0), glm::vec3(-7.0f, 0.0f, 10.0f));
+  xWingTransform = glm::scale(xWingTransform, glm::vec3(0.06f, 0.06f, 0.06f));
+  placeObject(SCENE_X_WING, x_wing.getBoundsMin(), x_wing.getBoundsMax(), xWingTransform);
   
   mainLight = DirectionalLight(1024, 1024, 
 			       1.0f, 1.0f, 1.0f,
@@ -408,14 +719,31 @@ int main(int argc, char *argv[])
 			    0.3f, 0.2f, 0.1f,
 			    20.0f);
   spotLightCount ++;
+
+  mainLight.getShadowMap()->initStaticCache();
+  // the far cascades change least as the camera moves
+  mainLight.setCascadeInterval(2, 2);
+  mainLight.setCascadeInterval(3, 4);
+
+  shadowAtlas.init(SHADOW_ATLAS_SIZE, SHADOW_TILE_MIN, SHADOW_TILE_MAX);
+  shadowAtlas.setTileBudget(SHADOW_TILE_BUDGET);
+
+  lightBuffer.init();
+  lightBuffer.setDirectionalLight(&mainLight);
+  lightBuffer.setPointLights(pointLights, pointLightCount);
+  lightBuffer.setSpotLights(spotLights, spotLightCount);
   
   glm::mat4 projection = glm::perspective(45.0f,
 					  mainWindow.getBufferWidth() /
 					  mainWindow.getBufferHeight(),
-					  0.1f, 100.0f);
+					  nearPlane, farPlane);
   
+  if (shadowBenchmark) {
+    benchmarkShadowFilters(projection);
+  }
+
   // loop until window closed
-  while (!mainWindow.getShouldClose()) {
+  while (!shadowBenchmark && !mainWindow.getShouldClose()) {
     GLfloat currentTime = glfwGetTime();
     deltaTime = currentTime - lastTime;
     lastTime = currentTime;
@@ -423,16 +751,57 @@ int main(int argc, char *argv[])
     // Get and handle user input events
     glfwPollEvents();
 
+    textureLoader.update();
+
     camera.keyControl(mainWindow.getKeys(), deltaTime);
     camera.mouseControl(mainWindow.getXchange(), mainWindow.getYchange());
 
+    glm::mat4 view = camera.calculateView();
+    resetCullingStats();
+    mainLight.updateCascades(projection * view, nearPlane, shadowDistance, worldBoundsMin, worldBoundsMax);
     directionalShaderMapPass(&mainLight);
-    renderPass(projection, camera.calculateView());
-
-    glUseProgram(0);
+    updateShadowAtlas(projection, view);
+    shadowAtlasPass();
+    renderPass(projection, view);
 
     mainWindow.swapBuffers();
+    GLState::endFrame();
+    geometryArena.endFrame();
+    frameRing.endFrame();
+  }
+
+  textureCache.printStats();
+  GLState::printStats();
+  printf("Light buffer: %u uploads\n", lightBuffer.getUploads());
+  printf("Culling: %u shadow pass and %u camera pass objects culled last frame\n",
+	 culledObjects[RENDER_PASS_SHADOW], culledObjects[RENDER_PASS_OPAQUE]);
+  printf("Shadow map: static cascade layers redrawn %u times\n", mainLight.getShadowMap()->getStaticUpdates());
+  if (shadowAtlas.isActive()) {
+    printf("Shadow atlas: %u tiles, %u lights dropped last frame\n", shadowAtlas.getTileCount(),
+	   shadowAtlas.getDroppedCount());
+  }
+  printf("Occlusion: %u shadow pass and %u camera pass objects occluded last frame\n",
+	 occludedObjects[RENDER_PASS_SHADOW], occludedObjects[RENDER_PASS_OPAQUE]);
+  if (frameRing.isActive()) {
+    printf("Frame ring: %u frames waited on the GPU\n", frameRing.getStalls());
+  }
+  if (geometryArena.isActive()) {
+    printf("Geometry arena: %u multi-draws, %u commands last frame\n",
+	   geometryArena.getMultiDrawCalls(), geometryArena.getCommands());
+  }
+  x_wing.clearModel();
+  brickCubes.clearInstancedMesh();
+  steelCubes.clearInstancedMesh();
+  for (size_t i = 0; i < meshList.size(); i ++) {
+    meshList[i]->clearMesh();
   }
+  geometryArena.clear();
+  frameRing.clear();
+  lightBuffer.clear();
+  shadowAtlas.clear();
+  occlusionCuller.clear();
+  textureCache.clear();
+  textureLoader.clear();
   
   return 0;
 }
@@ -0,0 +1,55 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile() {
+  fd = -1;
+  data = nullptr;
+  size = 0;
+}
+
+bool MappedFile::open(const char *fileLocation) {
+  close();
+
+  fd = ::open(fileLocation, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 || info.st_size == 0) {
+    close();
+    return false;
+  }
+  size = info.st_size;
+
+  void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping == MAP_FAILED) {
+    printf("Failed to map: \"%s\"\n", fileLocation);
+    close();
+    return false;
+  }
+  data = static_cast<unsigned char*>(mapping);
+  madvise(mapping, size, MADV_SEQUENTIAL);
+
+  return true;
+}
+
+void MappedFile::close() {
+  if (data) {
+    munmap(data, size);
+    data = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+  size = 0;
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
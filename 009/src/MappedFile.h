@@ -0,0 +1,20 @@
+#pragma once
+#include <stdio.h>
+#include <stddef.h>
+
+class MappedFile {
+public:
+  MappedFile();
+
+  bool open(const char *fileLocation);
+  const unsigned char *getData() {return data;}
+  size_t getSize() {return size;}
+  void close();
+
+  ~MappedFile();
+
+private:
+  int fd;
+  unsigned char *data;
+  size_t size;
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
 
 class Material {
 public:
@@ -8,6 +9,8 @@ public:
   Material(GLfloat sIntensity, GLfloat shine);
 
   void useMaterial(GLuint specularIntensityLocation, GLuint shininessLocation);
+  // specular intensity and shininess, as the per-draw attribute wants them
+  glm::vec2 getMaterialData() {return glm::vec2(specularIntensity, shininess);}
   
   ~Material();
 
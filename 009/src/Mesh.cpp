@@ -1,63 +1,215 @@
 #include "Mesh.h"
+#include "GLState.h"
+
+#include <float.h>
+#include <math.h>
+
+GeometryArena *Mesh::geometryArena = nullptr;
 
 Mesh::Mesh() {
   VAO = 0;
   VBO = 0;
   IBO = 0;
   indexCount = 0;
+  indexType = GL_UNSIGNED_INT;
+  vertexFormat = VERTEX_FORMAT_FLOAT;
+  inArena = false;
+  boundsMin = glm::vec3(0.0f);
+  boundsMax = glm::vec3(0.0f);
+  boundsCenter = glm::vec3(0.0f);
+  boundsRadius = 0.0f;
 }
 
-void Mesh::createMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices) {
+void Mesh::createMesh(const GLfloat *vertices, const unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices,
+		      VertexFormat format) {
   indexCount = numOfIndices;
+  vertexFormat = format;
+  computeBounds(vertices, numOfVertices / 8);
+
+  std::vector<unsigned char> packed;
+  packVertices(vertices, numOfVertices / 8, vertexFormat, packed, dequantization);
+
+  std::vector<GLushort> shortIndices;
+  const void *indexData = indices;
+  GLsizeiptr indexSize = sizeof(indices[0]);
+  indexType = GL_UNSIGNED_INT;
+  if (numOfVertices / 8 <= MAX_SHORT_INDEX_VERTICES) {
+    shortIndices.assign(indices, indices + numOfIndices);
+    indexData = shortIndices.empty() ? nullptr : &shortIndices[0];
+    indexSize = sizeof(GLushort);
+    indexType = GL_UNSIGNED_SHORT;
+  }
+
+  if (geometryArena && geometryArena->isActive() &&
+      geometryArena->upload(vertexFormat, packed, numOfVertices / 8, indexData, numOfIndices, indexType, arenaMesh)) {
+    inArena = true;
+    return;
+  }
 
   glGenVertexArrays(1, &VAO);
-  glBindVertexArray(VAO);
+  GLState::bindVertexArray(VAO);
 
   glGenBuffers(1, &IBO);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * numOfIndices, indices, GL_STATIC_DRAW);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize * numOfIndices, indexData, GL_STATIC_DRAW);
 
   glGenBuffers(1, &VBO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * numOfVertices, vertices, GL_STATIC_DRAW);
-
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8, 0);
-  glEnableVertexAttribArray(0);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8,
-			(void*)(sizeof(vertices[0]) * 3));
-  glEnableVertexAttribArray(1);
-  glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(vertices[0]) * 8,
-			(void*)(sizeof(vertices[0]) * 5));
-  glEnableVertexAttribArray(2);
-
-  glBindVertexArray(0);
-  
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+  glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.empty() ? nullptr : &packed[0], GL_STATIC_DRAW);
+
+  setVertexFormatAttributes(vertexFormat);
+
+  // so later element array binds can't land in this VAO
+  GLState::bindVertexArray(0);
+}
+
+// the sphere is centred on the box but sized to the furthest vertex,
+// which is usually tighter than half the diagonal
+void Mesh::computeBounds(const GLfloat *vertices, unsigned int vertexCount) {
+  if (vertexCount == 0) {
+    boundsMin = boundsMax = boundsCenter = glm::vec3(0.0f);
+    boundsRadius = 0.0f;
+    return;
+  }
+  boundsMin = glm::vec3(FLT_MAX);
+  boundsMax = glm::vec3(-FLT_MAX);
+  for (unsigned int i = 0; i < vertexCount; i ++) {
+    glm::vec3 p(vertices[i * 8], vertices[i * 8 + 1], vertices[i * 8 + 2]);
+    boundsMin = glm::min(boundsMin, p);
+    boundsMax = glm::max(boundsMax, p);
+  }
+  boundsCenter = (boundsMin + boundsMax) * 0.5f;
+  float radius2 = 0.0f;
+  for (unsigned int i = 0; i < vertexCount; i ++) {
+    glm::vec3 p(vertices[i * 8], vertices[i * 8 + 1], vertices[i * 8 + 2]);
+    radius2 = glm::max(radius2, glm::dot(p - boundsCenter, p - boundsCenter));
+  }
+  boundsRadius = sqrtf(radius2);
+}
+
+void Mesh::setLodLevels(const unsigned int *counts, unsigned int levelCount) {
+  lodFirst.clear();
+  lodCount.clear();
+  GLsizei first = 0;
+  for (unsigned int i = 0; i < levelCount; i ++) {
+    lodFirst.push_back(first);
+    lodCount.push_back(counts[i]);
+    first += counts[i];
+  }
+}
+
+void Mesh::renderMesh(unsigned int lod) {
+  if (inArena) {
+    DrawData draw;
+    fillDrawData(draw, glm::mat4(1.0f), glm::mat3(1.0f), -1);
+    addToBatch(&draw, 1, lod);
+    geometryArena->flush();
+    return;
+  }
+
+  // a single instance at the identity for shaders that read the
+  // per-instance transform, material and normal matrix (attributes 6-10
+  // and 12-14)
+  glVertexAttrib4f(6, 1.0f, 0.0f, 0.0f, 0.0f);
+  glVertexAttrib4f(7, 0.0f, 1.0f, 0.0f, 0.0f);
+  glVertexAttrib4f(8, 0.0f, 0.0f, 1.0f, 0.0f);
+  glVertexAttrib4f(9, 0.0f, 0.0f, 0.0f, 1.0f);
+  glVertexAttribI1i(10, -1);
+  glVertexAttrib3f(12, 1.0f, 0.0f, 0.0f);
+  glVertexAttrib3f(13, 0.0f, 1.0f, 0.0f);
+  glVertexAttrib3f(14, 0.0f, 0.0f, 1.0f);
+  drawElements(VAO, 0, lod);
 }
 
-void Mesh::renderMesh() {
-  glBindVertexArray(VAO);
+GLuint Mesh::createVertexArray() {
+  GLuint vertexArray = 0;
+  glGenVertexArrays(1, &vertexArray);
+  GLState::bindVertexArray(vertexArray);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  glBindVertexArray(0);
+  GLState::bindBuffer(GL_ARRAY_BUFFER, VBO);
+  setVertexFormatAttributes(vertexFormat);
+  return vertexArray;
+}
+
+void Mesh::renderMeshInstanced(GLuint vertexArray, GLsizei instanceCount, unsigned int lod) {
+  if (instanceCount > 0) {
+    drawElements(vertexArray, instanceCount, lod);
+  }
+}
+
+void Mesh::fillDrawData(DrawData &draw, const glm::mat4 &transform, const glm::mat3 &normal, GLint materialIndex) {
+  draw.positionScale = dequantization.positionScale;
+  draw.positionOffset = dequantization.positionOffset;
+  draw.texCoordTransform = dequantization.texCoordTransform;
+  draw.model = transform;
+  draw.normalMatrix = normal;
+  draw.materialIndex = materialIndex;
+  draw.material = glm::vec2(0.0f);
+}
+
+void Mesh::addToBatch(const DrawData *draws, GLuint drawCount, unsigned int lod) {
+  GLsizei first, count;
+  lodRange(lod, first, count);
+  geometryArena->addDraw(arenaMesh, first, count, draws, drawCount);
+}
+
+void Mesh::lodRange(unsigned int lod, GLsizei &first, GLsizei &count) {
+  first = 0;
+  count = indexCount;
+  if (!lodFirst.empty()) {
+    // coarsest level the mesh has if asked for more
+    lod = lod < lodFirst.size() ? lod : lodFirst.size() - 1;
+    first = lodFirst[lod];
+    count = lodCount[lod];
+  }
+}
+
+// instanceCount 0 is a plain, non-instanced draw
+void Mesh::drawElements(GLuint vertexArray, GLsizei instanceCount, unsigned int lod) {
+  GLsizei first, count;
+  lodRange(lod, first, count);
+  GLsizei indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+  const GLvoid *offset = (const GLvoid*)(size_t)(first * indexSize);
+
+  // attributes 3-5 are never enabled as arrays, so these constant values
+  // carry the dequantization into the vertex shader
+  glVertexAttrib3f(3, dequantization.positionScale.x, dequantization.positionScale.y, dequantization.positionScale.z);
+  glVertexAttrib3f(4, dequantization.positionOffset.x, dequantization.positionOffset.y, dequantization.positionOffset.z);
+  glVertexAttrib4f(5, dequantization.texCoordTransform.x, dequantization.texCoordTransform.y,
+		   dequantization.texCoordTransform.z, dequantization.texCoordTransform.w);
+  // the index buffer is part of the VAO
+  GLState::bindVertexArray(vertexArray);
+  if (instanceCount > 0) {
+    glDrawElementsInstanced(GL_TRIANGLES, count, indexType, offset, instanceCount);
+  } else {
+    glDrawElements(GL_TRIANGLES, count, indexType, offset);
+  }
 }
 
 void Mesh::clearMesh() {
+  if (inArena) {
+    geometryArena->release(arenaMesh);
+    inArena = false;
+  }
   if (IBO != 0) {
     glDeleteBuffers(1, &IBO);
+    GLState::bufferDeleted(IBO);
     IBO = 0;
   }
   if (VBO != 0) {
     glDeleteBuffers(1, &VBO);
+    GLState::bufferDeleted(VBO);
     VBO = 0;
   }
   if (VAO != 0) {
     glDeleteVertexArrays(1, &VAO);
+    GLState::vertexArrayDeleted(VAO);
     VAO = 0;
   }
   indexCount = 0;
+  indexType = GL_UNSIGNED_INT;
+  lodFirst.clear();
+  lodCount.clear();
 }
 
 Mesh::~Mesh() {
@@ -1,16 +1,70 @@
 #pragma once
+#include <vector>
+
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "VertexFormat.h"
+#include "GeometryArena.h"
+
+// Largest vertex count that can still be drawn with 16-bit indices
+const unsigned int MAX_SHORT_INDEX_VERTICES = 65536;
 
 class Mesh {
 public:
   Mesh();
   
-  void createMesh(GLfloat *vertices, unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices);
-  void renderMesh();
+  void createMesh(const GLfloat *vertices, const unsigned int *indices, unsigned int numOfVertices, unsigned int numOfIndices,
+		  VertexFormat format = VERTEX_FORMAT_FLOAT);
+  // counts are consecutive LOD index ranges in the index buffer, full
+  // detail first. Without this the whole buffer is one level.
+  void setLodLevels(const unsigned int *counts, unsigned int levelCount);
+  void renderMesh(unsigned int lod = 0);
   void clearMesh();
+
+  // Meshes created while an active arena is set live in it instead of
+  // owning buffers, and draw through batches
+  static void setGeometryArena(GeometryArena *arena) {geometryArena = arena;}
+  static GeometryArena *getGeometryArena() {return geometryArena;}
+  bool isInArena() {return inArena;}
+  // fills in this mesh's dequantization along with transform and material
+  void fillDrawData(DrawData &draw, const glm::mat4 &transform, const glm::mat3 &normal, GLint materialIndex);
+  // queued until the arena is flushed
+  void addToBatch(const DrawData *draws, GLuint drawCount, unsigned int lod = 0);
+
+  // A new VAO over this mesh's vertex and index buffers, left bound so the
+  // caller can add per-instance attributes. The caller owns it.
+  GLuint createVertexArray();
+  void renderMeshInstanced(GLuint vertexArray, GLsizei instanceCount, unsigned int lod = 0);
+  VertexFormat getVertexFormat() {return vertexFormat;}
+  GLenum getIndexType() {return indexType;}
+  unsigned int getLodCount() {return lodFirst.empty() ? 1 : lodFirst.size();}
+  // local space, from the vertices given to createMesh()
+  glm::vec3 getBoundsMin() {return boundsMin;}
+  glm::vec3 getBoundsMax() {return boundsMax;}
+  glm::vec3 getBoundsCenter() {return boundsCenter;}
+  float getBoundsRadius() {return boundsRadius;}
   
   ~Mesh();
 private:
   GLuint VAO, VBO, IBO;
   GLsizei indexCount;
+  GLenum indexType;
+  std::vector<GLsizei> lodFirst;
+  std::vector<GLsizei> lodCount;
+
+  VertexFormat vertexFormat;
+  VertexDequantization dequantization;
+
+  glm::vec3 boundsMin, boundsMax;
+  glm::vec3 boundsCenter;
+  float boundsRadius;
+
+  static GeometryArena *geometryArena;
+  bool inArena;
+  ArenaMesh arenaMesh;
+
+  void computeBounds(const GLfloat *vertices, unsigned int vertexCount);
+  void lodRange(unsigned int lod, GLsizei &first, GLsizei &count);
+  void drawElements(GLuint vertexArray, GLsizei instanceCount, unsigned int lod);
 };
@@ -0,0 +1,238 @@
+#include "MeshCache.h"
+#include "Hash.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char CACHE_MAGIC[4] = {'B', 'A', 'K', 'E'};
+// bumped whenever the import pipeline changes what gets baked
+// 2: triangle/vertex order optimized by optimizeMeshes()
+// 3: split for 16-bit indices, LOD chains
+// 4: importer keyed in the header instead of in the import flags
+static const uint32_t CACHE_VERSION = 4;
+static const unsigned int FLOATS_PER_VERTEX = 8;
+
+MeshCache::MeshCache() {
+  sourceHash = 0;
+  flags = 0;
+  importerId = 0;
+  header = nullptr;
+  meshEntries = nullptr;
+  materialEntries = nullptr;
+}
+
+bool MeshCache::open(const std::string &sourceFile, unsigned int importFlags, unsigned int importer) {
+  close();
+
+  cacheFile = sourceFile + ".bake";
+  flags = importFlags;
+  importerId = importer;
+
+  MappedFile source;
+  if (!source.open(sourceFile.c_str())) {
+    return false;
+  }
+  sourceHash = hashBytes(source.getData(), source.getSize());
+  source.close();
+
+  if (!mapping.open(cacheFile.c_str())) {
+    return false;
+  }
+  if (!validate()) {
+    mapping.close();
+    header = nullptr;
+    meshEntries = nullptr;
+    materialEntries = nullptr;
+    return false;
+  }
+
+  return true;
+}
+
+bool MeshCache::validate() {
+  const unsigned char *data = mapping.getData();
+  size_t size = mapping.getSize();
+
+  if (size < sizeof(Header)) {
+    return false;
+  }
+  header = reinterpret_cast<const Header*>(data);
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+      header->version != CACHE_VERSION ||
+      header->sourceHash != sourceHash ||
+      header->importFlags != flags ||
+      header->importer != importerId) {
+    return false;
+  }
+
+  size_t tableEnd = sizeof(Header) +
+    sizeof(MeshEntry) * header->meshCount +
+    sizeof(MaterialEntry) * header->materialCount;
+  if (tableEnd > size) {
+    return false;
+  }
+  meshEntries = reinterpret_cast<const MeshEntry*>(data + sizeof(Header));
+  materialEntries = reinterpret_cast<const MaterialEntry*>(meshEntries + header->meshCount);
+
+  for (size_t i = 0; i < header->meshCount; i ++) {
+    const MeshEntry &entry = meshEntries[i];
+    uint64_t vertexBytes = uint64_t(entry.vertexCount) * FLOATS_PER_VERTEX * sizeof(GLfloat);
+    uint64_t indexBytes = uint64_t(entry.indexCount) * sizeof(unsigned int);
+    uint64_t lodBytes = uint64_t(entry.lodCount) * sizeof(unsigned int);
+    if (entry.vertexOffset + vertexBytes > size || entry.indexOffset + indexBytes > size ||
+	entry.lodOffset + lodBytes > size) {
+      return false;
+    }
+    // the levels have to cover the index list exactly
+    const unsigned int *lodCounts = reinterpret_cast<const unsigned int*>(data + entry.lodOffset);
+    uint64_t lodIndices = 0;
+    for (size_t level = 0; level < entry.lodCount; level ++) {
+      lodIndices += lodCounts[level];
+    }
+    if (entry.lodCount && lodIndices != entry.indexCount) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < header->materialCount; i ++) {
+    const MaterialEntry &entry = materialEntries[i];
+    if (entry.pathOffset + entry.pathLength > size) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool MeshCache::write(const std::vector<BakedMesh> &meshes, const std::vector<std::string> &texturePaths) {
+  Header newHeader;
+  memcpy(newHeader.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  newHeader.version = CACHE_VERSION;
+  newHeader.sourceHash = sourceHash;
+  newHeader.importFlags = flags;
+  newHeader.meshCount = meshes.size();
+  newHeader.materialCount = texturePaths.size();
+  newHeader.importer = importerId;
+
+  // geometry follows the tables, strings go last so the floats stay aligned
+  uint64_t offset = sizeof(Header) +
+    sizeof(MeshEntry) * meshes.size() +
+    sizeof(MaterialEntry) * texturePaths.size();
+
+  std::vector<MeshEntry> newMeshEntries(meshes.size());
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    MeshEntry &entry = newMeshEntries[i];
+    entry.vertexCount = meshes[i].vertices.size() / FLOATS_PER_VERTEX;
+    entry.indexCount = meshes[i].indices.size();
+    entry.materialIndex = meshes[i].materialIndex;
+    entry.lodCount = meshes[i].lodIndexCounts.size();
+    entry.vertexOffset = offset;
+    offset += sizeof(GLfloat) * meshes[i].vertices.size();
+    entry.indexOffset = offset;
+    offset += sizeof(unsigned int) * meshes[i].indices.size();
+    entry.lodOffset = offset;
+    offset += sizeof(unsigned int) * meshes[i].lodIndexCounts.size();
+  }
+
+  std::vector<MaterialEntry> newMaterialEntries(texturePaths.size());
+  for (size_t i = 0; i < texturePaths.size(); i ++) {
+    MaterialEntry &entry = newMaterialEntries[i];
+    entry.pathOffset = offset;
+    entry.pathLength = texturePaths[i].size();
+    entry.reserved = 0;
+    offset += texturePaths[i].size();
+  }
+
+  std::string tempFile = cacheFile + ".tmp";
+  FILE *file = fopen(tempFile.c_str(), "wb");
+  if (!file) {
+    printf("Failed to write mesh cache: \"%s\"\n", tempFile.c_str());
+    return false;
+  }
+
+  bool ok = fwrite(&newHeader, sizeof(Header), 1, file) == 1;
+  if (!newMeshEntries.empty()) {
+    ok = ok && fwrite(&newMeshEntries[0], sizeof(MeshEntry), newMeshEntries.size(), file) == newMeshEntries.size();
+  }
+  if (!newMaterialEntries.empty()) {
+    ok = ok && fwrite(&newMaterialEntries[0], sizeof(MaterialEntry), newMaterialEntries.size(), file) == newMaterialEntries.size();
+  }
+  for (size_t i = 0; i < meshes.size() && ok; i ++) {
+    const BakedMesh &mesh = meshes[i];
+    if (!mesh.vertices.empty()) {
+      ok = fwrite(&mesh.vertices[0], sizeof(GLfloat), mesh.vertices.size(), file) == mesh.vertices.size();
+    }
+    if (ok && !mesh.indices.empty()) {
+      ok = fwrite(&mesh.indices[0], sizeof(unsigned int), mesh.indices.size(), file) == mesh.indices.size();
+    }
+    if (ok && !mesh.lodIndexCounts.empty()) {
+      ok = fwrite(&mesh.lodIndexCounts[0], sizeof(unsigned int), mesh.lodIndexCounts.size(), file) ==
+	mesh.lodIndexCounts.size();
+    }
+  }
+  for (size_t i = 0; i < texturePaths.size() && ok; i ++) {
+    ok = fwrite(texturePaths[i].data(), 1, texturePaths[i].size(), file) == texturePaths[i].size();
+  }
+
+  if (fclose(file) != 0) {
+    ok = false;
+  }
+  if (!ok || rename(tempFile.c_str(), cacheFile.c_str()) != 0) {
+    printf("Failed to write mesh cache: \"%s\"\n", cacheFile.c_str());
+    remove(tempFile.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void MeshCache::close() {
+  mapping.close();
+  header = nullptr;
+  meshEntries = nullptr;
+  materialEntries = nullptr;
+}
+
+unsigned int MeshCache::getMeshCount() {
+  return header ? header->meshCount : 0;
+}
+
+const GLfloat *MeshCache::getVertices(unsigned int mesh) {
+  return reinterpret_cast<const GLfloat*>(mapping.getData() + meshEntries[mesh].vertexOffset);
+}
+
+unsigned int MeshCache::getVertexCount(unsigned int mesh) {
+  return meshEntries[mesh].vertexCount;
+}
+
+const unsigned int *MeshCache::getIndices(unsigned int mesh) {
+  return reinterpret_cast<const unsigned int*>(mapping.getData() + meshEntries[mesh].indexOffset);
+}
+
+unsigned int MeshCache::getIndexCount(unsigned int mesh) {
+  return meshEntries[mesh].indexCount;
+}
+
+unsigned int MeshCache::getMaterialIndex(unsigned int mesh) {
+  return meshEntries[mesh].materialIndex;
+}
+
+unsigned int MeshCache::getLodCount(unsigned int mesh) {
+  return meshEntries[mesh].lodCount;
+}
+
+const unsigned int *MeshCache::getLodIndexCounts(unsigned int mesh) {
+  return reinterpret_cast<const unsigned int*>(mapping.getData() + meshEntries[mesh].lodOffset);
+}
+
+unsigned int MeshCache::getMaterialCount() {
+  return header ? header->materialCount : 0;
+}
+
+std::string MeshCache::getTexturePath(unsigned int material) {
+  const MaterialEntry &entry = materialEntries[material];
+  return std::string(reinterpret_cast<const char*>(mapping.getData() + entry.pathOffset), entry.pathLength);
+}
+
+MeshCache::~MeshCache() {
+  close();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "MappedFile.h"
+
+// Post-processed geometry of one submesh, laid out exactly as Mesh uploads
+// it: 8 floats per vertex (position, uv, normal). With a LOD chain the
+// index lists of all levels are stored back to back, finest first.
+struct BakedMesh {
+  std::vector<GLfloat> vertices;
+  std::vector<unsigned int> indices;
+  std::vector<unsigned int> lodIndexCounts;
+  unsigned int materialIndex;
+};
+
+// Binary cache of an imported model, stored next to the source file as
+// "<source>.bake". A cache is only valid for the exact source contents and
+// import flags and importer it was baked from.
+class MeshCache {
+public:
+  MeshCache();
+
+  // importer tells bakes of the same source by different loaders apart
+  bool open(const std::string &sourceFile, unsigned int importFlags, unsigned int importer = 0);
+  bool write(const std::vector<BakedMesh> &meshes, const std::vector<std::string> &texturePaths);
+  void close();
+
+  unsigned int getMeshCount();
+  const GLfloat *getVertices(unsigned int mesh);
+  unsigned int getVertexCount(unsigned int mesh);
+  const unsigned int *getIndices(unsigned int mesh);
+  unsigned int getIndexCount(unsigned int mesh);
+  unsigned int getMaterialIndex(unsigned int mesh);
+  unsigned int getLodCount(unsigned int mesh);
+  const unsigned int *getLodIndexCounts(unsigned int mesh);
+
+  unsigned int getMaterialCount();
+  std::string getTexturePath(unsigned int material);
+
+  ~MeshCache();
+
+private:
+  struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t importFlags;
+    uint32_t meshCount;
+    uint32_t materialCount;
+    uint32_t importer;
+  };
+
+  struct MeshEntry {
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t materialIndex;
+    uint32_t lodCount;
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint64_t lodOffset;
+  };
+
+  struct MaterialEntry {
+    uint64_t pathOffset;
+    uint32_t pathLength;
+    uint32_t reserved;
+  };
+
+  std::string cacheFile;
+  uint64_t sourceHash;
+  unsigned int flags;
+  unsigned int importerId;
+
+  MappedFile mapping;
+  const Header *header;
+  const MeshEntry *meshEntries;
+  const MaterialEntry *materialEntries;
+
+  bool validate();
+};
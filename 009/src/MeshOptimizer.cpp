@@ -0,0 +1,308 @@
+#include "MeshOptimizer.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, unsigned int vertexCount,
+				    unsigned int cacheSize) {
+  VertexCacheStats stats;
+  stats.transforms = 0;
+  stats.triangles = indices.size() / 3;
+  stats.vertices = vertexCount;
+
+  // a vertex is still cached while fewer than cacheSize misses happened
+  // after its own
+  std::vector<unsigned int> timestamps(vertexCount, 0);
+  unsigned int time = cacheSize + 1;
+  for (size_t i = 0; i < indices.size(); i ++) {
+    unsigned int v = indices[i];
+    if (time - timestamps[v] > cacheSize) {
+      timestamps[v] = time;
+      time ++;
+      stats.transforms ++;
+    }
+  }
+  return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount,
+			 std::vector<unsigned int> &clusters, unsigned int cacheSize) {
+  size_t triangleCount = indices.size() / 3;
+  clusters.clear();
+  if (triangleCount == 0) {
+    return;
+  }
+
+  // vertex -> triangle adjacency
+  std::vector<unsigned int> liveTriangles(vertexCount, 0);
+  for (size_t i = 0; i < triangleCount * 3; i ++) {
+    liveTriangles[indices[i]] ++;
+  }
+  std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+  for (size_t v = 0; v < vertexCount; v ++) {
+    adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+  }
+  std::vector<unsigned int> adjacency(triangleCount * 3);
+  std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+  for (size_t i = 0; i < triangleCount * 3; i ++) {
+    adjacency[fill[indices[i]] ++] = i / 3;
+  }
+
+  std::vector<unsigned int> timestamps(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<unsigned int> deadEnds;
+  std::vector<unsigned int> candidates;
+  std::vector<unsigned int> output;
+  output.reserve(triangleCount * 3);
+
+  unsigned int time = cacheSize + 1;
+  unsigned int cursor = 0;
+  int fanning = 0;
+  while (fanning >= 0 && liveTriangles[fanning] == 0 && cursor + 1 < vertexCount) {
+    fanning = ++ cursor;
+  }
+  clusters.push_back(0);
+
+  while (fanning >= 0) {
+    candidates.clear();
+    for (size_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; a ++) {
+      unsigned int t = adjacency[a];
+      if (emitted[t]) {
+	continue;
+      }
+      for (size_t k = 0; k < 3; k ++) {
+	unsigned int v = indices[t * 3 + k];
+	output.push_back(v);
+	deadEnds.push_back(v);
+	candidates.push_back(v);
+	liveTriangles[v] --;
+	if (time - timestamps[v] > cacheSize) {
+	  timestamps[v] = time;
+	  time ++;
+	}
+      }
+      emitted[t] = true;
+    }
+
+    // next fanning vertex: the candidate that stays in cache longest while
+    // it still has triangles left
+    int next = -1;
+    int best = -1;
+    for (size_t i = 0; i < candidates.size(); i ++) {
+      unsigned int v = candidates[i];
+      if (liveTriangles[v] == 0) {
+	continue;
+      }
+      int priority = 0;
+      if (time - timestamps[v] + 2 * liveTriangles[v] <= cacheSize) {
+	priority = time - timestamps[v];
+      }
+      if (priority > best) {
+	best = priority;
+	next = v;
+      }
+    }
+
+    if (next == -1) {
+      // dead end: back up through recently used vertices, then scan
+      while (!deadEnds.empty() && next == -1) {
+	unsigned int v = deadEnds.back();
+	deadEnds.pop_back();
+	if (liveTriangles[v] > 0) {
+	  next = v;
+	}
+      }
+      while (next == -1 && cursor + 1 < vertexCount) {
+	cursor ++;
+	if (liveTriangles[cursor] > 0) {
+	  next = cursor;
+	}
+      }
+      if (next != -1 && output.size() / 3 < triangleCount) {
+	clusters.push_back(output.size() / 3);
+      }
+    }
+    fanning = next;
+  }
+
+  indices.swap(output);
+}
+
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<GLfloat> &vertices,
+		      const std::vector<unsigned int> &clusters, float threshold) {
+  size_t triangleCount = indices.size() / 3;
+  if (clusters.size() < 2) {
+    return;
+  }
+
+  std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3(0.0f));
+  std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3(0.0f));
+  std::vector<float> clusterAreas(clusters.size(), 0.0f);
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+
+  for (size_t c = 0; c < clusters.size(); c ++) {
+    size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    for (size_t t = clusters[c]; t < end; t ++) {
+      const GLfloat *p0 = &vertices[indices[t * 3 + 0] * 8];
+      const GLfloat *p1 = &vertices[indices[t * 3 + 1] * 8];
+      const GLfloat *p2 = &vertices[indices[t * 3 + 2] * 8];
+      glm::vec3 a(p0[0], p0[1], p0[2]), b(p1[0], p1[1], p1[2]), d(p2[0], p2[1], p2[2]);
+      glm::vec3 normal = glm::cross(b - a, d - a);
+      float area = glm::length(normal);
+      glm::vec3 centroid = (a + b + d) / 3.0f;
+      clusterCentroids[c] += centroid * area;
+      clusterNormals[c] += normal;
+      clusterAreas[c] += area;
+      meshCentroid += centroid * area;
+      meshArea += area;
+    }
+  }
+  if (meshArea <= 0.0f) {
+    return;
+  }
+  meshCentroid /= meshArea;
+
+  std::vector<float> sortKeys(clusters.size(), 0.0f);
+  for (size_t c = 0; c < clusters.size(); c ++) {
+    if (clusterAreas[c] <= 0.0f) {
+      continue;
+    }
+    glm::vec3 centroid = clusterCentroids[c] / clusterAreas[c];
+    float normalLength = glm::length(clusterNormals[c]);
+    if (normalLength > 0.0f) {
+      sortKeys[c] = glm::dot(centroid - meshCentroid, clusterNormals[c] / normalLength);
+    }
+  }
+
+  std::vector<unsigned int> order(clusters.size());
+  for (size_t c = 0; c < order.size(); c ++) {
+    order[c] = c;
+  }
+  std::stable_sort(order.begin(), order.end(), [&sortKeys](unsigned int a, unsigned int b) {
+      return sortKeys[a] > sortKeys[b];
+    });
+
+  std::vector<unsigned int> sorted;
+  sorted.reserve(indices.size());
+  for (size_t i = 0; i < order.size(); i ++) {
+    unsigned int c = order[i];
+    size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+    sorted.insert(sorted.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+  }
+
+  unsigned int vertexCount = vertices.size() / 8;
+  float before = analyzeVertexCache(indices, vertexCount).acmr();
+  float after = analyzeVertexCache(sorted, vertexCount).acmr();
+  if (after <= before * threshold) {
+    indices.swap(sorted);
+  }
+}
+
+void optimizeVertexFetch(std::vector<GLfloat> &vertices, std::vector<unsigned int> &indices) {
+  unsigned int vertexCount = vertices.size() / 8;
+  std::vector<unsigned int> remap(vertexCount, ~0u);
+  std::vector<GLfloat> reordered;
+  reordered.reserve(vertices.size());
+
+  for (size_t i = 0; i < indices.size(); i ++) {
+    unsigned int v = indices[i];
+    if (remap[v] == ~0u) {
+      remap[v] = reordered.size() / 8;
+      reordered.insert(reordered.end(), vertices.begin() + v * 8, vertices.begin() + v * 8 + 8);
+    }
+    indices[i] = remap[v];
+  }
+
+  vertices.swap(reordered);
+}
+
+// Index range of one LOD level; meshes baked without LODs are one level
+static size_t lodCount(const BakedMesh &mesh) {
+  return mesh.lodIndexCounts.empty() ? 1 : mesh.lodIndexCounts.size();
+}
+
+static std::vector<unsigned int> getLod(const BakedMesh &mesh, size_t level) {
+  if (mesh.lodIndexCounts.empty()) {
+    return mesh.indices;
+  }
+  size_t first = 0;
+  for (size_t l = 0; l < level; l ++) {
+    first += mesh.lodIndexCounts[l];
+  }
+  return std::vector<unsigned int>(mesh.indices.begin() + first,
+				   mesh.indices.begin() + first + mesh.lodIndexCounts[level]);
+}
+
+static void setLod(BakedMesh &mesh, size_t level, const std::vector<unsigned int> &indices) {
+  size_t first = 0;
+  for (size_t l = 0; l < level && l < mesh.lodIndexCounts.size(); l ++) {
+    first += mesh.lodIndexCounts[l];
+  }
+  std::copy(indices.begin(), indices.end(), mesh.indices.begin() + first);
+}
+
+// Stats cover the full detail level only, that's what draws up close
+static VertexCacheStats analyzeMeshes(const std::vector<BakedMesh> &meshes) {
+  VertexCacheStats total;
+  total.transforms = total.triangles = total.vertices = 0;
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    VertexCacheStats stats = analyzeVertexCache(getLod(meshes[i], 0), meshes[i].vertices.size() / 8);
+    total.transforms += stats.transforms;
+    total.triangles += stats.triangles;
+    total.vertices += stats.vertices;
+  }
+  return total;
+}
+
+// prints how the step changed the stats, then keeps the new ones in
+// before for the next step
+static void reportStep(const std::vector<BakedMesh> &meshes, const char *name, const char *step,
+		       VertexCacheStats &before) {
+  VertexCacheStats after = analyzeMeshes(meshes);
+  printf("Model (%s) %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name, step,
+	 before.acmr(), after.acmr(), before.atvr(), after.atvr());
+  before = after;
+}
+
+void optimizeMeshes(std::vector<BakedMesh> &meshes, const char *name, bool verbose) {
+  std::vector<std::vector<std::vector<unsigned int> > > clusters(meshes.size());
+
+  VertexCacheStats stats;
+  if (verbose) {
+    stats = analyzeMeshes(meshes);
+  }
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    clusters[i].resize(lodCount(meshes[i]));
+    for (size_t level = 0; level < clusters[i].size(); level ++) {
+      std::vector<unsigned int> indices = getLod(meshes[i], level);
+      optimizeVertexCache(indices, meshes[i].vertices.size() / 8, clusters[i][level]);
+      setLod(meshes[i], level, indices);
+    }
+  }
+  if (verbose) {
+    reportStep(meshes, name, "vertex cache", stats);
+  }
+
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    for (size_t level = 0; level < clusters[i].size(); level ++) {
+      std::vector<unsigned int> indices = getLod(meshes[i], level);
+      optimizeOverdraw(indices, meshes[i].vertices, clusters[i][level]);
+      setLod(meshes[i], level, indices);
+    }
+  }
+  if (verbose) {
+    reportStep(meshes, name, "overdraw", stats);
+  }
+
+  // One vertex buffer serves every level; LOD0 comes first in the index
+  // list so its vertices end up first in memory
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    optimizeVertexFetch(meshes[i].vertices, meshes[i].indices);
+  }
+  if (verbose) {
+    reportStep(meshes, name, "vertex fetch", stats);
+  }
+}
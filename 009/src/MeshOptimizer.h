@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "MeshCache.h"
+
+// Import-time triangle and vertex reordering for the 8-float Mesh layout.
+// ACMR is post-transform cache misses per triangle, ATVR is misses per
+// vertex (1.0 is ideal), both simulated with a FIFO of cacheSize entries.
+
+const unsigned int VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats {
+  unsigned int transforms;
+  unsigned int triangles;
+  unsigned int vertices;
+
+  float acmr() {return triangles ? float(transforms) / triangles : 0.0f;}
+  float atvr() {return vertices ? float(transforms) / vertices : 0.0f;}
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, unsigned int vertexCount,
+				    unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Tipsify (Sander et al. 2007). clusters receives the first triangle of
+// every run that starts after a dead end.
+void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount,
+			 std::vector<unsigned int> &clusters, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// Sorts the Tipsify clusters so outward-facing ones far from the mesh
+// center draw first. Falls back to the input order when the ACMR would get
+// worse than threshold times the input.
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<GLfloat> &vertices,
+		      const std::vector<unsigned int> &clusters, float threshold = 1.05f);
+
+// Renumbers vertices in first-use order and drops unreferenced ones
+void optimizeVertexFetch(std::vector<GLfloat> &vertices, std::vector<unsigned int> &indices);
+
+// Runs the three passes above over every mesh, with verbose printing
+// ACMR/ATVR before and after each one. Cache and overdraw passes work on
+// each LOD level of BakedMesh::lodIndexCounts separately.
+void optimizeMeshes(std::vector<BakedMesh> &meshes, const char *name, bool verbose = false);
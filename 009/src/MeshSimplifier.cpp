@@ -0,0 +1,342 @@
+#include "MeshSimplifier.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <queue>
+
+#include <glm/glm.hpp>
+
+namespace {
+
+// Symmetric 4x4 plane quadric, upper triangle only
+struct Quadric {
+  double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+  Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+  void addPlane(double a, double b, double c, double d, double weight) {
+    a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+    b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+    c2 += weight * c * c; cd += weight * c * d;
+    d2 += weight * d * d;
+  }
+
+  void add(const Quadric &q) {
+    a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+    b2 += q.b2; bc += q.bc; bd += q.bd;
+    c2 += q.c2; cd += q.cd;
+    d2 += q.d2;
+  }
+
+  double evaluate(const glm::vec3 &p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+      b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+      c2 * z * z + 2 * cd * z + d2;
+  }
+};
+
+struct Collapse {
+  float cost;
+  unsigned int from, to;
+  unsigned int version;
+
+  bool operator>(const Collapse &other) const {return cost > other.cost;}
+};
+
+}
+
+float simplifyMesh(const std::vector<GLfloat> &vertices, const std::vector<unsigned int> &indices,
+		   size_t targetIndexCount, float maxError, std::vector<unsigned int> &result) {
+  unsigned int vertexCount = vertices.size() / 8;
+  size_t triangleCount = indices.size() / 3;
+  result = indices;
+  if (result.size() <= targetIndexCount) {
+    return 0.0f;
+  }
+
+  // Collapses work on positions. Vertices that share a position but not
+  // attributes (uv or normal seams) are wedges of the same position and
+  // move together: every wedge has to land on a wedge of the target it
+  // shares an edge with, which keeps seams intact and only lets them
+  // shorten along themselves.
+  std::vector<glm::vec3> positions(vertexCount);
+  std::vector<unsigned int> positionOf(vertexCount);
+  std::vector<unsigned int> nextWedge(vertexCount);
+  std::map<std::vector<float>, unsigned int> firstAtPosition;
+  for (unsigned int v = 0; v < vertexCount; v ++) {
+    positions[v] = glm::vec3(vertices[v * 8], vertices[v * 8 + 1], vertices[v * 8 + 2]);
+    std::vector<float> key(&vertices[v * 8], &vertices[v * 8] + 3);
+    std::map<std::vector<float>, unsigned int>::iterator found = firstAtPosition.find(key);
+    if (found == firstAtPosition.end()) {
+      firstAtPosition[key] = v;
+      positionOf[v] = v;
+      nextWedge[v] = v;
+    } else {
+      unsigned int first = found->second;
+      positionOf[v] = first;
+      nextWedge[v] = nextWedge[first];
+      nextWedge[first] = v;
+    }
+  }
+
+  // open borders, counted between positions so seams don't look open
+  std::map<std::pair<unsigned int, unsigned int>, unsigned int> edgeUse;
+  for (size_t t = 0; t < triangleCount; t ++) {
+    for (size_t k = 0; k < 3; k ++) {
+      unsigned int a = positionOf[result[t * 3 + k]], b = positionOf[result[t * 3 + (k + 1) % 3]];
+      edgeUse[std::make_pair(std::min(a, b), std::max(a, b))] ++;
+    }
+  }
+  std::vector<bool> locked(vertexCount, false);
+  for (std::map<std::pair<unsigned int, unsigned int>, unsigned int>::iterator it = edgeUse.begin();
+       it != edgeUse.end(); ++ it) {
+    if (it->second == 1) {
+      locked[it->first.first] = true;
+      locked[it->first.second] = true;
+    }
+  }
+
+  std::vector<Quadric> quadrics(vertexCount);
+  std::vector<std::vector<unsigned int> > vertexTriangles(vertexCount);
+  for (size_t t = 0; t < triangleCount; t ++) {
+    const glm::vec3 &p0 = positions[result[t * 3]];
+    const glm::vec3 &p1 = positions[result[t * 3 + 1]];
+    const glm::vec3 &p2 = positions[result[t * 3 + 2]];
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float area = glm::length(normal);
+    if (area > 0.0f) {
+      normal /= area;
+      double d = -glm::dot(normal, p0);
+      for (size_t k = 0; k < 3; k ++) {
+	quadrics[positionOf[result[t * 3 + k]]].addPlane(normal.x, normal.y, normal.z, d, area);
+      }
+    }
+    for (size_t k = 0; k < 3; k ++) {
+      vertexTriangles[result[t * 3 + k]].push_back(t);
+    }
+  }
+
+  std::vector<unsigned int> versions(vertexCount, 0);
+  std::vector<bool> removed(vertexCount, false);
+  std::vector<bool> deadTriangle(triangleCount, false);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse> > heap;
+
+  auto pushCollapse = [&](unsigned int from, unsigned int to) {
+    if (locked[from] || removed[from] || removed[to] || from == to) {
+      return;
+    }
+    Quadric q = quadrics[from];
+    q.add(quadrics[to]);
+    Collapse collapse;
+    collapse.cost = static_cast<float>(fmax(q.evaluate(positions[to]), 0.0));
+    collapse.from = from;
+    collapse.to = to;
+    collapse.version = versions[from] + versions[to];
+    heap.push(collapse);
+  };
+
+  for (std::map<std::pair<unsigned int, unsigned int>, unsigned int>::iterator it = edgeUse.begin();
+       it != edgeUse.end(); ++ it) {
+    pushCollapse(it->first.first, it->first.second);
+    pushCollapse(it->first.second, it->first.first);
+  }
+
+  // quadric costs are squared distances times area
+  float lastError = 0.0f;
+  size_t liveTriangles = triangleCount;
+  std::vector<std::pair<unsigned int, unsigned int> > wedgeTargets;
+  while (!heap.empty() && liveTriangles * 3 > targetIndexCount) {
+    Collapse collapse = heap.top();
+    heap.pop();
+    unsigned int from = collapse.from, to = collapse.to;
+    if (removed[from] || removed[to] || collapse.version != versions[from] + versions[to]) {
+      continue;
+    }
+
+    // pair every wedge of from with a wedge of to across a live edge
+    wedgeTargets.clear();
+    double area = 0.0;
+    bool valid = true;
+    unsigned int wedge = from;
+    do {
+      unsigned int target = ~0u;
+      for (size_t i = 0; i < vertexTriangles[wedge].size(); i ++) {
+	unsigned int t = vertexTriangles[wedge][i];
+	if (deadTriangle[t]) {
+	  continue;
+	}
+	const unsigned int *tri = &result[t * 3];
+	for (size_t k = 0; k < 3 && target == ~0u; k ++) {
+	  if (positionOf[tri[k]] == to) {
+	    target = tri[k];
+	  }
+	}
+	const glm::vec3 &p0 = positions[tri[0]];
+	area += glm::length(glm::cross(positions[tri[1]] - p0, positions[tri[2]] - p0));
+      }
+      if (target == ~0u) {
+	valid = false;
+	break;
+      }
+      wedgeTargets.push_back(std::make_pair(wedge, target));
+      wedge = nextWedge[wedge];
+    } while (wedge != from);
+    if (!valid) {
+      continue;
+    }
+
+    float error = area > 0.0 ? sqrtf(collapse.cost / static_cast<float>(area)) : 0.0f;
+    if (error > maxError) {
+      break;
+    }
+
+    // reject collapses that would flip a surviving triangle
+    bool flips = false;
+    for (size_t w = 0; w < wedgeTargets.size() && !flips; w ++) {
+      unsigned int v = wedgeTargets[w].first;
+      for (size_t i = 0; i < vertexTriangles[v].size() && !flips; i ++) {
+	unsigned int t = vertexTriangles[v][i];
+	if (deadTriangle[t]) {
+	  continue;
+	}
+	const unsigned int *tri = &result[t * 3];
+	if (positionOf[tri[0]] == to || positionOf[tri[1]] == to || positionOf[tri[2]] == to) {
+	  continue;
+	}
+	glm::vec3 p[3], q[3];
+	for (size_t k = 0; k < 3; k ++) {
+	  p[k] = positions[tri[k]];
+	  q[k] = positionOf[tri[k]] == from ? positions[to] : p[k];
+	}
+	glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+	glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+	if (glm::dot(before, after) <= 0.0f) {
+	  flips = true;
+	}
+      }
+    }
+    if (flips) {
+      continue;
+    }
+
+    removed[from] = true;
+    quadrics[to].add(quadrics[from]);
+    versions[to] ++;
+    lastError = error;
+
+    for (size_t w = 0; w < wedgeTargets.size(); w ++) {
+      unsigned int v = wedgeTargets[w].first, target = wedgeTargets[w].second;
+      for (size_t i = 0; i < vertexTriangles[v].size(); i ++) {
+	unsigned int t = vertexTriangles[v][i];
+	if (deadTriangle[t]) {
+	  continue;
+	}
+	unsigned int *tri = &result[t * 3];
+	for (size_t k = 0; k < 3; k ++) {
+	  if (tri[k] == v) {
+	    tri[k] = target;
+	  }
+	}
+	if (positionOf[tri[0]] == positionOf[tri[1]] || positionOf[tri[1]] == positionOf[tri[2]] ||
+	    positionOf[tri[0]] == positionOf[tri[2]]) {
+	  deadTriangle[t] = true;
+	  liveTriangles --;
+	} else {
+	  vertexTriangles[target].push_back(t);
+	}
+      }
+    }
+
+    wedge = to;
+    do {
+      for (size_t i = 0; i < vertexTriangles[wedge].size(); i ++) {
+	unsigned int t = vertexTriangles[wedge][i];
+	if (deadTriangle[t]) {
+	  continue;
+	}
+	for (size_t k = 0; k < 3; k ++) {
+	  unsigned int other = positionOf[result[t * 3 + k]];
+	  if (other != to) {
+	    pushCollapse(other, to);
+	    pushCollapse(to, other);
+	  }
+	}
+      }
+      wedge = nextWedge[wedge];
+    } while (wedge != to);
+  }
+
+  std::vector<unsigned int> compacted;
+  compacted.reserve(liveTriangles * 3);
+  for (size_t t = 0; t < triangleCount; t ++) {
+    if (!deadTriangle[t]) {
+      compacted.insert(compacted.end(), result.begin() + t * 3, result.begin() + t * 3 + 3);
+    }
+  }
+  result.swap(compacted);
+
+  return lastError;
+}
+
+// a level has to drop at least this share of the previous level's triangles
+static const float LOD_MIN_REDUCTION = 0.2f;
+static const size_t LOD_MIN_TRIANGLES = 64;
+
+void generateLods(std::vector<BakedMesh> &meshes, const char *name, bool verbose) {
+  // LODs switch on the size of the whole model, so errors are measured
+  // against it rather than each mesh
+  glm::vec3 minPos(FLT_MAX), maxPos(-FLT_MAX);
+  for (size_t m = 0; m < meshes.size(); m ++) {
+    const std::vector<GLfloat> &vertices = meshes[m].vertices;
+    for (size_t v = 0; v < vertices.size(); v += 8) {
+      glm::vec3 p(vertices[v], vertices[v + 1], vertices[v + 2]);
+      minPos = glm::min(minPos, p);
+      maxPos = glm::max(maxPos, p);
+    }
+  }
+  float diameter = glm::length(maxPos - minPos);
+
+  for (size_t m = 0; m < meshes.size(); m ++) {
+    BakedMesh &mesh = meshes[m];
+    mesh.lodIndexCounts.assign(1, mesh.indices.size());
+    if (mesh.indices.size() / 3 < LOD_MIN_TRIANGLES) {
+      continue;
+    }
+
+    std::vector<unsigned int> previous = mesh.indices;
+    for (size_t level = 1; level < MAX_LOD_LEVELS; level ++) {
+      std::vector<unsigned int> simplified;
+      // one pixel at the largest size this level is drawn at
+      float maxError = diameter / LOD_SCREEN_SIZES[level - 1];
+      simplifyMesh(mesh.vertices, previous, previous.size() / 6 * 3, maxError, simplified);
+      if (simplified.empty() || simplified.size() > previous.size() * (1.0f - LOD_MIN_REDUCTION)) {
+	break;
+      }
+      mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+      mesh.lodIndexCounts.push_back(simplified.size());
+      previous.swap(simplified);
+    }
+  }
+
+  if (!verbose) {
+    return;
+  }
+  // shorter chains keep drawing their last level
+  size_t levelTriangles[MAX_LOD_LEVELS] = {0};
+  for (size_t m = 0; m < meshes.size(); m ++) {
+    const std::vector<unsigned int> &counts = meshes[m].lodIndexCounts;
+    for (size_t level = 0; level < MAX_LOD_LEVELS; level ++) {
+      levelTriangles[level] += counts[level < counts.size() ? level : counts.size() - 1] / 3;
+    }
+  }
+
+  printf("Model (%s) LOD triangles:", name);
+  for (size_t level = 0; level < MAX_LOD_LEVELS; level ++) {
+    printf(" %zu", levelTriangles[level]);
+  }
+  printf("\n");
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "MeshCache.h"
+#include "LodSelector.h"
+
+const unsigned int MAX_LOD_LEVELS = LOD_THRESHOLD_COUNT + 1;
+
+// Quadric error metric edge-collapse simplification (Garland & Heckbert)
+// over the 8-float Mesh layout. Vertices only ever collapse onto other
+// existing vertices, so the result is a new index list into the same
+// vertex buffer. Open borders are never moved and uv/normal seams only
+// shorten along themselves.
+//
+// Stops at targetIndexCount indices or once the cheapest collapse costs
+// more than maxError (a distance, in mesh units). Returns the error of the
+// last collapse made.
+float simplifyMesh(const std::vector<GLfloat> &vertices, const std::vector<unsigned int> &indices,
+		   size_t targetIndexCount, float maxError, std::vector<unsigned int> &result);
+
+// Appends up to MAX_LOD_LEVELS - 1 coarser index lists to every mesh,
+// each aiming at half the triangles of the level before it. A chain stops
+// early once a level no longer saves enough to be worth a switch. With
+// verbose the triangle count of every level is printed.
+void generateLods(std::vector<BakedMesh> &meshes, const char *name, bool verbose = false);
@@ -1,49 +1,217 @@
 #include "Model.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+
+#include <float.h>
+#include <thread>
+#include <utility>
+
+// Meshes somewhat over the 16-bit limit draw cheaper as a few 16-bit
+// parts; past this the extra draws and duplicated seam vertices stop
+// paying for the halved index bandwidth
+static const unsigned int MAX_SPLIT_VERTICES = MAX_SHORT_INDEX_VERTICES * 4;
+
+// Greedily cuts a triangle list into parts of at most
+// MAX_SHORT_INDEX_VERTICES vertices each, keeping triangle order
+static void splitMesh(const GLfloat *vertices, const unsigned int *indices,
+		      unsigned int vertexCount, unsigned int indexCount, std::vector<BakedMesh> &parts) {
+  std::vector<unsigned int> remap(vertexCount, ~0u);
+  std::vector<unsigned int> used;
+  BakedMesh *part = nullptr;
+
+  for (size_t i = 0; i + 2 < indexCount; i += 3) {
+    unsigned int newVertices = 0;
+    for (size_t k = 0; k < 3; k ++) {
+      if (remap[indices[i + k]] == ~0u) {
+	newVertices ++;
+      }
+    }
+    if (!part || part->vertices.size() / 8 + newVertices > MAX_SHORT_INDEX_VERTICES) {
+      for (size_t j = 0; j < used.size(); j ++) {
+	remap[used[j]] = ~0u;
+      }
+      used.clear();
+      parts.push_back(BakedMesh());
+      part = &parts.back();
+      part->materialIndex = 0;
+    }
+
+    for (size_t k = 0; k < 3; k ++) {
+      unsigned int v = indices[i + k];
+      if (remap[v] == ~0u) {
+	remap[v] = part->vertices.size() / 8;
+	used.push_back(v);
+	part->vertices.insert(part->vertices.end(), vertices + v * 8, vertices + v * 8 + 8);
+      }
+      part->indices.push_back(remap[v]);
+    }
+  }
+}
+
+// Drops meshes without a whole triangle, such as an Assimp mesh with no
+// faces or an OBJ usemtl group nothing was drawn with
+static void dropEmptyMeshes(std::vector<BakedMesh> &meshes) {
+  size_t kept = 0;
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    if (meshes[i].indices.size() >= 3 && !meshes[i].vertices.empty()) {
+      if (kept != i) {
+	meshes[kept] = std::move(meshes[i]);
+      }
+      kept ++;
+    }
+  }
+  meshes.resize(kept);
+}
+
+// Splits every mesh in the range above before the bake so LODs and the
+// vertex order are generated per part
+static void splitMeshes(std::vector<BakedMesh> &meshes) {
+  std::vector<BakedMesh> result;
+  for (size_t i = 0; i < meshes.size(); i ++) {
+    unsigned int vertexCount = meshes[i].vertices.size() / 8;
+    if (vertexCount <= MAX_SHORT_INDEX_VERTICES || vertexCount > MAX_SPLIT_VERTICES) {
+      result.push_back(std::move(meshes[i]));
+      continue;
+    }
+    std::vector<BakedMesh> parts;
+    splitMesh(&meshes[i].vertices[0], &meshes[i].indices[0], vertexCount, meshes[i].indices.size(), parts);
+    for (size_t j = 0; j < parts.size(); j ++) {
+      parts[j].materialIndex = meshes[i].materialIndex;
+      result.push_back(std::move(parts[j]));
+    }
+  }
+  meshes.swap(result);
+}
 
 Model::Model() {
-  
+  textureCache = nullptr;
+  lodCount = 1;
+  boundsMin = glm::vec3(FLT_MAX);
+  boundsMax = glm::vec3(-FLT_MAX);
+  boundsCenter = glm::vec3(0.0f);
+  boundsRadius = 0.0f;
+  rayQueries = false;
+  verbose = false;
+}
+
+unsigned int Model::selectLod(LodSelector &selector, const glm::mat4 &model, const glm::vec3 &eye, float projectionScale) {
+  glm::vec3 center = glm::vec3(model * glm::vec4(boundsCenter, 1.0f));
+  float scale = glm::max(glm::length(glm::vec3(model[0])),
+			 glm::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+  float radius = boundsRadius * scale;
+  float distance = glm::length(center - eye);
+  float screenSize = distance > radius ? 2.0f * radius * projectionScale / distance : FLT_MAX;
+  return selector.select(screenSize, lodCount);
 }
 
-void Model::renderModel() {
+void Model::renderModel(unsigned int lod) {
   for (size_t i = 0; i < meshList.size(); i ++) {
     unsigned int materialIndex = meshToTex[i];
     if (materialIndex < textureList.size() && textureList[materialIndex]) {
       textureList[materialIndex]->useTexture();
     }
-    meshList[i]->renderMesh();
+    meshList[i]->renderMesh(lod);
+  }
+}
+
+void Model::submit(RenderQueue &queue, RenderPass pass, Shader *shader, Material *material,
+		   const glm::mat4 &transform, float depth, unsigned int lod) {
+  bool shading = pass != RENDER_PASS_SHADOW;
+  for (size_t i = 0; i < meshList.size(); i ++) {
+    DrawItem &item = queue.submit(pass, shader, transform, depth);
+    unsigned int materialIndex = meshToTex[i];
+    if (shading && materialIndex < textureList.size()) {
+      item.texture = textureList[materialIndex];
+    }
+    item.material = shading ? material : nullptr;
+    item.mesh = meshList[i];
+    item.lod = lod;
   }
 }
 
-void Model::loadModel(const std::string &fileName) {
-  Assimp::Importer importer;
-  const aiScene *scene = importer.ReadFile(fileName,
-					   aiProcess_Triangulate |
-					   aiProcess_FlipUVs |
-					   aiProcess_GenSmoothNormals |
-					   aiProcess_JoinIdenticalVertices);
-  if (!scene) {
-    printf("Model (%s) failed to load: %s", fileName.c_str(), importer.GetErrorString());
+void Model::loadModel(const std::string &fileName, ModelImporter importer) {
+  unsigned int importFlags = aiProcess_Triangulate |
+    aiProcess_FlipUVs |
+    aiProcess_GenSmoothNormals |
+    aiProcess_JoinIdenticalVertices;
+
+  MeshCache cache;
+  if (cache.open(fileName, importFlags, importer)) {
+    for (size_t i = 0; i < cache.getMeshCount(); i ++) {
+      // caches written before empty meshes were dropped may still hold some
+      if (cache.getIndexCount(i) < 3 || cache.getVertexCount(i) == 0) {
+	continue;
+      }
+      addMesh(cache.getVertices(i), cache.getIndices(i),
+	      cache.getVertexCount(i), cache.getIndexCount(i), cache.getMaterialIndex(i),
+	      cache.getLodIndexCounts(i), cache.getLodCount(i));
+    }
+    updateBounds();
+    // the BVHs read straight from the mapped cache
+    buildBvhs();
+    std::vector<std::string> texturePaths(cache.getMaterialCount());
+    for (size_t i = 0; i < texturePaths.size(); i ++) {
+      texturePaths[i] = cache.getTexturePath(i);
+    }
+    cache.close();
+    addTextures(texturePaths);
     return;
   }
 
-  loadNode(scene->mRootNode, scene);
-  loadMaterials(scene);
+  std::vector<BakedMesh> bakedMeshes;
+  std::vector<std::string> texturePaths;
+  if (importer == IMPORTER_NATIVE_OBJ) {
+    ObjLoader loader;
+    if (!loader.load(fileName, bakedMeshes, texturePaths)) {
+      printf("Model (%s) failed to load\n", fileName.c_str());
+      return;
+    }
+  } else {
+    Assimp::Importer assimpImporter;
+    const aiScene *scene = assimpImporter.ReadFile(fileName, importFlags);
+    if (!scene) {
+      printf("Model (%s) failed to load: %s", fileName.c_str(), assimpImporter.GetErrorString());
+      return;
+    }
+    loadNode(scene->mRootNode, scene, bakedMeshes);
+    loadMaterials(scene, texturePaths);
+  }
+
+  dropEmptyMeshes(bakedMeshes);
+  splitMeshes(bakedMeshes);
+  generateLods(bakedMeshes, fileName.c_str(), verbose);
+  optimizeMeshes(bakedMeshes, fileName.c_str(), verbose);
+  cache.write(bakedMeshes, texturePaths);
+
+  for (size_t i = 0; i < bakedMeshes.size(); i ++) {
+    const BakedMesh &baked = bakedMeshes[i];
+    addMesh(&baked.vertices[0], &baked.indices[0],
+	    baked.vertices.size() / 8, baked.indices.size(), baked.materialIndex,
+	    &baked.lodIndexCounts[0], baked.lodIndexCounts.size());
+  }
+  updateBounds();
+  buildBvhs();
+  addTextures(texturePaths);
 }
 
-void Model::loadNode(aiNode *node, const aiScene *scene) {
+void Model::loadNode(aiNode *node, const aiScene *scene, std::vector<BakedMesh> &bakedMeshes) {
   for (size_t i = 0; i < node->mNumMeshes; i ++) {
-    loadMesh(scene->mMeshes[node->mMeshes[i]], scene);
+    loadMesh(scene->mMeshes[node->mMeshes[i]], scene, bakedMeshes);
   }
 
   for (size_t i = 0; i < node->mNumChildren; i ++) {
-    loadNode(node->mChildren[i], scene);
+    loadNode(node->mChildren[i], scene, bakedMeshes);
   }
 }
 
-void Model::loadMesh(aiMesh *mesh, const aiScene *scene) {
-  std::vector<GLfloat> vertices;
-  std::vector<unsigned int> indices;
+void Model::loadMesh(aiMesh *mesh, const aiScene *scene, std::vector<BakedMesh> &bakedMeshes) {
+  bakedMeshes.push_back(BakedMesh());
+  BakedMesh &baked = bakedMeshes.back();
+  std::vector<GLfloat> &vertices = baked.vertices;
+  std::vector<unsigned int> &indices = baked.indices;
 
+  vertices.reserve(mesh->mNumVertices * 8);
   for (size_t i = 0; i < mesh->mNumVertices; i ++) {
     vertices.insert(vertices.end(), {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z});
     if (mesh->mTextureCoords[0]) {
@@ -60,31 +228,152 @@ void Model::loadMesh(aiMesh *mesh, const aiScene *scene) {
       indices.push_back(face.mIndices[j]);
     }
   }
-  Mesh *newMesh = new Mesh();
-  newMesh->createMesh(&vertices[0], &indices[0], vertices.size(), indices.size());
-  meshList.push_back(newMesh);
-  meshToTex.push_back(mesh->mMaterialIndex);
+  baked.materialIndex = mesh->mMaterialIndex;
 }
 
-void Model::loadMaterials(const aiScene *scene) {
-  textureList.resize(scene->mNumMaterials);
+void Model::loadMaterials(const aiScene *scene, std::vector<std::string> &texturePaths) {
+  texturePaths.resize(scene->mNumMaterials);
   for (size_t i = 0; i < scene->mNumMaterials; i ++) {
     aiMaterial *material = scene->mMaterials[i];
-    textureList[i] = nullptr;
     if (material->GetTextureCount(aiTextureType_DIFFUSE)) {
       aiString path;
       if (material->GetTexture(aiTextureType_DIFFUSE, 0, &path) == AI_SUCCESS) {
 	int idx = std::string(path.data).rfind("\\");
 	std::string filename = std::string(path.data).substr(idx + 1);
-	std::string texPath = std::string("textures/") + filename;
-	textureList[i] = new Texture(texPath.c_str());
-	bool flag = textureList[i]->loadTexture();
-
-	if (!flag) {
-	  printf("failed to load texture at: \"%s\"\n", texPath.c_str());
-	  delete textureList[i];
-	  textureList[i] = nullptr;
-	}
+	texturePaths[i] = std::string("textures/") + filename;
+      }
+    }
+  }
+}
+
+void Model::addMesh(const GLfloat *vertices, const unsigned int *indices,
+		    unsigned int vertexCount, unsigned int indexCount, unsigned int materialIndex,
+		    const unsigned int *lodIndexCounts, unsigned int lodLevels) {
+  Mesh *newMesh = new Mesh();
+  newMesh->createMesh(vertices, indices, vertexCount * 8, indexCount,
+		      chooseVertexFormat(vertices, vertexCount));
+  newMesh->setLodLevels(lodIndexCounts, lodLevels);
+  meshList.push_back(newMesh);
+  meshToTex.push_back(materialIndex);
+
+  if (rayQueries) {
+    BvhJob job;
+    job.vertices = vertices;
+    job.indices = indices;
+    job.indexCount = lodLevels > 0 ? lodIndexCounts[0] : indexCount;
+    bvhJobs.push_back(job);
+  }
+
+  // meshes with a shorter chain keep drawing their last level
+  lodCount = lodLevels > lodCount ? lodLevels : lodCount;
+  boundsMin = glm::min(boundsMin, newMesh->getBoundsMin());
+  boundsMax = glm::max(boundsMax, newMesh->getBoundsMax());
+}
+
+void Model::updateBounds() {
+  if (boundsMin.x > boundsMax.x) {
+    return;
+  }
+  boundsCenter = (boundsMin + boundsMax) * 0.5f;
+  // smallest sphere around the box's centre that holds every mesh's sphere
+  boundsRadius = 0.0f;
+  for (size_t i = 0; i < meshList.size(); i ++) {
+    float reach = glm::length(meshList[i]->getBoundsCenter() - boundsCenter) + meshList[i]->getBoundsRadius();
+    boundsRadius = glm::max(boundsRadius, reach);
+  }
+  boundsRadius = glm::min(boundsRadius, glm::length(boundsMax - boundsMin) * 0.5f);
+}
+
+// Submeshes build independently, so each gets its own task
+void Model::buildBvhs() {
+  if (bvhJobs.empty()) {
+    return;
+  }
+  size_t first = bvhList.size();
+  for (size_t i = 0; i < bvhJobs.size(); i ++) {
+    bvhList.push_back(new TriangleBvh());
+  }
+
+  unsigned int threadCount = std::thread::hardware_concurrency();
+  threadCount = threadCount > 0 ? threadCount : 1;
+  threadCount = threadCount < bvhJobs.size() ? threadCount : bvhJobs.size();
+  if (threadCount > 1) {
+    ThreadPool pool;
+    pool.init(threadCount);
+    for (size_t i = 0; i < bvhJobs.size(); i ++) {
+      TriangleBvh *bvh = bvhList[first + i];
+      BvhJob job = bvhJobs[i];
+      pool.addTask([bvh, job] {bvh->build(job.vertices, 8, job.indices, job.indexCount);});
+    }
+    pool.waitIdle();
+    pool.shutdown();
+  } else {
+    for (size_t i = 0; i < bvhJobs.size(); i ++) {
+      bvhList[first + i]->build(bvhJobs[i].vertices, 8, bvhJobs[i].indices, bvhJobs[i].indexCount);
+    }
+  }
+  bvhJobs.clear();
+}
+
+bool Model::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) {
+  bool found = false;
+  for (size_t i = 0; i < bvhList.size(); i ++) {
+    // each later mesh only has to beat the closest hit so far
+    if (bvhList[i]->intersect(origin, direction, maxDistance, hit)) {
+      maxDistance = hit.distance;
+      hit.mesh = i;
+      found = true;
+    }
+  }
+  return found;
+}
+
+bool Model::occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) {
+  for (size_t i = 0; i < bvhList.size(); i ++) {
+    if (bvhList[i]->occluded(origin, direction, maxDistance)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// an affine transform keeps ray parameters, so distances carry over
+bool Model::raycast(const glm::mat4 &transform, const glm::vec3 &origin, const glm::vec3 &direction,
+		    float maxDistance, RayHit &hit) {
+  glm::mat4 inverse = glm::inverse(transform);
+  return raycast(glm::vec3(inverse * glm::vec4(origin, 1.0f)), glm::vec3(inverse * glm::vec4(direction, 0.0f)),
+		 maxDistance, hit);
+}
+
+bool Model::occluded(const glm::mat4 &transform, const glm::vec3 &origin, const glm::vec3 &direction,
+		     float maxDistance) {
+  glm::mat4 inverse = glm::inverse(transform);
+  return occluded(glm::vec3(inverse * glm::vec4(origin, 1.0f)), glm::vec3(inverse * glm::vec4(direction, 0.0f)),
+		  maxDistance);
+}
+
+void Model::addTextures(const std::vector<std::string> &texturePaths) {
+  textureList.resize(texturePaths.size());
+  for (size_t i = 0; i < texturePaths.size(); i ++) {
+    textureList[i] = nullptr;
+    if (textureCache) {
+      if (!texturePaths[i].empty()) {
+	textureList[i] = textureCache->acquire(texturePaths[i], false);
+      }
+      if (!textureList[i]) {
+	textureList[i] = textureCache->acquire("textures/plain.png", true);
+      }
+      continue;
+    }
+
+    if (!texturePaths[i].empty()) {
+      textureList[i] = new Texture(texturePaths[i].c_str());
+      bool flag = textureList[i]->loadTexture();
+
+      if (!flag) {
+	printf("failed to load texture at: \"%s\"\n", texturePaths[i].c_str());
+	delete textureList[i];
+	textureList[i] = nullptr;
       }
     }
 
@@ -104,10 +393,24 @@ void Model::clearModel() {
   }
   for (size_t i = 0; i < textureList.size(); i ++) {
     if (textureList[i]) {
-      delete textureList[i];
+      if (textureCache) {
+	textureCache->release(textureList[i]);
+      } else {
+	delete textureList[i];
+      }
       textureList[i] = nullptr;
     }
   }
+  for (size_t i = 0; i < bvhList.size(); i ++) {
+    delete bvhList[i];
+  }
+  bvhList.clear();
+  bvhJobs.clear();
+  lodCount = 1;
+  boundsMin = glm::vec3(FLT_MAX);
+  boundsMax = glm::vec3(-FLT_MAX);
+  boundsCenter = glm::vec3(0.0f);
+  boundsRadius = 0.0f;
 }
 
 Model::~Model() {
@@ -7,26 +7,92 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
+#include <glm/glm.hpp>
+
 #include "Mesh.h"
 #include "Texture.h"
+#include "TextureCache.h"
+#include "MeshCache.h"
+#include "ObjLoader.h"
+#include "LodSelector.h"
+#include "RenderQueue.h"
+#include "TriangleBvh.h"
+
+enum ModelImporter {
+  IMPORTER_ASSIMP,
+  IMPORTER_NATIVE_OBJ
+};
 
 class Model {
 public:
   Model();
 
-  void loadModel(const std::string &fileName);
-  void renderModel();
+  void loadModel(const std::string &fileName, ModelImporter importer = IMPORTER_ASSIMP);
+  void renderModel(unsigned int lod = 0);
+  // one item per submesh, each with its own texture outside the shadow pass
+  void submit(RenderQueue &queue, RenderPass pass, Shader *shader, Material *material,
+	      const glm::mat4 &transform, float depth, unsigned int lod = 0);
   void clearModel();
+  void setTextureCache(TextureCache *cache) {textureCache = cache;}
+  // print LOD and vertex cache stats when a load has to bake
+  void setVerbose(bool enabled) {verbose = enabled;}
+
+  // projectionScale is viewport height / (2 * tan(fovy / 2)), which turns
+  // a size over a distance into pixels
+  unsigned int selectLod(LodSelector &selector, const glm::mat4 &model, const glm::vec3 &eye, float projectionScale);
+  unsigned int getLodCount() {return lodCount;}
+  // model space box and sphere around every mesh
+  glm::vec3 getBoundsMin() {return boundsMin;}
+  glm::vec3 getBoundsMax() {return boundsMax;}
+  glm::vec3 getBoundsCenter() {return boundsCenter;}
+  float getBoundsRadius() {return boundsRadius;}
+
+  // keep a triangle BVH per submesh, built from LOD 0 on load; has to be
+  // set before loadModel
+  void setRayQueries(bool enabled) {rayQueries = enabled;}
+  // model space; hit.mesh is the submesh index
+  bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit);
+  bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance);
+  // world space rays against the model drawn with transform; distances
+  // stay in units of the world space direction
+  bool raycast(const glm::mat4 &transform, const glm::vec3 &origin, const glm::vec3 &direction,
+	       float maxDistance, RayHit &hit);
+  bool occluded(const glm::mat4 &transform, const glm::vec3 &origin, const glm::vec3 &direction,
+		float maxDistance);
   
   ~Model();
 
 private:
-  void loadNode(aiNode *node, const aiScene *scene);
-  void loadMesh(aiMesh *mesh, const aiScene *scene);
-  void loadMaterials(const aiScene *scene);
+  void loadNode(aiNode *node, const aiScene *scene, std::vector<BakedMesh> &bakedMeshes);
+  void loadMesh(aiMesh *mesh, const aiScene *scene, std::vector<BakedMesh> &bakedMeshes);
+  void loadMaterials(const aiScene *scene, std::vector<std::string> &texturePaths);
+  void addMesh(const GLfloat *vertices, const unsigned int *indices,
+	       unsigned int vertexCount, unsigned int indexCount, unsigned int materialIndex,
+	       const unsigned int *lodIndexCounts, unsigned int lodLevels);
+  void updateBounds();
+  void buildBvhs();
+  void addTextures(const std::vector<std::string> &texturePaths);
     
   std::vector<Mesh*> meshList;
   std::vector<Texture*> textureList;
   std::vector<unsigned int> meshToTex;
+
+  // source data for BVHs still to build, valid until the load returns
+  struct BvhJob {
+    const GLfloat *vertices;
+    const unsigned int *indices;
+    unsigned int indexCount;
+  };
+  bool rayQueries;
+  std::vector<TriangleBvh*> bvhList;
+  std::vector<BvhJob> bvhJobs;
+
+  unsigned int lodCount;
+  glm::vec3 boundsMin, boundsMax;
+  glm::vec3 boundsCenter;
+  float boundsRadius;
+
+  TextureCache *textureCache;
+  bool verbose;
 };
 
@@ -0,0 +1,69 @@
+#include "NormalMatrix.h"
+
+#include <math.h>
+
+// relative tolerance for treating column lengths as equal and columns as
+// orthogonal
+static const float UNIFORM_SCALE_EPSILON = 1e-4f;
+
+// & rather than && so every test is evaluated and nothing branches
+static inline bool uniformScale(const glm::vec3 &x, const glm::vec3 &y, const glm::vec3 &z, float scale2) {
+  float tolerance = UNIFORM_SCALE_EPSILON * scale2;
+  return (scale2 > 0.0f) &
+    (fabsf(glm::dot(y, y) - scale2) <= tolerance) &
+    (fabsf(glm::dot(z, z) - scale2) <= tolerance) &
+    (fabsf(glm::dot(x, y)) <= tolerance) &
+    (fabsf(glm::dot(x, z)) <= tolerance) &
+    (fabsf(glm::dot(y, z)) <= tolerance);
+}
+
+// matrices the batch call sorts into uniform and other before computing
+// any cofactors
+static const size_t BATCH_CHUNK = 256;
+
+static inline glm::mat3 uniformNormalMatrix(const glm::vec3 &x, const glm::vec3 &y, const glm::vec3 &z,
+					    float scale2) {
+  float inverseScale2 = scale2 > 0.0f ? 1.0f / scale2 : 0.0f;
+  return glm::mat3(x * inverseScale2, y * inverseScale2, z * inverseScale2);
+}
+
+// the inverse transpose is the cofactor matrix over the determinant
+static inline glm::mat3 cofactorNormalMatrix(const glm::vec3 &x, const glm::vec3 &y, const glm::vec3 &z) {
+  glm::vec3 cx = glm::cross(y, z);
+  glm::vec3 cy = glm::cross(z, x);
+  glm::vec3 cz = glm::cross(x, y);
+  float determinant = glm::dot(x, cx);
+  float inverseDeterminant = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+  return glm::mat3(cx * inverseDeterminant, cy * inverseDeterminant, cz * inverseDeterminant);
+}
+
+glm::mat3 normalMatrix(const glm::mat4 &model) {
+  glm::vec3 x(model[0]), y(model[1]), z(model[2]);
+  float scale2 = glm::dot(x, x);
+  if (uniformScale(x, y, z, scale2)) {
+    return uniformNormalMatrix(x, y, z, scale2);
+  }
+  return cofactorNormalMatrix(x, y, z);
+}
+
+// Per chunk, the first loop writes the uniform scale result for every
+// matrix and appends the index of each one that isn't uniform without
+// branching; only those then get the cofactors
+void normalMatrices(const glm::mat4 *models, glm::mat3 *normals, size_t count) {
+  size_t others[BATCH_CHUNK];
+  for (size_t first = 0; first < count; first += BATCH_CHUNK) {
+    size_t end = first + BATCH_CHUNK < count ? first + BATCH_CHUNK : count;
+    size_t otherCount = 0;
+    for (size_t i = first; i < end; i ++) {
+      glm::vec3 x(models[i][0]), y(models[i][1]), z(models[i][2]);
+      float scale2 = glm::dot(x, x);
+      normals[i] = uniformNormalMatrix(x, y, z, scale2);
+      others[otherCount] = i;
+      otherCount += !uniformScale(x, y, z, scale2);
+    }
+    for (size_t j = 0; j < otherCount; j ++) {
+      const glm::mat4 &model = models[others[j]];
+      normals[others[j]] = cofactorNormalMatrix(glm::vec3(model[0]), glm::vec3(model[1]), glm::vec3(model[2]));
+    }
+  }
+}
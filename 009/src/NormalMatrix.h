@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <glm/glm.hpp>
+
+// Normal matrices (inverse transpose of the upper 3x3) computed once per
+// object on the CPU, so the vertex shader doesn't invert per vertex.
+// Rotation with uniform scale is its own normal matrix up to a factor
+// of 1 / scale^2 and skips the inverse.
+glm::mat3 normalMatrix(const glm::mat4 &model);
+// Same results; the batch tests every matrix for uniform scale first and
+// computes the inverse only for the ones that aren't
+void normalMatrices(const glm::mat4 *models, glm::mat3 *normals, size_t count);
@@ -0,0 +1,521 @@
+#include "ObjLoader.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+#include "MappedFile.h"
+
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+static const double POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+  1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool isBlank(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static inline bool isLineEnd(char c) {
+  return c == '\n' || c == '\r';
+}
+
+static inline const char *skipBlanks(const char *p, const char *end) {
+  while (p < end && isBlank(*p)) {
+    p ++;
+  }
+  return p;
+}
+
+static inline const char *skipLine(const char *p, const char *end) {
+  const char *next = static_cast<const char*>(memchr(p, '\n', end - p));
+  return next ? next + 1 : end;
+}
+
+// Plain decimal/exponent parser; much faster than strtof and exact enough
+// for vertex data.
+static const char *parseFloat(const char *p, const char *end, GLfloat &value) {
+  p = skipBlanks(p, end);
+
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p ++;
+  }
+
+  double mantissa = 0.0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    mantissa = mantissa * 10.0 + (*p - '0');
+    p ++;
+  }
+
+  int exponent = 0;
+  if (p < end && *p == '.') {
+    p ++;
+    while (p < end && *p >= '0' && *p <= '9') {
+      mantissa = mantissa * 10.0 + (*p - '0');
+      exponent --;
+      p ++;
+    }
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    p ++;
+    bool negativeExponent = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negativeExponent = (*p == '-');
+      p ++;
+    }
+    int e = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+      e = e * 10 + (*p - '0');
+      p ++;
+    }
+    exponent += negativeExponent ? -e : e;
+  }
+
+  while (exponent > 22) {
+    mantissa *= 1e22;
+    exponent -= 22;
+  }
+  while (exponent < -22) {
+    mantissa /= 1e22;
+    exponent += 22;
+  }
+  if (exponent >= 0) {
+    mantissa *= POWERS_OF_TEN[exponent];
+  } else {
+    mantissa /= POWERS_OF_TEN[-exponent];
+  }
+
+  value = static_cast<GLfloat>(negative ? -mantissa : mantissa);
+  return p;
+}
+
+static const char *parseInt(const char *p, const char *end, int &value) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p ++;
+  }
+  int result = 0;
+  while (p < end && *p >= '0' && *p <= '9') {
+    result = result * 10 + (*p - '0');
+    p ++;
+  }
+  value = negative ? -result : result;
+  return p;
+}
+
+// OBJ indices are 1-based, negative values count back from the current end
+static inline int resolveIndex(int index, unsigned int count) {
+  if (index > 0) {
+    return index - 1;
+  }
+  if (index < 0) {
+    return static_cast<int>(count) + index;
+  }
+  return -1;
+}
+
+static std::string restOfLine(const char *p, const char *end) {
+  p = skipBlanks(p, end);
+  const char *lineEnd = p;
+  while (lineEnd < end && !isLineEnd(*lineEnd)) {
+    lineEnd ++;
+  }
+  while (lineEnd > p && isBlank(lineEnd[-1])) {
+    lineEnd --;
+  }
+  return std::string(p, lineEnd);
+}
+
+ObjLoader::ObjLoader() {
+  
+}
+
+bool ObjLoader::load(const std::string &fileName, std::vector<BakedMesh> &meshes,
+		     std::vector<std::string> &texturePaths) {
+  MappedFile file;
+  if (!file.open(fileName.c_str())) {
+    printf("Failed to open: \"%s\"\n", fileName.c_str());
+    return false;
+  }
+  const char *data = reinterpret_cast<const char*>(file.getData());
+  size_t size = file.getSize();
+
+  unsigned int threadCount = std::thread::hardware_concurrency();
+  if (threadCount == 0) {
+    threadCount = 1;
+  }
+  unsigned int chunkCount = size / MIN_CHUNK_SIZE + 1;
+  if (chunkCount > threadCount) {
+    chunkCount = threadCount;
+  }
+  splitChunks(data, size, chunkCount);
+
+  // first pass only counts attributes so every chunk knows where its
+  // vertices land in the shared arrays
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    workers.push_back(std::thread(&ObjLoader::countChunk, this, std::ref(chunks[i])));
+  }
+  for (size_t i = 0; i < workers.size(); i ++) {
+    workers[i].join();
+  }
+  workers.clear();
+
+  unsigned int positionTotal = 0, texCoordTotal = 0, normalTotal = 0;
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    chunks[i].positionBase = positionTotal;
+    chunks[i].texCoordBase = texCoordTotal;
+    chunks[i].normalBase = normalTotal;
+    positionTotal += chunks[i].positionCount;
+    texCoordTotal += chunks[i].texCoordCount;
+    normalTotal += chunks[i].normalCount;
+  }
+  positions.resize(positionTotal * 3);
+  texCoords.resize(texCoordTotal * 2);
+  normals.resize(normalTotal * 3);
+
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    workers.push_back(std::thread(&ObjLoader::parseChunk, this, std::ref(chunks[i])));
+  }
+  for (size_t i = 0; i < workers.size(); i ++) {
+    workers[i].join();
+  }
+  workers.clear();
+
+  bool missingNormals = false;
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    missingNormals = missingNormals || chunks[i].missingNormals;
+  }
+  if (missingNormals) {
+    generateSmoothNormals();
+  }
+
+  std::vector<std::string> names;
+  texturePaths.clear();
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    for (size_t j = 0; j < chunks[i].libraries.size(); j ++) {
+      size_t slash = fileName.find_last_of("/\\");
+      std::string directory = slash == std::string::npos ? "" : fileName.substr(0, slash + 1);
+      loadMaterials(directory + chunks[i].libraries[j], names, texturePaths);
+    }
+  }
+  std::unordered_map<std::string, unsigned int> materialIndices;
+  for (size_t i = 0; i < names.size(); i ++) {
+    materialIndices[names[i]] = i;
+  }
+
+  // faces before any usemtl, or naming an unknown material, get a default
+  // material appended after the ones from the library
+  unsigned int defaultMaterial = names.size();
+  std::vector<std::vector<const Corner*> > groups(names.size() + 1);
+  unsigned int currentMaterial = defaultMaterial;
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    const Chunk &chunk = chunks[i];
+    size_t triangleCount = chunk.corners.size() / 3;
+    size_t run = 0;
+    for (size_t t = 0; t < triangleCount; t ++) {
+      while (run < chunk.runs.size() && chunk.runs[run].firstTriangle == t) {
+	auto found = materialIndices.find(chunk.runs[run].name);
+	currentMaterial = found == materialIndices.end() ? defaultMaterial : found->second;
+	run ++;
+      }
+      groups[currentMaterial].push_back(&chunk.corners[t * 3]);
+    }
+    while (run < chunk.runs.size()) {
+      auto found = materialIndices.find(chunk.runs[run].name);
+      currentMaterial = found == materialIndices.end() ? defaultMaterial : found->second;
+      run ++;
+    }
+  }
+  if (!groups[defaultMaterial].empty()) {
+    texturePaths.push_back("");
+  }
+
+  meshes.clear();
+  std::vector<const std::vector<const Corner*>*> weldInputs;
+  for (size_t i = 0; i < groups.size(); i ++) {
+    if (!groups[i].empty()) {
+      meshes.push_back(BakedMesh());
+      meshes.back().materialIndex = i;
+      weldInputs.push_back(&groups[i]);
+    }
+  }
+  // no more workers than cores, however many materials there are
+  std::atomic<size_t> nextGroup(0);
+  unsigned int weldThreads = weldInputs.size() < threadCount ? weldInputs.size() : threadCount;
+  for (unsigned int i = 0; i < weldThreads; i ++) {
+    workers.push_back(std::thread(&ObjLoader::weldGroups, this, std::cref(weldInputs), std::ref(meshes),
+				  std::ref(nextGroup)));
+  }
+  for (size_t i = 0; i < workers.size(); i ++) {
+    workers[i].join();
+  }
+
+  chunks.clear();
+  positions.clear();
+  texCoords.clear();
+  normals.clear();
+  smoothNormals.clear();
+
+  return !meshes.empty();
+}
+
+void ObjLoader::weldGroups(const std::vector<const std::vector<const Corner*>*> &groups,
+			   std::vector<BakedMesh> &meshes, std::atomic<size_t> &nextGroup) {
+  for (size_t i = nextGroup ++; i < groups.size(); i = nextGroup ++) {
+    weldGroup(*groups[i], meshes[i]);
+  }
+}
+
+void ObjLoader::splitChunks(const char *data, size_t size, unsigned int chunkCount) {
+  chunks.clear();
+  const char *end = data + size;
+  const char *begin = data;
+  for (unsigned int i = 0; i < chunkCount && begin < end; i ++) {
+    const char *chunkEnd = end;
+    if (i + 1 < chunkCount) {
+      chunkEnd = data + size / chunkCount * (i + 1);
+      chunkEnd = chunkEnd < begin ? begin : chunkEnd;
+      chunkEnd = skipLine(chunkEnd, end);
+    }
+
+    Chunk chunk;
+    chunk.begin = begin;
+    chunk.end = chunkEnd;
+    chunk.positionCount = chunk.texCoordCount = chunk.normalCount = 0;
+    chunk.positionBase = chunk.texCoordBase = chunk.normalBase = 0;
+    chunk.missingNormals = false;
+    chunks.push_back(chunk);
+
+    begin = chunkEnd;
+  }
+}
+
+void ObjLoader::countChunk(Chunk &chunk) {
+  const char *p = chunk.begin;
+  const char *end = chunk.end;
+  while (p < end) {
+    p = skipBlanks(p, end);
+    if (end - p > 1 && p[0] == 'v') {
+      if (isBlank(p[1])) {
+	chunk.positionCount ++;
+      } else if (p[1] == 't') {
+	chunk.texCoordCount ++;
+      } else if (p[1] == 'n') {
+	chunk.normalCount ++;
+      }
+    }
+    p = skipLine(p, end);
+  }
+}
+
+void ObjLoader::parseChunk(Chunk &chunk) {
+  const char *p = chunk.begin;
+  const char *end = chunk.end;
+
+  GLfloat *position = positions.empty() ? nullptr : &positions[chunk.positionBase * 3];
+  GLfloat *texCoord = texCoords.empty() ? nullptr : &texCoords[chunk.texCoordBase * 2];
+  GLfloat *normal = normals.empty() ? nullptr : &normals[chunk.normalBase * 3];
+  unsigned int positionCount = chunk.positionBase;
+  unsigned int texCoordCount = chunk.texCoordBase;
+  unsigned int normalCount = chunk.normalBase;
+
+  std::vector<Corner> polygon;
+  while (p < end) {
+    p = skipBlanks(p, end);
+    if (end - p < 2) {
+      break;
+    }
+
+    if (p[0] == 'v' && isBlank(p[1])) {
+      p = parseFloat(p + 1, end, position[0]);
+      p = parseFloat(p, end, position[1]);
+      p = parseFloat(p, end, position[2]);
+      position += 3;
+      positionCount ++;
+    } else if (p[0] == 'v' && p[1] == 't') {
+      p = parseFloat(p + 2, end, texCoord[0]);
+      p = parseFloat(p, end, texCoord[1]);
+      texCoord += 2;
+      texCoordCount ++;
+    } else if (p[0] == 'v' && p[1] == 'n') {
+      p = parseFloat(p + 2, end, normal[0]);
+      p = parseFloat(p, end, normal[1]);
+      p = parseFloat(p, end, normal[2]);
+      normal += 3;
+      normalCount ++;
+    } else if (p[0] == 'f' && isBlank(p[1])) {
+      polygon.clear();
+      p ++;
+      while (true) {
+	p = skipBlanks(p, end);
+	if (p >= end || isLineEnd(*p)) {
+	  break;
+	}
+	int v = 0, t = 0, n = 0;
+	p = parseInt(p, end, v);
+	if (p < end && *p == '/') {
+	  p ++;
+	  if (p < end && *p != '/') {
+	    p = parseInt(p, end, t);
+	  }
+	  if (p < end && *p == '/') {
+	    p = parseInt(p + 1, end, n);
+	  }
+	}
+	if (v == 0) {
+	  // not an index; skip the garbage token
+	  while (p < end && !isBlank(*p) && !isLineEnd(*p)) {
+	    p ++;
+	  }
+	  continue;
+	}
+	Corner corner;
+	corner.position = resolveIndex(v, positionCount);
+	corner.texCoord = resolveIndex(t, texCoordCount);
+	corner.normal = resolveIndex(n, normalCount);
+	if (corner.position < 0 || corner.position >= static_cast<int>(positions.size() / 3) ||
+	    corner.texCoord >= static_cast<int>(texCoords.size() / 2) ||
+	    corner.normal >= static_cast<int>(normals.size() / 3)) {
+	  polygon.clear();
+	  break;
+	}
+	if (corner.normal < 0) {
+	  chunk.missingNormals = true;
+	}
+	polygon.push_back(corner);
+      }
+      // fan triangulation, same as aiProcess_Triangulate for convex faces
+      for (size_t i = 2; i < polygon.size(); i ++) {
+	chunk.corners.push_back(polygon[0]);
+	chunk.corners.push_back(polygon[i - 1]);
+	chunk.corners.push_back(polygon[i]);
+      }
+    } else if (end - p > 6 && strncmp(p, "usemtl", 6) == 0 && isBlank(p[6])) {
+      MaterialRun run;
+      run.name = restOfLine(p + 6, end);
+      run.firstTriangle = chunk.corners.size() / 3;
+      chunk.runs.push_back(run);
+    } else if (end - p > 6 && strncmp(p, "mtllib", 6) == 0 && isBlank(p[6])) {
+      chunk.libraries.push_back(restOfLine(p + 6, end));
+    }
+
+    p = skipLine(p, end);
+  }
+}
+
+// Area-weighted vertex normals per position, used for faces without "vn"
+void ObjLoader::generateSmoothNormals() {
+  smoothNormals.assign(positions.size(), 0.0f);
+  for (size_t i = 0; i < chunks.size(); i ++) {
+    const std::vector<Corner> &corners = chunks[i].corners;
+    for (size_t c = 0; c + 2 < corners.size(); c += 3) {
+      const GLfloat *p0 = &positions[corners[c + 0].position * 3];
+      const GLfloat *p1 = &positions[corners[c + 1].position * 3];
+      const GLfloat *p2 = &positions[corners[c + 2].position * 3];
+      glm::vec3 faceNormal = glm::cross(glm::vec3(p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]),
+					glm::vec3(p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]));
+      for (size_t k = 0; k < 3; k ++) {
+	GLfloat *target = &smoothNormals[corners[c + k].position * 3];
+	target[0] += faceNormal.x;
+	target[1] += faceNormal.y;
+	target[2] += faceNormal.z;
+      }
+    }
+  }
+  for (size_t i = 0; i < smoothNormals.size(); i += 3) {
+    glm::vec3 n(smoothNormals[i], smoothNormals[i + 1], smoothNormals[i + 2]);
+    GLfloat length = glm::length(n);
+    if (length > 0.0f) {
+      n /= length;
+    }
+    smoothNormals[i] = n.x;
+    smoothNormals[i + 1] = n.y;
+    smoothNormals[i + 2] = n.z;
+  }
+}
+
+// Welds identical (position, uv, normal) triples through an open-addressing
+// hash table and writes the Mesh layout: position, flipped uv, negated normal
+void ObjLoader::weldGroup(const std::vector<const Corner*> &triangles, BakedMesh &mesh) {
+  size_t capacity = 16;
+  while (capacity < triangles.size() * 3 * 2) {
+    capacity <<= 1;
+  }
+  std::vector<Corner> keys(capacity);
+  std::vector<unsigned int> slots(capacity, ~0u);
+
+  mesh.indices.reserve(triangles.size() * 3);
+  mesh.vertices.reserve(triangles.size() * 8);
+
+  for (size_t t = 0; t < triangles.size(); t ++) {
+    for (size_t k = 0; k < 3; k ++) {
+      const Corner &corner = triangles[t][k];
+      unsigned int hash = static_cast<unsigned int>(corner.position) * 73856093u ^
+	static_cast<unsigned int>(corner.texCoord) * 19349663u ^
+	static_cast<unsigned int>(corner.normal) * 83492791u;
+      size_t slot = hash & (capacity - 1);
+      while (slots[slot] != ~0u &&
+	     (keys[slot].position != corner.position ||
+	      keys[slot].texCoord != corner.texCoord ||
+	      keys[slot].normal != corner.normal)) {
+	slot = (slot + 1) & (capacity - 1);
+      }
+
+      if (slots[slot] == ~0u) {
+	keys[slot] = corner;
+	slots[slot] = mesh.vertices.size() / 8;
+
+	const GLfloat *p = &positions[corner.position * 3];
+	mesh.vertices.insert(mesh.vertices.end(), {p[0], p[1], p[2]});
+	if (corner.texCoord >= 0) {
+	  const GLfloat *uv = &texCoords[corner.texCoord * 2];
+	  mesh.vertices.insert(mesh.vertices.end(), {uv[0], 1.0f - uv[1]});
+	} else {
+	  mesh.vertices.insert(mesh.vertices.end(), {0.0f, 0.0f});
+	}
+	const GLfloat *n = corner.normal >= 0 ? &normals[corner.normal * 3] : &smoothNormals[corner.position * 3];
+	mesh.vertices.insert(mesh.vertices.end(), {-n[0], -n[1], -n[2]});
+      }
+      mesh.indices.push_back(slots[slot]);
+    }
+  }
+}
+
+bool ObjLoader::loadMaterials(const std::string &fileName, std::vector<std::string> &names,
+			      std::vector<std::string> &texturePaths) {
+  MappedFile file;
+  if (!file.open(fileName.c_str())) {
+    printf("Failed to open material library: \"%s\"\n", fileName.c_str());
+    return false;
+  }
+
+  const char *p = reinterpret_cast<const char*>(file.getData());
+  const char *end = p + file.getSize();
+  while (p < end) {
+    p = skipBlanks(p, end);
+    if (end - p > 6 && strncmp(p, "newmtl", 6) == 0 && isBlank(p[6])) {
+      names.push_back(restOfLine(p + 6, end));
+      texturePaths.push_back("");
+    } else if (end - p > 6 && strncmp(p, "map_Kd", 6) == 0 && isBlank(p[6]) && !names.empty()) {
+      std::string path = restOfLine(p + 6, end);
+      size_t slash = path.find_last_of("/\\");
+      texturePaths.back() = std::string("textures/") + path.substr(slash == std::string::npos ? 0 : slash + 1);
+    }
+    p = skipLine(p, end);
+  }
+
+  return true;
+}
+
+ObjLoader::~ObjLoader() {
+  
+}
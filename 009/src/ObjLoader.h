@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "MeshCache.h"
+
+// Native Wavefront OBJ/MTL importer. The file is memory-mapped, split into
+// line-aligned chunks that are parsed in parallel, and each material group
+// is welded straight into the Mesh vertex layout without an intermediate
+// scene. The output matches what Model builds from Assimp with
+// Triangulate | FlipUVs | GenSmoothNormals | JoinIdenticalVertices.
+class ObjLoader {
+public:
+  ObjLoader();
+
+  bool load(const std::string &fileName, std::vector<BakedMesh> &meshes,
+	    std::vector<std::string> &texturePaths);
+
+  ~ObjLoader();
+
+private:
+  struct Corner {
+    int position;
+    int texCoord;
+    int normal;
+  };
+
+  struct MaterialRun {
+    std::string name;
+    size_t firstTriangle;
+  };
+
+  struct Chunk {
+    const char *begin;
+    const char *end;
+
+    unsigned int positionCount, texCoordCount, normalCount;
+    unsigned int positionBase, texCoordBase, normalBase;
+
+    std::vector<Corner> corners;
+    std::vector<MaterialRun> runs;
+    std::vector<std::string> libraries;
+    bool missingNormals;
+  };
+
+  std::vector<Chunk> chunks;
+  std::vector<GLfloat> positions;
+  std::vector<GLfloat> texCoords;
+  std::vector<GLfloat> normals;
+  std::vector<GLfloat> smoothNormals;
+
+  void splitChunks(const char *data, size_t size, unsigned int chunkCount);
+  void countChunk(Chunk &chunk);
+  void parseChunk(Chunk &chunk);
+  void generateSmoothNormals();
+  void weldGroup(const std::vector<const Corner*> &triangles, BakedMesh &mesh);
+  // welds groups[i] into meshes[i], taking the next unclaimed group each time
+  void weldGroups(const std::vector<const std::vector<const Corner*>*> &groups, std::vector<BakedMesh> &meshes,
+		  std::atomic<size_t> &nextGroup);
+  bool loadMaterials(const std::string &fileName, std::vector<std::string> &names,
+		     std::vector<std::string> &texturePaths);
+};
@@ -0,0 +1,375 @@
+#include "OcclusionCuller.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static const unsigned int TILE_SIZE = 32;
+// 32, 16, 8, 4, 2 and 1 texels per tile
+static const unsigned int LEVEL_COUNT = 6;
+// texels per axis a box test may read before moving to a coarser level
+static const unsigned int TEST_TEXELS = 4;
+
+OcclusionCuller::OcclusionCuller() {
+  width = 0;
+  height = 0;
+  tilesX = 0;
+  tilesY = 0;
+  testedCount = 0;
+  occludedCount = 0;
+  threaded = false;
+}
+
+void OcclusionCuller::init(unsigned int bufferWidth, unsigned int bufferHeight, unsigned int threadCount) {
+  tilesX = (bufferWidth + TILE_SIZE - 1) / TILE_SIZE;
+  tilesY = (bufferHeight + TILE_SIZE - 1) / TILE_SIZE;
+  width = tilesX * TILE_SIZE;
+  height = tilesY * TILE_SIZE;
+  tileBins.assign(tilesX * tilesY, std::vector<uint32_t>());
+  levels.resize(LEVEL_COUNT);
+  for (unsigned int level = 0; level < LEVEL_COUNT; level ++) {
+    levels[level].assign((width >> level) * (height >> level), 1.0f);
+  }
+
+  threaded = threadCount != 1;
+  if (threaded) {
+    pool.init(threadCount);
+  }
+}
+
+unsigned int OcclusionCuller::addOccluderMesh(const float *vertices, unsigned int stride, unsigned int vertexCount,
+					      const unsigned int *indices, unsigned int indexCount) {
+  meshes.push_back(OccluderMesh());
+  OccluderMesh &mesh = meshes.back();
+  mesh.positions.resize(vertexCount);
+  for (unsigned int i = 0; i < vertexCount; i ++) {
+    mesh.positions[i] = glm::vec3(vertices[i * stride], vertices[i * stride + 1], vertices[i * stride + 2]);
+  }
+  mesh.indices.assign(indices, indices + indexCount);
+  return meshes.size() - 1;
+}
+
+void OcclusionCuller::beginFrame(const glm::mat4 &frameViewProjection) {
+  viewProjection = frameViewProjection;
+  triangles.clear();
+  for (size_t i = 0; i < tileBins.size(); i ++) {
+    tileBins[i].clear();
+  }
+  testedCount = 0;
+  occludedCount = 0;
+}
+
+void OcclusionCuller::addOccluder(unsigned int mesh, const glm::mat4 &transform) {
+  if (mesh >= meshes.size()) {
+    return;
+  }
+  const OccluderMesh &occluder = meshes[mesh];
+  glm::mat4 toClip = viewProjection * transform;
+  for (size_t i = 0; i + 2 < occluder.indices.size(); i += 3) {
+    glm::vec4 clip[3];
+    for (int corner = 0; corner < 3; corner ++) {
+      clip[corner] = toClip * glm::vec4(occluder.positions[occluder.indices[i + corner]], 1.0f);
+    }
+    clipAndBin(clip);
+  }
+}
+
+// Only the near plane is clipped against; the sides are left to the
+// tile bounds, and depth past the far plane never beats the clear value
+void OcclusionCuller::clipAndBin(const glm::vec4 *clip) {
+  // all three behind one side plane
+  for (int axis = 0; axis < 3; axis ++) {
+    if (clip[0][axis] > clip[0].w && clip[1][axis] > clip[1].w && clip[2][axis] > clip[2].w) {
+      return;
+    }
+    if (axis < 2 && clip[0][axis] < -clip[0].w && clip[1][axis] < -clip[1].w && clip[2][axis] < -clip[2].w) {
+      return;
+    }
+  }
+
+  glm::vec4 polygon[4];
+  int count = 0;
+  for (int i = 0; i < 3; i ++) {
+    const glm::vec4 &a = clip[i];
+    const glm::vec4 &b = clip[(i + 1) % 3];
+    float distanceA = a.z + a.w;
+    float distanceB = b.z + b.w;
+    if (distanceA >= 0.0f) {
+      polygon[count ++] = a;
+    }
+    if ((distanceA >= 0.0f) != (distanceB >= 0.0f)) {
+      polygon[count ++] = a + (b - a) * (distanceA / (distanceA - distanceB));
+    }
+  }
+  if (count < 3) {
+    return;
+  }
+
+  ScreenTriangle screen[2];
+  glm::vec3 projected[4];
+  for (int i = 0; i < count; i ++) {
+    float inverseW = 1.0f / polygon[i].w;
+    projected[i] = glm::vec3((polygon[i].x * inverseW * 0.5f + 0.5f) * width,
+			     (polygon[i].y * inverseW * 0.5f + 0.5f) * height,
+			     polygon[i].z * inverseW * 0.5f + 0.5f);
+  }
+  for (int fan = 0; fan + 2 < count; fan ++) {
+    const glm::vec3 *corners[3] = {&projected[0], &projected[fan + 1], &projected[fan + 2]};
+    for (int corner = 0; corner < 3; corner ++) {
+      screen[fan].x[corner] = corners[corner]->x;
+      screen[fan].y[corner] = corners[corner]->y;
+      screen[fan].z[corner] = corners[corner]->z;
+    }
+    binTriangle(screen[fan]);
+  }
+}
+
+void OcclusionCuller::binTriangle(const ScreenTriangle &triangle) {
+  float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0]) -
+    (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+  if (fabsf(area) < 1e-6f) {
+    return;
+  }
+  float minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+  float maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+  float minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+  float maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+  if (maxX < 0.0f || maxY < 0.0f || minX >= width || minY >= height) {
+    return;
+  }
+  int firstX = std::max(0, (int)minX / (int)TILE_SIZE);
+  int firstY = std::max(0, (int)minY / (int)TILE_SIZE);
+  int lastX = std::min((int)tilesX - 1, (int)std::min(maxX, (float)width - 1.0f) / (int)TILE_SIZE);
+  int lastY = std::min((int)tilesY - 1, (int)std::min(maxY, (float)height - 1.0f) / (int)TILE_SIZE);
+
+  uint32_t index = triangles.size();
+  triangles.push_back(triangle);
+  for (int y = firstY; y <= lastY; y ++) {
+    for (int x = firstX; x <= lastX; x ++) {
+      tileBins[y * tilesX + x].push_back(index);
+    }
+  }
+}
+
+void OcclusionCuller::finish() {
+  if (threaded) {
+    for (unsigned int tile = 0; tile < tileBins.size(); tile ++) {
+      pool.addTask([this, tile] {
+	  rasterizeTile(tile);
+	  reduceTile(tile);
+	});
+    }
+    pool.waitIdle();
+    return;
+  }
+  for (unsigned int tile = 0; tile < tileBins.size(); tile ++) {
+    rasterizeTile(tile);
+    reduceTile(tile);
+  }
+}
+
+// Edge a->b is stepX (p.x - origin.x) + stepY (p.y - origin.y), positive
+// on its left. The endpoints are always taken in the same order and the
+// result negated for the other direction, so the two triangles sharing
+// an edge get exactly opposite values there and no pixel centre on it
+// is missed by both.
+struct EdgeFunction {
+  float stepX, stepY;
+  float originX, originY;
+};
+
+static EdgeFunction makeEdge(float ax, float ay, float bx, float by) {
+  bool flip = ay > by || (ay == by && ax > bx);
+  if (flip) {
+    std::swap(ax, bx);
+    std::swap(ay, by);
+  }
+  EdgeFunction edge;
+  edge.stepX = flip ? by - ay : ay - by;
+  edge.stepY = flip ? ax - bx : bx - ax;
+  edge.originX = ax;
+  edge.originY = ay;
+  return edge;
+}
+
+// Edge functions and depth are planes over the pixel centres, evaluated
+// at every pixel relative to a vertex rather than stepped, so large
+// coordinates keep their precision and the SSE and scalar loops agree
+void OcclusionCuller::rasterizeTile(unsigned int tile) {
+  int tileX = (tile % tilesX) * TILE_SIZE;
+  int tileY = (tile / tilesX) * TILE_SIZE;
+  float *depth = &levels[0][0];
+  for (size_t y = 0; y < TILE_SIZE; y ++) {
+    std::fill(depth + (tileY + y) * width + tileX, depth + (tileY + y) * width + tileX + TILE_SIZE, 1.0f);
+  }
+
+  const std::vector<uint32_t> &bin = tileBins[tile];
+  for (size_t i = 0; i < bin.size(); i ++) {
+    const ScreenTriangle &triangle = triangles[bin[i]];
+    float x0 = triangle.x[0], y0 = triangle.y[0];
+    float x1 = triangle.x[1], y1 = triangle.y[1];
+    float x2 = triangle.x[2], y2 = triangle.y[2];
+    float z0 = triangle.z[0], z1 = triangle.z[1], z2 = triangle.z[2];
+    float area = (x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0);
+    if (area < 0.0f) {
+      // occluders are drawn from both sides
+      std::swap(x1, x2);
+      std::swap(y1, y2);
+      std::swap(z1, z2);
+      area = -area;
+    }
+
+    int minX = std::max(tileX, (int)floorf(std::min(x0, std::min(x1, x2))));
+    int maxX = std::min(tileX + (int)TILE_SIZE - 1, (int)ceilf(std::max(x0, std::max(x1, x2))));
+    int minY = std::max(tileY, (int)floorf(std::min(y0, std::min(y1, y2))));
+    int maxY = std::min(tileY + (int)TILE_SIZE - 1, (int)ceilf(std::max(y0, std::max(y1, y2))));
+    if (minX > maxX || minY > maxY) {
+      continue;
+    }
+    // groups of four start on a multiple of four, which stays in the tile
+    minX &= ~3;
+
+    // the edge opposite a vertex weights that vertex
+    EdgeFunction edge12 = makeEdge(x1, y1, x2, y2);
+    EdgeFunction edge20 = makeEdge(x2, y2, x0, y0);
+    EdgeFunction edge01 = makeEdge(x0, y0, x1, y1);
+    float inverseArea = 1.0f / area;
+    float depthStepX = ((z1 - z0) * (y2 - y0) + (z2 - z0) * (y0 - y1)) * inverseArea;
+    float depthStepY = ((z1 - z0) * (x0 - x2) + (z2 - z0) * (x1 - x0)) * inverseArea;
+
+    for (int y = minY; y <= maxY; y ++) {
+      float py = y + 0.5f;
+      float row12 = edge12.stepY * (py - edge12.originY);
+      float row20 = edge20.stepY * (py - edge20.originY);
+      float row01 = edge01.stepY * (py - edge01.originY);
+      float rowDepth = z0 + depthStepY * (py - y0);
+      float *row = depth + y * width;
+      int x = minX;
+#ifdef __SSE__
+      __m128 px = _mm_add_ps(_mm_set1_ps(x + 0.5f), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+      __m128 four = _mm_set1_ps(4.0f);
+      __m128 zero = _mm_setzero_ps();
+      for (; x <= maxX; x += 4) {
+	__m128 e12 = _mm_add_ps(_mm_set1_ps(row12),
+				_mm_mul_ps(_mm_set1_ps(edge12.stepX), _mm_sub_ps(px, _mm_set1_ps(edge12.originX))));
+	__m128 e20 = _mm_add_ps(_mm_set1_ps(row20),
+				_mm_mul_ps(_mm_set1_ps(edge20.stepX), _mm_sub_ps(px, _mm_set1_ps(edge20.originX))));
+	__m128 e01 = _mm_add_ps(_mm_set1_ps(row01),
+				_mm_mul_ps(_mm_set1_ps(edge01.stepX), _mm_sub_ps(px, _mm_set1_ps(edge01.originX))));
+	__m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e12, zero), _mm_cmpge_ps(e20, zero)),
+				   _mm_cmpge_ps(e01, zero));
+	if (_mm_movemask_ps(inside)) {
+	  __m128 z = _mm_add_ps(_mm_set1_ps(rowDepth),
+				_mm_mul_ps(_mm_set1_ps(depthStepX), _mm_sub_ps(px, _mm_set1_ps(x0))));
+	  __m128 old = _mm_loadu_ps(row + x);
+	  __m128 nearest = _mm_min_ps(old, z);
+	  _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+	}
+	px = _mm_add_ps(px, four);
+      }
+#else
+      for (; x <= maxX; x ++) {
+	float px = x + 0.5f;
+	if (row12 + edge12.stepX * (px - edge12.originX) >= 0.0f &&
+	    row20 + edge20.stepX * (px - edge20.originX) >= 0.0f &&
+	    row01 + edge01.stepX * (px - edge01.originX) >= 0.0f) {
+	  row[x] = std::min(row[x], rowDepth + depthStepX * (px - x0));
+	}
+      }
+#endif
+    }
+  }
+}
+
+// Each texel of a level keeps the farthest of the four below it. A tile
+// reduces to one texel at the last level, so tiles never share texels.
+void OcclusionCuller::reduceTile(unsigned int tile) {
+  unsigned int tileX = (tile % tilesX) * TILE_SIZE;
+  unsigned int tileY = (tile / tilesX) * TILE_SIZE;
+  for (unsigned int level = 1; level < LEVEL_COUNT; level ++) {
+    const float *source = &levels[level - 1][0];
+    float *target = &levels[level][0];
+    unsigned int sourceWidth = width >> (level - 1);
+    unsigned int targetWidth = width >> level;
+    unsigned int size = TILE_SIZE >> level;
+    unsigned int firstX = tileX >> level, firstY = tileY >> level;
+    for (unsigned int y = firstY; y < firstY + size; y ++) {
+      for (unsigned int x = firstX; x < firstX + size; x ++) {
+	const float *quad = source + y * 2 * sourceWidth + x * 2;
+	target[y * targetWidth + x] = std::max(std::max(quad[0], quad[1]),
+					       std::max(quad[sourceWidth], quad[sourceWidth + 1]));
+      }
+    }
+  }
+}
+
+// The box's nearest depth against the farthest occluder depth over its
+// screen rectangle, read from the finest level where that rectangle
+// spans at most TEST_TEXELS texels a side
+bool OcclusionCuller::isVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+  testedCount ++;
+  if (width == 0) {
+    return true;
+  }
+  glm::vec3 screenMin(FLT_MAX), screenMax(-FLT_MAX);
+  for (int corner = 0; corner < 8; corner ++) {
+    glm::vec3 point(corner & 1 ? boundsMax.x : boundsMin.x,
+		    corner & 2 ? boundsMax.y : boundsMin.y,
+		    corner & 4 ? boundsMax.z : boundsMin.z);
+    glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+    // boxes through the near plane cover too much to be worth testing
+    if (clip.z < -clip.w || clip.w <= 0.0f) {
+      return true;
+    }
+    glm::vec3 ndc = glm::vec3(clip) / clip.w;
+    screenMin = glm::min(screenMin, ndc);
+    screenMax = glm::max(screenMax, ndc);
+  }
+  // off screen is for the frustum to decide
+  if (screenMax.x < -1.0f || screenMax.y < -1.0f || screenMin.x > 1.0f || screenMin.y > 1.0f) {
+    return true;
+  }
+  float nearest = screenMin.z * 0.5f + 0.5f;
+  int minX = std::max(0, (int)floorf((screenMin.x * 0.5f + 0.5f) * width));
+  int minY = std::max(0, (int)floorf((screenMin.y * 0.5f + 0.5f) * height));
+  int maxX = std::min((int)width - 1, (int)floorf((screenMax.x * 0.5f + 0.5f) * width));
+  int maxY = std::min((int)height - 1, (int)floorf((screenMax.y * 0.5f + 0.5f) * height));
+
+  unsigned int level = 0;
+  while (level + 1 < LEVEL_COUNT &&
+	 ((maxX >> level) - (minX >> level) >= (int)TEST_TEXELS || (maxY >> level) - (minY >> level) >= (int)TEST_TEXELS)) {
+    level ++;
+  }
+  const float *depth = &levels[level][0];
+  unsigned int levelWidth = width >> level;
+  for (int y = minY >> level; y <= maxY >> level; y ++) {
+    for (int x = minX >> level; x <= maxX >> level; x ++) {
+      if (depth[y * levelWidth + x] >= nearest) {
+	return true;
+      }
+    }
+  }
+  occludedCount ++;
+  return false;
+}
+
+void OcclusionCuller::clear() {
+  pool.shutdown();
+  threaded = false;
+  meshes.clear();
+  triangles.clear();
+  tileBins.clear();
+  levels.clear();
+  width = 0;
+  height = 0;
+  tilesX = 0;
+  tilesY = 0;
+}
+
+OcclusionCuller::~OcclusionCuller() {
+  clear();
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+// Software occlusion culling. A few chosen occluder meshes are
+// rasterized into a small CPU depth buffer, which is reduced into a
+// hierarchical max-depth pyramid. Object boxes are then tested against
+// the pyramid. No GL is involved.
+//
+// The screen is split into square tiles. Triangles are binned to the
+// tiles they touch, and each tile is rasterized, four pixels at a time
+// with SSE, and reduced on its own thread. Depth is z/w in [0, 1], so
+// the same code serves perspective and orthographic (shadow) views.
+//
+// Usage per view: beginFrame, addOccluder for each occluder, finish,
+// then isVisible for each object.
+class OcclusionCuller {
+public:
+  OcclusionCuller();
+
+  // width and height are rounded up to whole tiles; threadCount 0 picks
+  // one per core, 1 rasterizes on the calling thread
+  void init(unsigned int width, unsigned int height, unsigned int threadCount = 0);
+
+  // positions are the first three floats of each stride-float vertex;
+  // returns the id for addOccluder
+  unsigned int addOccluderMesh(const float *vertices, unsigned int stride, unsigned int vertexCount,
+			       const unsigned int *indices, unsigned int indexCount);
+
+  void beginFrame(const glm::mat4 &viewProjection);
+  void addOccluder(unsigned int mesh, const glm::mat4 &transform);
+  // rasterizes the binned triangles and builds the pyramid
+  void finish();
+
+  // world space box; false only if every pixel it could cover is behind
+  // the occluders
+  bool isVisible(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+  unsigned int getWidth() {return width;}
+  unsigned int getHeight() {return height;}
+  // level 0 is the full resolution depth buffer
+  const float *getDepth(unsigned int level = 0) {return &levels[level][0];}
+  unsigned int getTriangleCount() {return triangles.size();}
+  unsigned int getTestedCount() {return testedCount;}
+  unsigned int getOccludedCount() {return occludedCount;}
+
+  void clear();
+
+  ~OcclusionCuller();
+
+private:
+  // screen space triangle: pixel coordinates and z/w depth
+  struct ScreenTriangle {
+    float x[3], y[3], z[3];
+  };
+
+  struct OccluderMesh {
+    std::vector<glm::vec3> positions;
+    std::vector<unsigned int> indices;
+  };
+
+  unsigned int width, height;
+  unsigned int tilesX, tilesY;
+  glm::mat4 viewProjection;
+  std::vector<OccluderMesh> meshes;
+  std::vector<ScreenTriangle> triangles;
+  std::vector<std::vector<uint32_t> > tileBins;
+  // max depth pyramid, each level half the size of the one above it,
+  // down to one texel per tile
+  std::vector<std::vector<float> > levels;
+  unsigned int testedCount, occludedCount;
+
+  ThreadPool pool;
+  bool threaded;
+
+  void clipAndBin(const glm::vec4 *clip);
+  void binTriangle(const ScreenTriangle &triangle);
+  void rasterizeTile(unsigned int tile);
+  void reduceTile(unsigned int tile);
+};
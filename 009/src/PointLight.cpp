@@ -1,29 +1,60 @@
 #include "PointLight.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <math.h>
 
 PointLight::PointLight() : Light(){
   position = glm::vec3(0.0f, 0.0f, 0.0f);
   constant = 1.0f;
   linear = 0.0f;
   exponent = 0.0f;
+  shadowTile = -1;
 }
 
 PointLight::PointLight(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensity, GLfloat dIntensity, GLfloat xPos, GLfloat yPos, GLfloat zPos, GLfloat con, GLfloat lin, GLfloat exp)
-  : Light(1024, 1024, red, green, blue, aIntensity, dIntensity) {
+  : Light(red, green, blue, aIntensity, dIntensity) {
   position = glm::vec3(xPos, yPos, zPos);
   constant = con;
   linear = lin;
   exponent = exp;
+  shadowTile = -1;
 }
 
-void PointLight::useLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation, GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation) {
-  glUniform3f(ambientColorLocation, color.x, color.y,color.z);
-  glUniform1f(ambientIntensityLocation, ambientIntensity);
-  glUniform1f(diffuseIntensityLocation, diffuseIntensity);
-  
-  glUniform3f(positionLocation, position.x, position.y, position.z);
-  glUniform1f(constantLocation, constant);
-  glUniform1f(linearLocation, linear);
-  glUniform1f(exponentLocation, exponent);
+void PointLight::fillLightData(PointLightData &data) {
+  Light::fillLightData(data.base);
+  data.position = position;
+  data.constant = constant;
+  data.linear = linear;
+  data.exponent = exponent;
+  data.shadowTile = shadowTile;
+}
+
+// solves exponent d^2 + linear d + constant = 256 * brightest channel
+GLfloat PointLight::getRange(GLfloat maxRange) {
+  GLfloat brightest = fmaxf(color.x, fmaxf(color.y, color.z)) * diffuseIntensity;
+  GLfloat c = constant - 256.0f * brightest;
+  GLfloat range = maxRange;
+  if (exponent > 0.0f) {
+    range = (-linear + sqrtf(fmaxf(linear * linear - 4.0f * exponent * c, 0.0f))) / (2.0f * exponent);
+  } else if (linear > 0.0f) {
+    range = -c / linear;
+  }
+  return fminf(fmaxf(range, LIGHT_SHADOW_NEAR * 2.0f), maxRange);
+}
+
+glm::mat4 PointLight::calculateFaceTransform(unsigned int face, GLfloat range) {
+  static const glm::vec3 faceDirections[6] = {
+    glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+    glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+  };
+  static const glm::vec3 faceUps[6] = {
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+    glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f),
+    glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)
+  };
+  glm::mat4 view = glm::lookAt(position, position + faceDirections[face], faceUps[face]);
+  return glm::perspective(glm::radians(90.0f), 1.0f, LIGHT_SHADOW_NEAR, range) * view;
 }
 
 PointLight::~PointLight() {
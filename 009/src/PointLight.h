@@ -1,6 +1,8 @@
 #pragma once
 #include "Light.h"
 
+// Shadows come from the shadow atlas: six tiles, one per cube face, in
+// the GL cube map face order (+x, -x, +y, -y, +z, -z).
 class PointLight : public Light{
 public:
   PointLight();
@@ -9,12 +11,22 @@ public:
 	     GLfloat xPos, GLfloat yPos, GLfloat zPos,
 	     GLfloat con, GLfloat lin, GLfloat exp);
   
-  void useLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation);
+  void fillLightData(PointLightData &data);
+
+  glm::vec3 getPosition() {return position;}
+  // distance at which the attenuated light drops below one 8-bit step,
+  // at most maxRange
+  GLfloat getRange(GLfloat maxRange);
+
+  // first of the light's atlas tiles this frame, -1 for no shadow
+  void setShadowTile(int tile) {shadowTile = tile;}
+  int getShadowTile() {return shadowTile;}
+  // 90 degree view-projection of a cube face out to range
+  glm::mat4 calculateFaceTransform(unsigned int face, GLfloat range);
 
   ~PointLight();
 protected:
   glm::vec3 position;
   GLfloat constant, linear, exponent;
+  int shadowTile;
 };
@@ -0,0 +1,190 @@
+#include "RenderQueue.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "NormalMatrix.h"
+
+static const unsigned int DEPTH_BITS = 24;
+static const uint32_t DEPTH_MAX = (1u << DEPTH_BITS) - 1;
+
+RenderQueue::RenderQueue() {
+  drawCount = 0;
+  stateChanges = 0;
+}
+
+DrawItem &RenderQueue::submit(RenderPass pass, Shader *shader, const glm::mat4 &transform, float depth) {
+  items.push_back(DrawItem());
+  DrawItem &item = items.back();
+  item.pass = pass;
+  item.shader = shader;
+  item.texture = nullptr;
+  item.material = nullptr;
+  item.transform = transform;
+  item.depth = depth;
+  item.mesh = nullptr;
+  item.instancedMesh = nullptr;
+  item.lod = 0;
+  return item;
+}
+
+// 0 is null. A frame with more distinct states than the field holds
+// wraps them, which only costs some grouping, since playback compares
+// pointers
+uint32_t RenderQueue::stateId(StateIds &ids, const void *state, uint32_t fieldMask) {
+  if (!state) {
+    return 0;
+  }
+  StateIds::iterator found = ids.find(state);
+  if (found != ids.end()) {
+    return found->second;
+  }
+  uint32_t id = (ids.size() % fieldMask) + 1;
+  ids[state] = id;
+  return id;
+}
+
+uint64_t RenderQueue::makeKey(const DrawItem &item) {
+  float depth = item.depth < 0.0f ? 0.0f : (item.depth > 1.0f ? 1.0f : item.depth);
+  uint64_t key = uint64_t(item.pass & 0xf) << 60;
+  key |= uint64_t(stateId(shaderIds, item.shader, 0xff)) << 52;
+  key |= uint64_t(stateId(textureIds, item.texture, 0xffff)) << 36;
+  key |= uint64_t(stateId(materialIds, item.material, 0xff)) << 28;
+  key |= uint64_t(depth * DEPTH_MAX) << 4;
+  return key;
+}
+
+// LSD radix sort of item indices, 8 bits per pass; passes where every key
+// has the same byte are skipped
+void RenderQueue::sort() {
+  size_t count = items.size();
+  keys.resize(count);
+  order.resize(count);
+  scratch.resize(count);
+  for (size_t i = 0; i < count; i ++) {
+    keys[i] = makeKey(items[i]);
+    order[i] = i;
+  }
+  shaderIds.clear();
+  textureIds.clear();
+  materialIds.clear();
+
+  for (unsigned int shift = 0; shift < 64; shift += 8) {
+    size_t histogram[256] = {0};
+    for (size_t i = 0; i < count; i ++) {
+      histogram[(keys[i] >> shift) & 0xff] ++;
+    }
+    if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (size_t b = 0; b < 256; b ++) {
+      size_t bucket = histogram[b];
+      histogram[b] = offset;
+      offset += bucket;
+    }
+    for (size_t i = 0; i < count; i ++) {
+      uint32_t index = order[i];
+      scratch[histogram[(keys[index] >> shift) & 0xff] ++] = index;
+    }
+    order.swap(scratch);
+  }
+}
+
+void RenderQueue::execute() {
+  GeometryArena *arena = Mesh::getGeometryArena();
+  bool batching = arena && arena->isActive();
+  const glm::mat4 identity(1.0f);
+
+  Shader *currentShader = nullptr;
+  Texture *currentTexture = nullptr;
+  Material *currentMaterial = nullptr;
+  // material the constant attribute 11 holds, for draws outside the arena
+  Material *attributeMaterial = nullptr;
+  GLuint uniformModel = 0, uniformModelNormal = 0;
+  const glm::mat3 identityNormal(1.0f);
+
+  for (size_t i = 0; i < order.size(); i ++) {
+    const DrawItem &item = items[order[i]];
+
+    // materials travel with the draw data, so they don't break a batch
+    bool changes = item.shader != currentShader ||
+      (item.texture && item.texture != currentTexture);
+    if (changes && batching) {
+      arena->flush();
+    }
+
+    if (item.shader != currentShader) {
+      currentShader = item.shader;
+      currentShader->useShader();
+      uniformModel = currentShader->getModelLocation();
+      uniformModelNormal = currentShader->getModelNormalLocation();
+      if (batching) {
+	glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(identity));
+	glUniformMatrix3fv(uniformModelNormal, 1, GL_FALSE, glm::value_ptr(identityNormal));
+      }
+      stateChanges ++;
+    }
+    if (item.texture && item.texture != currentTexture) {
+      currentTexture = item.texture;
+      currentTexture->useTexture();
+      stateChanges ++;
+    }
+    if (item.material && item.material != currentMaterial) {
+      currentMaterial = item.material;
+      stateChanges ++;
+    }
+    drawCount ++;
+
+    if (batching && item.mesh && item.mesh->isInArena()) {
+      DrawData draw;
+      item.mesh->fillDrawData(draw, item.transform, normalMatrix(item.transform), -1);
+      if (currentMaterial) {
+	draw.material = currentMaterial->getMaterialData();
+      }
+      item.mesh->addToBatch(&draw, 1, item.lod);
+      continue;
+    }
+    if (batching && item.instancedMesh && item.instancedMesh->isInArena()) {
+      item.instancedMesh->addToBatch(item.transform, item.lod);
+      continue;
+    }
+
+    // meshes outside the arena draw on their own with the model uniform
+    if (batching) {
+      arena->flush();
+    }
+    if (currentMaterial != attributeMaterial) {
+      attributeMaterial = currentMaterial;
+      glm::vec2 material = attributeMaterial ? attributeMaterial->getMaterialData() : glm::vec2(0.0f);
+      glVertexAttrib2f(11, material.x, material.y);
+    }
+    glm::mat3 normal = normalMatrix(item.transform);
+    glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(item.transform));
+    glUniformMatrix3fv(uniformModelNormal, 1, GL_FALSE, glm::value_ptr(normal));
+    if (item.mesh) {
+      item.mesh->renderMesh(item.lod);
+    } else if (item.instancedMesh) {
+      item.instancedMesh->renderInstancedMesh(item.lod);
+    }
+    if (batching) {
+      glUniformMatrix4fv(uniformModel, 1, GL_FALSE, glm::value_ptr(identity));
+      glUniformMatrix3fv(uniformModelNormal, 1, GL_FALSE, glm::value_ptr(identityNormal));
+    }
+  }
+
+  if (batching) {
+    arena->flush();
+  }
+}
+
+void RenderQueue::clear() {
+  items.clear();
+  order.clear();
+  drawCount = 0;
+  stateChanges = 0;
+}
+
+RenderQueue::~RenderQueue() {
+  
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "Texture.h"
+#include "Material.h"
+#include "Mesh.h"
+#include "InstancedMesh.h"
+
+enum RenderPass {
+  RENDER_PASS_SHADOW,
+  RENDER_PASS_OPAQUE
+};
+
+// One draw. Exactly one of mesh and instancedMesh is set. texture
+// and material may be null to leave the current binding alone, which is
+// what depth-only passes want.
+struct DrawItem {
+  RenderPass pass;
+  Shader *shader;
+  Texture *texture;
+  Material *material;
+  glm::mat4 transform;
+  float depth;              // 0 near .. 1 far
+  Mesh *mesh;
+  InstancedMesh *instancedMesh;
+  unsigned int lod;
+};
+
+// Collects a frame's draws, sorts them by a 64-bit key and plays them
+// back, changing program, texture and material only between items that
+// differ. Key, most significant first:
+//   pass 4 | program 8 | texture 16 | material 8 | depth 24 | unused 4
+// so opaque items sharing state draw front to back.
+//
+// With an active GeometryArena, runs of items that share program and
+// texture are collected into the arena and go out as one multi-draw; the
+// model uniform stays at the identity and each draw carries its transform
+// and material. Other draws get the material as constant attribute 11.
+class RenderQueue {
+public:
+  RenderQueue();
+
+  DrawItem &submit(RenderPass pass, Shader *shader, const glm::mat4 &transform, float depth);
+  void sort();
+  void execute();
+  void clear();
+
+  unsigned int getDrawCount() {return drawCount;}
+  unsigned int getStateChanges() {return stateChanges;}
+
+  ~RenderQueue();
+
+private:
+  std::vector<DrawItem> items;
+  std::vector<uint64_t> keys;
+  std::vector<uint32_t> order, scratch;
+
+  // small ids for the key, one space per field, handed out in the order
+  // pointers show up in this frame's items and forgotten after sorting,
+  // so destroyed objects never keep ids
+  typedef std::unordered_map<const void*, uint32_t> StateIds;
+  StateIds shaderIds, textureIds, materialIds;
+
+  unsigned int drawCount;
+  unsigned int stateChanges;
+
+  static uint32_t stateId(StateIds &ids, const void *state, uint32_t fieldMask);
+  uint64_t makeKey(const DrawItem &item);
+};
@@ -0,0 +1,104 @@
+#include "RingBuffer.h"
+#include "GLState.h"
+
+#include <stdio.h>
+
+RingBuffer::RingBuffer() {
+  buffer = 0;
+  mapped = nullptr;
+  regionSize = 0;
+  region = 0;
+  used = 0;
+  for (unsigned int i = 0; i < REGION_COUNT; i ++) {
+    fences[i] = 0;
+  }
+  stalls = 0;
+}
+
+bool RingBuffer::init(GLsizeiptr size) {
+  clear();
+  if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage) {
+    printf("Persistent mapping unavailable, no ring buffer\n");
+    return false;
+  }
+
+  GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+  regionSize = size;
+  glGenBuffers(1, &buffer);
+  GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+  glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * REGION_COUNT, nullptr, flags);
+  mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * REGION_COUNT, flags));
+  if (!mapped) {
+    printf("Failed to map ring buffer\n");
+    clear();
+    return false;
+  }
+  return true;
+}
+
+void *RingBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr &offset) {
+  if (!mapped) {
+    return nullptr;
+  }
+  // aligned within the whole buffer, as callers divide the offset by the
+  // alignment and regionSize need not be a multiple of it
+  GLintptr regionStart = regionSize * region;
+  GLintptr start = (regionStart + used + alignment - 1) / alignment * alignment;
+  if (start + size > regionStart + regionSize) {
+    return nullptr;
+  }
+  used = start + size - regionStart;
+  offset = start;
+  return mapped + offset;
+}
+
+void RingBuffer::endFrame() {
+  if (!mapped) {
+    return;
+  }
+  fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  region = (region + 1) % REGION_COUNT;
+  used = 0;
+
+  GLsync &fence = fences[region];
+  if (!fence) {
+    return;
+  }
+  // the first wait flushes so the fence is guaranteed to signal
+  GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+  if (result == GL_TIMEOUT_EXPIRED) {
+    stalls ++;
+    while (result == GL_TIMEOUT_EXPIRED) {
+      result = glClientWaitSync(fence, 0, 1000000);
+    }
+  }
+  glDeleteSync(fence);
+  fence = 0;
+}
+
+void RingBuffer::clear() {
+  for (unsigned int i = 0; i < REGION_COUNT; i ++) {
+    if (fences[i]) {
+      glDeleteSync(fences[i]);
+      fences[i] = 0;
+    }
+  }
+  if (buffer != 0) {
+    if (mapped) {
+      GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+      glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+      mapped = nullptr;
+    }
+    glDeleteBuffers(1, &buffer);
+    GLState::bufferDeleted(buffer);
+    buffer = 0;
+  }
+  regionSize = 0;
+  region = 0;
+  used = 0;
+  stalls = 0;
+}
+
+RingBuffer::~RingBuffer() {
+  
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Per-frame scratch memory in one persistently and coherently mapped
+// buffer, split into REGION_COUNT regions used round robin. Writes are
+// plain stores into mapped memory; endFrame() fences the region just
+// used and waits for the next one's fence, which only blocks when the GPU
+// is more than REGION_COUNT - 1 frames behind.
+//
+// Needs GL 4.4 or ARB_buffer_storage; init() returns false otherwise.
+class RingBuffer {
+public:
+  static const unsigned int REGION_COUNT = 3;
+
+  RingBuffer();
+
+  bool init(GLsizeiptr regionSize);
+  bool isActive() {return mapped != nullptr;}
+  GLuint getBuffer() {return buffer;}
+
+  // offset is from the start of the buffer and a multiple of alignment;
+  // nullptr once this frame's region is full
+  void *allocate(GLsizeiptr size, GLsizeiptr alignment, GLintptr &offset);
+  void endFrame();
+
+  // frames where endFrame() had to wait for the GPU
+  unsigned int getStalls() {return stalls;}
+
+  void clear();
+
+  ~RingBuffer();
+
+private:
+  GLuint buffer;
+  unsigned char *mapped;
+  GLsizeiptr regionSize;
+  unsigned int region;
+  GLsizeiptr used;
+  GLsync fences[REGION_COUNT];
+  unsigned int stalls;
+};
@@ -1,16 +1,30 @@
 #include "Shader.h"
+#include "Hash.h"
+#include "GLState.h"
+
+#include <vector>
+#include <sys/stat.h>
+
+static const char *PROGRAM_CACHE_DIR = "shaders/cache";
+static const char PROGRAM_CACHE_MAGIC[4] = {'P', 'B', 'I', 'N'};
+
+struct ProgramBinaryHeader {
+  char magic[4];
+  uint32_t format;
+  uint64_t key;
+  uint32_t length;
+  uint32_t reserved;
+};
 
 Shader::Shader() {
   shaderID = 0;
   uniformModel = 0;
+  uniformModelNormal = 0;
   uniformProjection = 0;
-
-  pointLightCount = 0;
-  spotLightCount = 0;
 }
 
 void Shader::createFromString(const char *vertexCode, const char *fragmentCode) {
-  compileShader(vertexCode, fragmentCode);
+  compileShader(vertexCode, nullptr, fragmentCode);
 }
 
 void Shader::createFromFiles(const char *vertexLocation, const char *fragmentLocation) {
@@ -19,7 +33,15 @@ void Shader::createFromFiles(const char *vertexLocation, const char *fragmentLoc
   const char *vertexCode = vertexString.c_str();
   const char *fragmentCode = fragmentString.c_str();
 
-  compileShader(vertexCode, fragmentCode);
+  compileShader(vertexCode, nullptr, fragmentCode);
+}
+
+void Shader::createFromFiles(const char *vertexLocation, const char *geometryLocation, const char *fragmentLocation) {
+  std::string vertexString = readFile(vertexLocation);
+  std::string geometryString = readFile(geometryLocation);
+  std::string fragmentString = readFile(fragmentLocation);
+
+  compileShader(vertexString.c_str(), geometryString.c_str(), fragmentString.c_str());
 }
 
 std::string Shader::readFile(const char *fileLocation) {
@@ -41,7 +63,11 @@ std::string Shader::readFile(const char *fileLocation) {
   return content;
 }
 
-void Shader::compileShader(const char *vertexCode, const char *fragmentCode) {
+void Shader::compileShader(const char *vertexCode, const char *geometryCode, const char *fragmentCode) {
+  std::string vertexSource = injectDefines(vertexCode);
+  std::string geometrySource = geometryCode ? injectDefines(geometryCode) : std::string();
+  std::string fragmentSource = injectDefines(fragmentCode);
+
   shaderID = glCreateProgram();
 
   if (!shaderID) {
@@ -49,8 +75,22 @@ void Shader::compileShader(const char *vertexCode, const char *fragmentCode) {
     return;
   }
 
-  addShader(shaderID, vertexCode, GL_VERTEX_SHADER);
-  addShader(shaderID, fragmentCode, GL_FRAGMENT_SHADER);
+  bool useBinaryCache = programBinarySupported();
+  uint64_t key = 0;
+  if (useBinaryCache) {
+    key = programKey(vertexSource, geometrySource, fragmentSource);
+    if (loadProgramBinary(key)) {
+      getUniformLocations();
+      return;
+    }
+    glProgramParameteri(shaderID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
+
+  addShader(shaderID, vertexSource.c_str(), GL_VERTEX_SHADER);
+  if (geometryCode) {
+    addShader(shaderID, geometrySource.c_str(), GL_GEOMETRY_SHADER);
+  }
+  addShader(shaderID, fragmentSource.c_str(), GL_FRAGMENT_SHADER);
 
   GLint result = 0;
   GLchar eLog[1024] = {0};
@@ -71,80 +111,176 @@ void Shader::compileShader(const char *vertexCode, const char *fragmentCode) {
     return;
   }
 
+  if (useBinaryCache) {
+    saveProgramBinary(key);
+  }
+
+  getUniformLocations();
+}
+
+// Defines go right after the #version line, which has to stay first
+std::string Shader::injectDefines(const char *shaderCode) {
+  std::string code = shaderCode;
+  if (defines.empty()) {
+    return code;
+  }
+
+  std::string block = defines;
+  if (block[block.size() - 1] != '\n') {
+    block += '\n';
+  }
+
+  size_t version = code.find("#version");
+  if (version == std::string::npos) {
+    return block + code;
+  }
+  size_t lineEnd = code.find('\n', version);
+  if (lineEnd == std::string::npos) {
+    return code + "\n" + block;
+  }
+  return code.insert(lineEnd + 1, block);
+}
+
+bool Shader::programBinarySupported() {
+  if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+    return false;
+  }
+  GLint formatCount = 0;
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+  return formatCount > 0;
+}
+
+// Binaries are only valid for the exact sources and the driver that
+// produced them, so all of that goes into the key
+uint64_t Shader::programKey(const std::string &vertexSource, const std::string &geometrySource,
+			    const std::string &fragmentSource) {
+  const char nul = '\0';
+  uint64_t key = hashBytes(vertexSource.data(), vertexSource.size());
+  key = hashBytes(&nul, 1, key);
+  key = hashBytes(geometrySource.data(), geometrySource.size(), key);
+  key = hashBytes(&nul, 1, key);
+  key = hashBytes(fragmentSource.data(), fragmentSource.size(), key);
+  key = hashBytes(&nul, 1, key);
+  key = hashBytes(defines.data(), defines.size(), key);
+
+  const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+  for (size_t i = 0; i < 3; i ++) {
+    const char *value = reinterpret_cast<const char*>(glGetString(driverStrings[i]));
+    if (value) {
+      key = hashBytes(value, strlen(value), key);
+    }
+    key = hashBytes(&nul, 1, key);
+  }
+  return key;
+}
+
+bool Shader::loadProgramBinary(uint64_t key) {
+  char fileLocation[256];
+  snprintf(fileLocation, sizeof(fileLocation), "%s/%016llx.pbin", PROGRAM_CACHE_DIR,
+	   static_cast<unsigned long long>(key));
+
+  FILE *file = fopen(fileLocation, "rb");
+  if (!file) {
+    return false;
+  }
+
+  ProgramBinaryHeader header;
+  std::vector<char> binary;
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+    memcmp(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC)) == 0 &&
+    header.key == key && header.length > 0;
+  if (ok) {
+    binary.resize(header.length);
+    ok = fread(&binary[0], 1, binary.size(), file) == binary.size();
+  }
+  fclose(file);
+  if (!ok) {
+    return false;
+  }
+
+  glProgramBinary(shaderID, header.format, &binary[0], binary.size());
+  GLint result = 0;
+  glGetProgramiv(shaderID, GL_LINK_STATUS, &result);
+  if (!result) {
+    // rejected by the driver (e.g. after an update); the program object is
+    // unusable now, so start from a fresh one
+    glDeleteProgram(shaderID);
+    GLState::programDeleted(shaderID);
+    shaderID = glCreateProgram();
+    remove(fileLocation);
+    return false;
+  }
+
+  return true;
+}
+
+void Shader::saveProgramBinary(uint64_t key) {
+  GLint length = 0;
+  glGetProgramiv(shaderID, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(shaderID, length, nullptr, &format, &binary[0]);
+
+  mkdir(PROGRAM_CACHE_DIR, 0755);
+
+  char fileLocation[256];
+  snprintf(fileLocation, sizeof(fileLocation), "%s/%016llx.pbin", PROGRAM_CACHE_DIR,
+	   static_cast<unsigned long long>(key));
+  FILE *file = fopen(fileLocation, "wb");
+  if (!file) {
+    printf("Failed to write program binary: \"%s\"\n", fileLocation);
+    return;
+  }
+
+  ProgramBinaryHeader header;
+  memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+  header.format = format;
+  header.key = key;
+  header.length = length;
+  header.reserved = 0;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(&binary[0], 1, binary.size(), file) == binary.size();
+  fclose(file);
+  if (!ok) {
+    remove(fileLocation);
+  }
+}
+
+void Shader::getUniformLocations() {
   uniformModel = glGetUniformLocation(shaderID, "model");
+  uniformModelNormal = glGetUniformLocation(shaderID, "modelNormal");
   uniformProjection = glGetUniformLocation(shaderID, "projection");
   uniformView = glGetUniformLocation(shaderID, "view");
-  uniformDirectionalLight.uniformColor = glGetUniformLocation(shaderID, "directionalLight.base.color");
-  uniformDirectionalLight.uniformAmbientIntensity = glGetUniformLocation(shaderID, "directionalLight.base.ambientIntensity");
-  uniformDirectionalLight.uniformDirection = glGetUniformLocation(shaderID, "directionalLight.direction");
-  uniformDirectionalLight.uniformDiffuseIntensity = glGetUniformLocation(shaderID, "directionalLight.base.diffuseIntensity");
-  uniformSpecularIntensity = glGetUniformLocation(shaderID, "material.specularIntensity");
-  uniformShininess = glGetUniformLocation(shaderID, "material.shininess");
   uniformEyePosition = glGetUniformLocation(shaderID, "eyePosition");
 
-  uniformPointLightCount = glGetUniformLocation(shaderID, "pointLightCount");
+  // programs without lights (the shadow pass) have no block
+  GLuint lightBlock = glGetUniformBlockIndex(shaderID, "LightBlock");
+  if (lightBlock != GL_INVALID_INDEX) {
+    glUniformBlockBinding(shaderID, lightBlock, LIGHT_BLOCK_BINDING);
+  }
 
-  for (size_t i = 0; i < MAX_POINT_LIGHTS; i ++) {
+  for (size_t i = 0; i < MAX_INSTANCE_MATERIALS; i ++) {
     char locBuff[100] = {'\0'};
-    
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.color", static_cast<int>(i));
-    uniformPointLight[i].uniformColor = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.ambientIntensity", static_cast<int>(i));
-    uniformPointLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].base.diffuseIntensity", static_cast<int>(i));
-    uniformPointLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].position", static_cast<int>(i));
-    uniformPointLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].constant", static_cast<int>(i));
-    uniformPointLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].linear", static_cast<int>(i));
-    uniformPointLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "pointLights[%d].exponent", static_cast<int>(i));
-    uniformPointLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
-  }
 
-    uniformSpotLightCount = glGetUniformLocation(shaderID, "spotLightCount");
+    snprintf(locBuff, sizeof(locBuff), "instanceMaterials[%d].specularIntensity", static_cast<int>(i));
+    uniformInstanceMaterial[i].uniformSpecularIntensity = glGetUniformLocation(shaderID, locBuff);
 
-  for (size_t i = 0; i < MAX_SPOT_LIGHTS; i ++) {
-    char locBuff[100] = {'\0'};
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.color", static_cast<int>(i));
-    uniformSpotLight[i].uniformColor = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.ambientIntensity", static_cast<int>(i));
-    uniformSpotLight[i].uniformAmbientIntensity = glGetUniformLocation(shaderID, locBuff);
-
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.base.diffuseIntensity", static_cast<int>(i));
-    uniformSpotLight[i].uniformDiffuseIntensity = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.position", static_cast<int>(i));
-    uniformSpotLight[i].uniformPosition = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.constant", static_cast<int>(i));
-    uniformSpotLight[i].uniformConstant = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.linear", static_cast<int>(i));
-    uniformSpotLight[i].uniformLinear = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].base.exponent", static_cast<int>(i));
-    uniformSpotLight[i].uniformExponent = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].direction", static_cast<int>(i));
-    uniformSpotLight[i].uniformDirection = glGetUniformLocation(shaderID, locBuff);
-    
-    snprintf(locBuff, sizeof(locBuff), "spotLights[%d].edge", static_cast<int>(i));
-    uniformSpotLight[i].uniformEdge = glGetUniformLocation(shaderID, locBuff);
+    snprintf(locBuff, sizeof(locBuff), "instanceMaterials[%d].shininess", static_cast<int>(i));
+    uniformInstanceMaterial[i].uniformShininess = glGetUniformLocation(shaderID, locBuff);
   }
 
   uniformTexture = glGetUniformLocation(shaderID, "theTexture");
-  uniformDirectionalLightTransform = glGetUniformLocation(shaderID, "directionalLightTransform");
   uniformDirectionalShadowMap = glGetUniformLocation(shaderID, "directionalShadowMap");
+  uniformCascadeTransforms = glGetUniformLocation(shaderID, "cascadeTransforms");
+  uniformCascadeMask = glGetUniformLocation(shaderID, "cascadeMask");
+  uniformShadowAtlas = glGetUniformLocation(shaderID, "shadowAtlas");
+  uniformShadowTileTransforms = glGetUniformLocation(shaderID, "shadowTileTransforms");
+  uniformShadowTileRects = glGetUniformLocation(shaderID, "shadowTileRects");
+  uniformLightTransform = glGetUniformLocation(shaderID, "lightTransform");
 }
 
 void Shader::addShader(GLuint theProgram, const char *shaderCode, GLenum shaderType) {
@@ -177,6 +313,10 @@ GLuint Shader::getModelLocation() {
   return uniformModel;
 }
 
+GLuint Shader::getModelNormalLocation() {
+  return uniformModelNormal;
+}
+
 GLuint Shader::getProjectionLocation() {
   return uniformProjection;
 }
@@ -189,90 +329,58 @@ GLuint Shader::getEyePositionLocation() {
   return uniformEyePosition;
 }
 
-GLuint Shader::getAmbientColorLocation() {
-  return uniformDirectionalLight.uniformColor;
-}
-
-GLuint Shader::getAmbientIntensityLocation() {
-  return uniformDirectionalLight.uniformAmbientIntensity;
-}
-
-GLuint Shader::getDiffuseIntensityLocation() {
-  return uniformDirectionalLight.uniformDiffuseIntensity;
+void Shader::setInstanceMaterials(Material *materials, unsigned int materialCount) {
+  if (materialCount > MAX_INSTANCE_MATERIALS) {
+    materialCount = MAX_INSTANCE_MATERIALS;
+  }
+  for (size_t i = 0; i < materialCount; i ++) {
+    materials[i].useMaterial(uniformInstanceMaterial[i].uniformSpecularIntensity,
+			     uniformInstanceMaterial[i].uniformShininess);
+  }
 }
 
-GLuint Shader::getDirectionLocation() {
-  return uniformDirectionalLight.uniformDirection;
+void Shader::setTexture(GLuint textureUnit) {
+  glUniform1i(uniformTexture, textureUnit);
 }
 
-GLuint Shader::getSpecularIntensityLocation() {
-  return uniformSpecularIntensity;
+void Shader::setDirectionalShadowMap(GLuint textureUnit) {
+  glUniform1i(uniformDirectionalShadowMap, textureUnit);
 }
 
-GLuint Shader::getShininessLocation() {
-  return uniformShininess;
+void Shader::setCascadeTransforms(const glm::mat4 *transforms, unsigned int count) {
+  glUniformMatrix4fv(uniformCascadeTransforms, count, GL_FALSE, glm::value_ptr(transforms[0]));
 }
 
-void Shader::setDirectionalLight(DirectionalLight *dLight) {
-  dLight->useLight(uniformDirectionalLight.uniformAmbientIntensity,
-		   uniformDirectionalLight.uniformColor,
-		   uniformDirectionalLight.uniformDiffuseIntensity,
-		   uniformDirectionalLight.uniformDirection);
+void Shader::setCascadeMask(unsigned int mask) {
+  glUniform1i(uniformCascadeMask, mask);
 }
 
-void Shader::setPointLights(PointLight *pLight, unsigned int lightCount) {
-  if (lightCount > MAX_POINT_LIGHTS) {
-    lightCount = MAX_POINT_LIGHTS;
-  }
-  glUniform1i(uniformPointLightCount, lightCount);
-  for (size_t i = 0; i < lightCount; i ++) {
-    pLight[i].useLight(uniformPointLight[i].uniformAmbientIntensity,
-		       uniformPointLight[i].uniformColor,
-		       uniformPointLight[i].uniformDiffuseIntensity,
-		       uniformPointLight[i].uniformPosition,
-		       uniformPointLight[i].uniformConstant,
-		       uniformPointLight[i].uniformLinear,
-		       uniformPointLight[i].uniformExponent);
-  }
+void Shader::setShadowAtlas(GLuint textureUnit) {
+  glUniform1i(uniformShadowAtlas, textureUnit);
 }
 
-void Shader::setSpotLights(SpotLight *sLight, unsigned int lightCount) {
-  if (lightCount > MAX_POINT_LIGHTS) {
-    lightCount = MAX_POINT_LIGHTS;
+void Shader::setShadowTiles(const glm::mat4 *transforms, const glm::vec4 *rects, unsigned int count) {
+  if (count > MAX_SHADOW_TILES) {
+    count = MAX_SHADOW_TILES;
   }
-  glUniform1i(uniformSpotLightCount, lightCount);
-  for (size_t i = 0; i < lightCount; i ++) {
-    sLight[i].useLight(uniformSpotLight[i].uniformAmbientIntensity,
-		       uniformSpotLight[i].uniformColor,
-		       uniformSpotLight[i].uniformDiffuseIntensity,
-		       uniformSpotLight[i].uniformPosition,
-		       uniformSpotLight[i].uniformDirection,
-		       uniformSpotLight[i].uniformConstant,
-		       uniformSpotLight[i].uniformLinear,
-		       uniformSpotLight[i].uniformExponent,
-		       uniformSpotLight[i].uniformEdge);
+  if (count > 0) {
+    glUniformMatrix4fv(uniformShadowTileTransforms, count, GL_FALSE, glm::value_ptr(transforms[0]));
+    glUniform4fv(uniformShadowTileRects, count, glm::value_ptr(rects[0]));
   }
 }
 
-void Shader::setTexture(GLuint textureUnit) {
-  glUniform1i(uniformTexture, textureUnit);
-}
-
-void Shader::setDirectionalShadowMap(GLuint textureUnit) {
-  glUniform1i(uniformDirectionalShadowMap, textureUnit);
-}
-
-void Shader::setDirectionalLightTransform(glm::mat4 *lTransform) {
-  glUniformMatrix4fv(uniformDirectionalLightTransform, 1, GL_FALSE, glm::value_ptr(*lTransform));
+void Shader::setLightTransform(const glm::mat4 &transform) {
+  glUniformMatrix4fv(uniformLightTransform, 1, GL_FALSE, glm::value_ptr(transform));
 }
 
 void Shader::useShader() {
-  glUseProgram(shaderID);
+  GLState::useProgram(shaderID);
 }
 
 void Shader::clearShader() {
   if (shaderID != 0) {
     glDeleteProgram(shaderID);
+    GLState::programDeleted(shaderID);
     shaderID = 0;
   }
 
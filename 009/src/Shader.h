@@ -4,6 +4,8 @@
 #include <string.h>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <stdint.h>
 
 #include <GL/glew.h>
 
@@ -11,86 +13,65 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "constants.h"
-#include "DirectionalLight.h"
-#include "PointLight.h"
-#include "SpotLight.h"
+#include "Material.h"
 
 class Shader {
 public:
   Shader();
 
+  void setDefines(const std::string &shaderDefines) {defines = shaderDefines;}
   void createFromString(const char *vertexCode, const char *fragmentCode);
   void createFromFiles(const char *vertexLocation, const char *fragmentLocation);
+  void createFromFiles(const char *vertexLocation, const char *geometryLocation, const char *fragmentLocation);
 
   std::string readFile(const char *fileLocation);
   
   GLuint getProjectionLocation();
   GLuint getModelLocation();
+  GLuint getModelNormalLocation();
   GLuint getViewLocation();
   GLuint getEyePositionLocation();
-  GLuint getAmbientIntensityLocation();
-  GLuint getAmbientColorLocation();
-  GLuint getDiffuseIntensityLocation();
-  GLuint getDirectionLocation();
-  GLuint getSpecularIntensityLocation();
-  GLuint getShininessLocation();
 
-  void setDirectionalLight(DirectionalLight *dLight);
-  void setPointLights(PointLight *pLight, unsigned int lightCount);
-  void setSpotLights(SpotLight *sLight, unsigned int lightCount);
+  // InstanceData::materialIndex indexes these
+  void setInstanceMaterials(Material *materials, unsigned int materialCount);
   void setTexture(GLuint textureUnit);
   void setDirectionalShadowMap(GLuint textureUnit);
-  void setDirectionalLightTransform(glm::mat4* lTransform);
+  // one light transform per shadow cascade
+  void setCascadeTransforms(const glm::mat4 *transforms, unsigned int count);
+  // cascades the shadow pass renders into
+  void setCascadeMask(unsigned int mask);
+  void setShadowAtlas(GLuint textureUnit);
+  // ShadowAtlas::getTileTransforms and getTileRects
+  void setShadowTiles(const glm::mat4 *transforms, const glm::vec4 *rects, unsigned int count);
+  // view-projection of the atlas tile being rendered
+  void setLightTransform(const glm::mat4 &transform);
 
   void useShader();
   void clearShader();
 
   ~Shader();
 private:
-  int pointLightCount;
-  int spotLightCount;
-  
-  GLuint shaderID, uniformProjection, uniformModel, uniformView, uniformEyePosition, 
-    uniformSpecularIntensity, uniformShininess,
-    uniformTexture,
-    uniformDirectionalLightTransform, uniformDirectionalShadowMap;
-
-  struct {
-    GLuint uniformColor;
-    GLuint uniformAmbientIntensity;
-    GLuint uniformDiffuseIntensity;
-    GLuint uniformDirection;
-  } uniformDirectionalLight;
+  std::string defines;
 
-  GLuint uniformPointLightCount;
-  
-  struct {
-    GLuint uniformColor;
-    GLuint uniformAmbientIntensity;
-    GLuint uniformDiffuseIntensity;
-
-    GLuint uniformPosition;
-    GLuint uniformConstant;
-    GLuint uniformLinear;
-    GLuint uniformExponent;
-  } uniformPointLight[MAX_POINT_LIGHTS];
-
-  GLuint uniformSpotLightCount;
+  GLuint shaderID, uniformProjection, uniformModel, uniformModelNormal, uniformView, uniformEyePosition, 
+    uniformTexture,
+    uniformDirectionalShadowMap, uniformCascadeTransforms, uniformCascadeMask,
+    uniformShadowAtlas, uniformShadowTileTransforms, uniformShadowTileRects, uniformLightTransform;
 
   struct {
-    GLuint uniformColor;
-    GLuint uniformAmbientIntensity;
-    GLuint uniformDiffuseIntensity;
-
-    GLuint uniformPosition;
-    GLuint uniformConstant;
-    GLuint uniformLinear;
-    GLuint uniformExponent;
-
-    GLuint uniformDirection;
-    GLuint uniformEdge;
-  } uniformSpotLight[MAX_SPOT_LIGHTS];
+    GLuint uniformSpecularIntensity;
+    GLuint uniformShininess;
+  } uniformInstanceMaterial[MAX_INSTANCE_MATERIALS];
 
-  void compileShader(const char *vertexCode, const char *fragmentCode);
+  // geometryCode may be null
+  void compileShader(const char *vertexCode, const char *geometryCode, const char *fragmentCode);
   void addShader(GLuint theProgram, const char *shaderCode, GLenum shaderType);
+  void getUniformLocations();
+
+  std::string injectDefines(const char *shaderCode);
+  bool programBinarySupported();
+  uint64_t programKey(const std::string &vertexSource, const std::string &geometrySource,
+		      const std::string &fragmentSource);
+  bool loadProgramBinary(uint64_t key);
+  void saveProgramBinary(uint64_t key);
 };
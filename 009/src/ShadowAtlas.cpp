@@ -0,0 +1,227 @@
+#include "ShadowAtlas.h"
+#include "GLState.h"
+
+#include <math.h>
+#include <algorithm>
+
+static bool isPowerOfTwo(GLuint value) {
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+// every other bit of code, starting at bit 0; with code >> 1 this turns
+// a Morton index back into x and y
+static GLuint compactBits(GLuint code) {
+  code &= 0x55555555;
+  code = (code | (code >> 1)) & 0x33333333;
+  code = (code | (code >> 2)) & 0x0f0f0f0f;
+  code = (code | (code >> 4)) & 0x00ff00ff;
+  code = (code | (code >> 8)) & 0x0000ffff;
+  return code;
+}
+
+ShadowAtlas::ShadowAtlas() {
+  FBO = 0;
+  atlasMap = 0;
+  atlasSize = 0;
+  minTileSize = 0;
+  maxTileSize = 0;
+  tileBudget = MAX_SHADOW_TILES;
+  droppedCount = 0;
+}
+
+bool ShadowAtlas::init(GLuint size, GLuint minTile, GLuint maxTile) {
+  clear();
+  if (!isPowerOfTwo(size) || !isPowerOfTwo(minTile) || !isPowerOfTwo(maxTile) ||
+      minTile > maxTile || maxTile > size) {
+    printf("Shadow atlas: sizes have to be powers of two with %u <= %u <= %u\n", minTile, maxTile, size);
+    return false;
+  }
+  atlasSize = size;
+  minTileSize = minTile;
+  maxTileSize = maxTile;
+
+  glGenTextures(1, &atlasMap);
+  GLState::bindTexture(0, atlasMap);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, atlasSize, atlasSize, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+  glGenFramebuffers(1, &FBO);
+  GLState::bindFramebuffer(FBO);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlasMap, 0);
+  glDrawBuffer(GL_NONE);
+  glReadBuffer(GL_NONE);
+
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  GLState::bindFramebuffer(0);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    printf("Framebuffer Error: %i\n", status);
+    clear();
+    return false;
+  }
+
+  return true;
+}
+
+void ShadowAtlas::setTileBudget(unsigned int tiles) {
+  tileBudget = tiles < MAX_SHADOW_TILES ? tiles : MAX_SHADOW_TILES;
+}
+
+void ShadowAtlas::beginFrame() {
+  requests.clear();
+}
+
+unsigned int ShadowAtlas::request(float importance, unsigned int faces) {
+  Request next;
+  next.importance = importance;
+  next.faces = faces;
+  next.tileSize = 0;
+  next.firstTile = -1;
+  requests.push_back(next);
+  return requests.size() - 1;
+}
+
+// the largest power of two up to importance * maxTileSize
+GLuint ShadowAtlas::tileSizeFor(float importance) {
+  GLuint size = maxTileSize;
+  while (size > minTileSize && size > importance * maxTileSize) {
+    size /= 2;
+  }
+  return size;
+}
+
+// Requests are served most important first, each shrinking its tiles
+// until they fit in what is left. Placement then goes largest tile
+// first: every Morton index is then a multiple of the current tile's
+// cell count, so each tile is an aligned square of cells.
+void ShadowAtlas::allocate() {
+  tiles.clear();
+  droppedCount = 0;
+
+  std::vector<unsigned int> order(requests.size());
+  for (size_t i = 0; i < requests.size(); i ++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+      return requests[a].importance > requests[b].importance;
+    });
+
+  // in cells of minTileSize
+  GLuint cellsPerSide = FBO ? atlasSize / minTileSize : 0;
+  GLuint freeCells = cellsPerSide * cellsPerSide;
+  unsigned int freeTiles = tileBudget;
+  for (size_t i = 0; i < order.size(); i ++) {
+    Request &next = requests[order[i]];
+    next.tileSize = 0;
+    next.firstTile = -1;
+    if (!FBO || next.faces == 0 || next.faces > freeTiles) {
+      droppedCount ++;
+      continue;
+    }
+    GLuint size = tileSizeFor(next.importance);
+    while (size > minTileSize && next.faces * (size / minTileSize) * (size / minTileSize) > freeCells) {
+      size /= 2;
+    }
+    GLuint cells = next.faces * (size / minTileSize) * (size / minTileSize);
+    if (cells > freeCells) {
+      droppedCount ++;
+      continue;
+    }
+    next.tileSize = size;
+    freeCells -= cells;
+    freeTiles -= next.faces;
+  }
+
+  std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+      return requests[a].tileSize > requests[b].tileSize;
+    });
+  GLuint cursor = 0;
+  for (size_t i = 0; i < order.size() && requests[order[i]].tileSize > 0; i ++) {
+    Request &next = requests[order[i]];
+    next.firstTile = tiles.size();
+    GLuint cells = (next.tileSize / minTileSize) * (next.tileSize / minTileSize);
+    for (unsigned int face = 0; face < next.faces; face ++) {
+      Tile tile;
+      tile.x = compactBits(cursor) * minTileSize;
+      tile.y = compactBits(cursor >> 1) * minTileSize;
+      tile.size = next.tileSize;
+      tiles.push_back(tile);
+      cursor += cells;
+    }
+  }
+
+  tileViewProjections.assign(tiles.size(), glm::mat4(1.0f));
+  tileTransforms.assign(tiles.size(), glm::mat4(1.0f));
+  tileRects.assign(tiles.size(), glm::vec4(0.0f));
+}
+
+// The light's clip space [-1, 1] maps onto the tile and depth onto
+// [0, 1]; the shader divides by w after this
+void ShadowAtlas::setTileTransform(unsigned int tile, const glm::mat4 &lightViewProjection) {
+  const Tile &target = tiles[tile];
+  float scale = target.size * 0.5f / atlasSize;
+  glm::mat4 toTile(1.0f);
+  toTile[0][0] = scale;
+  toTile[1][1] = scale;
+  toTile[2][2] = 0.5f;
+  toTile[3] = glm::vec4((target.x + target.size * 0.5f) / atlasSize, (target.y + target.size * 0.5f) / atlasSize,
+			0.5f, 1.0f);
+
+  tileViewProjections[tile] = lightViewProjection;
+  tileTransforms[tile] = toTile * lightViewProjection;
+  tileRects[tile] = glm::vec4(target.x + 0.5f, target.y + 0.5f,
+			      target.x + target.size - 0.5f, target.y + target.size - 0.5f) / (float)atlasSize;
+}
+
+void ShadowAtlas::write() {
+  GLState::bindFramebuffer(FBO);
+  glClear(GL_DEPTH_BUFFER_BIT);
+}
+
+void ShadowAtlas::writeTile(unsigned int tile) {
+  const Tile &target = tiles[tile];
+  GLState::viewport(target.x, target.y, target.size, target.size);
+}
+
+void ShadowAtlas::read(GLenum textureUnit) {
+  GLState::bindTexture(textureUnit - GL_TEXTURE0, atlasMap);
+}
+
+float ShadowAtlas::screenImportance(const glm::vec3 &center, float radius, const glm::vec3 &eye,
+				    float projectionScale) {
+  glm::vec3 offset = center - eye;
+  float distance2 = glm::dot(offset, offset);
+  if (distance2 <= radius * radius) {
+    return 1.0f;
+  }
+  // tangent of the sphere's angular radius over that of half the view
+  float importance = radius * projectionScale / sqrtf(distance2 - radius * radius);
+  return importance < 1.0f ? importance : 1.0f;
+}
+
+void ShadowAtlas::clear() {
+  if (FBO) {
+    glDeleteFramebuffers(1, &FBO);
+    GLState::framebufferDeleted(FBO);
+    FBO = 0;
+  }
+  if (atlasMap) {
+    glDeleteTextures(1, &atlasMap);
+    GLState::textureDeleted(atlasMap);
+    atlasMap = 0;
+  }
+  requests.clear();
+  tiles.clear();
+  tileViewProjections.clear();
+  tileTransforms.clear();
+  tileRects.clear();
+  droppedCount = 0;
+}
+
+ShadowAtlas::~ShadowAtlas() {
+  clear();
+}
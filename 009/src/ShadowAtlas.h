@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdio.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "constants.h"
+
+// One depth texture and one framebuffer for every spot and point light
+// shadow. Each frame the shadowed lights ask for tiles, one for a spot
+// light and six (the cube faces) for a point light, sized by how much of
+// the screen the light covers. Tiles are square powers of two, so packing
+// them largest first in Morton order fills the atlas without gaps.
+//
+// When the atlas or the tile budget runs out, the least important lights
+// get smaller tiles first and then none at all.
+//
+// Usage per frame: beginFrame, request for each light, allocate,
+// setTileTransform for every granted tile; then write, and writeTile
+// before drawing each tile's casters.
+class ShadowAtlas {
+public:
+  ShadowAtlas();
+
+  // size is the atlas edge in texels; tile sizes are powers of two from
+  // minTileSize to maxTileSize
+  bool init(GLuint size, GLuint minTileSize, GLuint maxTileSize);
+  // most tiles rendered per frame, at most MAX_SHADOW_TILES
+  void setTileBudget(unsigned int tiles);
+
+  void beginFrame();
+  // importance in [0, 1], see screenImportance(); faces is 1 for a spot
+  // light and 6 for a point light; returns the id for getFirstTile
+  unsigned int request(float importance, unsigned int faces);
+  // sizes and places the tiles of this frame's requests
+  void allocate();
+  // the request's tiles are consecutive from here; -1 if it got none
+  int getFirstTile(unsigned int request) {return requests[request].firstTile;}
+
+  // the light view-projection the tile is rendered with
+  void setTileTransform(unsigned int tile, const glm::mat4 &lightViewProjection);
+  unsigned int getTileCount() {return tiles.size();}
+  GLuint getTileSize(unsigned int tile) {return tiles[tile].size;}
+  const glm::mat4 &getTileViewProjection(unsigned int tile) {return tileViewProjections[tile];}
+  // for the shader: world to atlas coordinates and depth per tile, and
+  // the outermost texel centres of each tile for clamping filter taps
+  const glm::mat4 *getTileTransforms() {return tiles.empty() ? nullptr : &tileTransforms[0];}
+  const glm::vec4 *getTileRects() {return tiles.empty() ? nullptr : &tileRects[0];}
+
+  // clears the whole atlas and binds its framebuffer
+  void write();
+  // sets the viewport to one tile
+  void writeTile(unsigned int tile);
+  void read(GLenum textureUnit);
+
+  bool isActive() {return FBO != 0;}
+  // lights that asked for tiles and got none last allocate()
+  unsigned int getDroppedCount() {return droppedCount;}
+
+  // share of the screen height a light's sphere of influence spans, 1
+  // from inside it; projectionScale is projection[1][1]
+  static float screenImportance(const glm::vec3 &center, float radius, const glm::vec3 &eye,
+				float projectionScale);
+
+  void clear();
+
+  ~ShadowAtlas();
+
+private:
+  struct Request {
+    float importance;
+    unsigned int faces;
+    GLuint tileSize;
+    int firstTile;
+  };
+
+  // texel rectangle in the atlas
+  struct Tile {
+    GLuint x, y, size;
+  };
+
+  GLuint FBO, atlasMap;
+  GLuint atlasSize, minTileSize, maxTileSize;
+  unsigned int tileBudget;
+  unsigned int droppedCount;
+
+  std::vector<Request> requests;
+  std::vector<Tile> tiles;
+  std::vector<glm::mat4> tileViewProjections;
+  std::vector<glm::mat4> tileTransforms;
+  std::vector<glm::vec4> tileRects;
+
+  GLuint tileSizeFor(float importance);
+};
@@ -1,17 +1,26 @@
 #include "ShadowMap.h"
+#include "GLState.h"
 
 ShadowMap::ShadowMap() {
   FBO = 0;
   shadowMap = 0;
+  staticFBO = 0;
+  staticMap = 0;
+  staticDirty = true;
+  dynamicWritten = false;
+  staticUpdates = 0;
 }
 
 bool ShadowMap::init(GLuint width, GLuint height) {
   shadowWidth = width; shadowHeight = height;
+  return createDepthTarget(FBO, shadowMap);
+}
 
-  glGenFramebuffers(1, &FBO);
+bool ShadowMap::createDepthTarget(GLuint &framebuffer, GLuint &texture) {
+  glGenFramebuffers(1, &framebuffer);
   
-  glGenTextures(1, &shadowMap);
-  glBindTexture(GL_TEXTURE_2D, shadowMap);
+  glGenTextures(1, &texture);
+  GLState::bindTexture(0, texture);
   glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowWidth, shadowHeight, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
@@ -19,9 +28,11 @@ bool ShadowMap::init(GLuint width, GLuint height) {
   glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, bColor);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
-  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadowMap, 0);
+  GLState::bindFramebuffer(framebuffer);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
 
   glDrawBuffer(GL_NONE);
   glReadBuffer(GL_NONE);
@@ -33,25 +44,52 @@ bool ShadowMap::init(GLuint width, GLuint height) {
     return false;
   }
 
-  glBindFramebuffer(GL_FRAMEBUFFER, 0);
+  GLState::bindFramebuffer(0);
   
   return true;
 }
 
 void ShadowMap::write() {
-  glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+  dynamicWritten = true;
+  GLState::bindFramebuffer(FBO);
+}
+
+bool ShadowMap::initStaticCache() {
+  if (staticFBO) {
+    return true;
+  }
+  if (!createDepthTarget(staticFBO, staticMap)) {
+    glDeleteFramebuffers(1, &staticFBO);
+    GLState::framebufferDeleted(staticFBO);
+    glDeleteTextures(1, &staticMap);
+    GLState::textureDeleted(staticMap);
+    staticFBO = 0;
+    staticMap = 0;
+    return false;
+  }
+  staticDirty = true;
+  return true;
 }
 
 void ShadowMap::read(GLenum textureUnit) {
-  glActiveTexture(textureUnit);
-  glBindTexture(GL_TEXTURE_2D, shadowMap);
+  GLState::bindTexture(textureUnit - GL_TEXTURE0, staticMap && !dynamicWritten ? staticMap : shadowMap);
 }
 
 ShadowMap::~ShadowMap() {
   if (FBO) {
     glDeleteFramebuffers(1, &FBO);
+    GLState::framebufferDeleted(FBO);
   }
   if (shadowMap) {
     glDeleteTextures(1, &shadowMap);
+    GLState::textureDeleted(shadowMap);
+  }
+  if (staticFBO) {
+    glDeleteFramebuffers(1, &staticFBO);
+    GLState::framebufferDeleted(staticFBO);
+  }
+  if (staticMap) {
+    glDeleteTextures(1, &staticMap);
+    GLState::textureDeleted(staticMap);
   }
 }
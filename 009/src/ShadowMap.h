@@ -1,7 +1,18 @@
 #pragma once
 #include <stdio.h>
 #include <GL/glew.h>
+#include <glm/glm.hpp>
 
+// Depth map a light renders its casters into. With the static cache on,
+// casters that never move go into a second depth target that is only
+// redrawn when the light transform changes or someone invalidates it;
+// CascadedShadowMap keeps it per cascade and copies it under the dynamic
+// casters instead of redrawing everything.
+// read() samples the static target until write() has been called.
+//
+// The depth textures compare in hardware (GL_COMPARE_REF_TO_TEXTURE), so
+// shaders read them through shadow samplers and each linear fetch is a
+// bilinear 2x2 PCF.
 class ShadowMap {
 public:
   ShadowMap();
@@ -10,9 +21,24 @@ public:
   virtual void read(GLenum textureUnit);
   GLuint getShadowWidth() {return shadowWidth;}
   GLuint getShadowHeight() {return shadowHeight;}
-  ~ShadowMap();
 
-private:
+  virtual bool initStaticCache();
+  bool hasStaticCache() {return staticFBO != 0;}
+  // static casters moved or were added or removed
+  void invalidateStatic() {staticDirty = true;}
+  // times the static layer was redrawn
+  unsigned int getStaticUpdates() {return staticUpdates;}
+
+  virtual ~ShadowMap();
+
+protected:
   GLuint FBO, shadowMap;
   GLuint shadowWidth, shadowHeight;
+
+  GLuint staticFBO, staticMap;
+  bool staticDirty;
+  bool dynamicWritten;
+  unsigned int staticUpdates;
+
+  bool createDepthTarget(GLuint &framebuffer, GLuint &texture);
 };
@@ -1,4 +1,7 @@
 #include "SpotLight.h"
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <math.h>
 
 SpotLight::SpotLight() {
   direction = glm::vec3(0.0f, -1.0f, 0.0f);
@@ -12,18 +15,19 @@ SpotLight::SpotLight(GLfloat red, GLfloat green, GLfloat blue, GLfloat aIntensit
   procEdge = cosf(glm::radians(edge));
 }
 
-void SpotLight::useLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation, GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation, GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation, GLuint edgeLocation) {
-  glUniform3f(ambientColorLocation, color.x, color.y,color.z);
-  glUniform1f(ambientIntensityLocation, ambientIntensity);
-  glUniform1f(diffuseIntensityLocation, diffuseIntensity);
-  
-  glUniform3f(positionLocation, position.x, position.y, position.z);
-  glUniform1f(constantLocation, constant);
-  glUniform1f(linearLocation, linear);
-  glUniform1f(exponentLocation, exponent);
+void SpotLight::fillLightData(SpotLightData &data) {
+  PointLight::fillLightData(data.base);
+  data.direction = direction;
+  data.edge = procEdge;
+}
 
-  glUniform3f(directionLocation, direction.x, direction.y, direction.z);
-  glUniform1f(edgeLocation, procEdge);
+glm::mat4 SpotLight::calculateShadowTransform(GLfloat range) {
+  // any up vector that isn't along the cone
+  glm::vec3 up = fabsf(direction.y) < 0.99f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(0.0f, 0.0f, 1.0f);
+  glm::mat4 view = glm::lookAt(position, position + direction, up);
+  // a little wider than the cone for the filter taps at its edge
+  GLfloat fov = fminf(2.0f * edge + 2.0f, 170.0f);
+  return glm::perspective(glm::radians(fov), 1.0f, LIGHT_SHADOW_NEAR, range) * view;
 }
 
 void SpotLight::setFlash(glm::vec3 pos, glm::vec3 dir) {
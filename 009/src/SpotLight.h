@@ -11,13 +11,13 @@ public:
 	    GLfloat con, GLfloat lin, GLfloat exp,
 	    GLfloat edg);
   
-  void useLight(GLuint ambientIntensityLocation, GLuint ambientColorLocation,
-		GLuint diffuseIntensityLocation, GLuint positionLocation, GLuint directionLocation,
-		GLuint constantLocation, GLuint linearLocation, GLuint exponentLocation,
-		GLuint edgeLocation);
+  void fillLightData(SpotLightData &data);
 
   void setFlash(glm::vec3 pos, glm::vec3 dir);
 
+  // covers the cone out to range; the shadow is one atlas tile
+  glm::mat4 calculateShadowTransform(GLfloat range);
+
   ~SpotLight();
   
 private:
@@ -1,7 +1,9 @@
 #include "Texture.h"
+#include "GLState.h"
 
 Texture::Texture() {
   textureID = 0;
+  placeholder = 0;
   width = 0;
   height = 0;
   bitDepth = 0;
@@ -10,6 +12,7 @@ Texture::Texture() {
 
 Texture::Texture(const char *fileLoc) {
   textureID = 0;
+  placeholder = 0;
   width = 0;
   height = 0;
   bitDepth = 0;
@@ -17,63 +20,64 @@ Texture::Texture(const char *fileLoc) {
 }
 
 bool Texture::loadTexture() {
-  unsigned char *texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
+  return loadFromFile(false);
+}
+
+bool Texture::loadTextureAlpha() {
+  return loadFromFile(true);
+}
+
+bool Texture::loadFromFile(bool alpha) {
+  int texWidth, texHeight, texBitDepth;
+  unsigned char *texData = stbi_load(fileLocation.c_str(), &texWidth, &texHeight, &texBitDepth, 0);
   if (!texData) {
-    printf("Failed to find: \"%s\"\n", fileLocation);
+    printf("Failed to find: \"%s\"\n", fileLocation.c_str());
     return false;
   }
 
-  glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_2D, textureID);
-
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, texData);
-  glGenerateMipmap(GL_TEXTURE_2D);
-
-  glBindTexture(GL_TEXTURE_2D, 0);
+  createFromPixels(texData, texWidth, texHeight, texBitDepth, alpha);
 
   stbi_image_free(texData);
 
   return true;
 }
 
-bool Texture::loadTextureAlpha() {
-  unsigned char *texData = stbi_load(fileLocation, &width, &height, &bitDepth, 0);
-  if (!texData) {
-    printf("Failed to find: \"%s\"\n", fileLocation);
-    return false;
+// Only touches GL, so this is the part that has to run on the render thread
+bool Texture::createFromPixels(const unsigned char *texData, int texWidth, int texHeight, int texBitDepth, bool alpha) {
+  if (textureID != 0) {
+    glDeleteTextures(1, &textureID);
+    GLState::textureDeleted(textureID);
   }
+  width = texWidth;
+  height = texHeight;
+  bitDepth = texBitDepth;
 
   glGenTextures(1, &textureID);
-  glBindTexture(GL_TEXTURE_2D, textureID);
+  GLState::bindTexture(0, textureID);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, texData);
+  GLenum format = alpha ? GL_RGBA : GL_RGB;
+  glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, texData);
   glGenerateMipmap(GL_TEXTURE_2D);
 
-  glBindTexture(GL_TEXTURE_2D, 0);
-
-  stbi_image_free(texData);
-
   return true;
 }
 
 void Texture::useTexture() {
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, textureID);
+  GLState::bindTexture(0, textureID ? textureID : placeholder);
 }
 
 void Texture::clearTexture() {
-  glDeleteTextures(1, &textureID);
+  if (textureID != 0) {
+    glDeleteTextures(1, &textureID);
+    GLState::textureDeleted(textureID);
+  }
   textureID = 0;
+  placeholder = 0;
   width = 0;
   height = 0;
   bitDepth = 0;
@@ -1,4 +1,5 @@
 #pragma once
+#include <string>
 #include <GL/glew.h>
 #include "stb_image.h"
 
@@ -9,6 +10,13 @@ public:
 
   bool loadTexture();
   bool loadTextureAlpha();
+  bool createFromPixels(const unsigned char *texData, int texWidth, int texHeight, int texBitDepth, bool alpha);
+  void setPlaceholder(GLuint placeholderID) {placeholder = placeholderID;}
+  bool isLoaded() {return textureID != 0;}
+  const std::string &getFileLocation() {return fileLocation;}
+  GLuint getTextureID() {return textureID;}
+  int getWidth() {return width;}
+  int getHeight() {return height;}
   void useTexture();
   void clearTexture();
   
@@ -16,6 +24,9 @@ public:
 
 private:
   GLuint textureID;
+  GLuint placeholder;
   int width, height, bitDepth;
-  const char *fileLocation;
+  std::string fileLocation;
+
+  bool loadFromFile(bool alpha);
 };
@@ -0,0 +1,107 @@
+#include "TextureCache.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+TextureCache::TextureCache() {
+  textureLoader = nullptr;
+  hits = 0;
+  misses = 0;
+  releasedBytesSaved = 0;
+}
+
+std::string TextureCache::makeKey(const std::string &fileLocation, bool alpha) {
+  char resolved[PATH_MAX];
+  std::string canonical = realpath(fileLocation.c_str(), resolved) ? resolved : fileLocation;
+  return canonical + (alpha ? "|RGBA" : "|RGB");
+}
+
+// Returns nullptr when the file can't be loaded synchronously; with a
+// loader the texture is returned right away and shows its placeholder
+// until the decode lands (or forever, if it fails).
+Texture *TextureCache::acquire(const std::string &fileLocation, bool alpha) {
+  std::string key = makeKey(fileLocation, alpha);
+
+  std::map<std::string, Entry>::iterator found = entries.find(key);
+  if (found != entries.end()) {
+    found->second.refCount ++;
+    found->second.hits ++;
+    hits ++;
+    return found->second.texture;
+  }
+
+  misses ++;
+  Texture *texture = new Texture(fileLocation.c_str());
+  if (textureLoader) {
+    textureLoader->loadAsync(texture, alpha);
+  } else {
+    bool flag = alpha ? texture->loadTextureAlpha() : texture->loadTexture();
+    if (!flag) {
+      delete texture;
+      return nullptr;
+    }
+  }
+
+  Entry entry;
+  entry.texture = texture;
+  entry.alpha = alpha;
+  entry.refCount = 1;
+  entry.hits = 0;
+  entries[key] = entry;
+  keys[texture] = key;
+
+  return texture;
+}
+
+void TextureCache::release(Texture *texture) {
+  std::map<Texture*, std::string>::iterator key = keys.find(texture);
+  if (key == keys.end()) {
+    return;
+  }
+
+  Entry &entry = entries[key->second];
+  entry.refCount --;
+  if (entry.refCount == 0) {
+    releasedBytesSaved += entryBytes(entry) * entry.hits;
+    if (textureLoader) {
+      textureLoader->cancel(texture);
+    }
+    delete texture;
+    entries.erase(key->second);
+    keys.erase(key);
+  }
+}
+
+size_t TextureCache::entryBytes(const Entry &entry) {
+  return size_t(entry.texture->getWidth()) * entry.texture->getHeight() * (entry.alpha ? 4 : 3);
+}
+
+// Decoded bytes that every cache hit would otherwise have loaded and
+// uploaded again (mip chain not included)
+size_t TextureCache::getBytesSaved() {
+  size_t bytes = releasedBytesSaved;
+  for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++ it) {
+    bytes += entryBytes(it->second) * it->second.hits;
+  }
+  return bytes;
+}
+
+void TextureCache::printStats() {
+  printf("Texture cache: %u textures, %u hits, %u misses, %.2f MB saved\n",
+	 getTextureCount(), hits, misses, getBytesSaved() / (1024.0 * 1024.0));
+}
+
+void TextureCache::clear() {
+  for (std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++ it) {
+    if (textureLoader) {
+      textureLoader->cancel(it->second.texture);
+    }
+    delete it->second.texture;
+  }
+  entries.clear();
+  keys.clear();
+}
+
+TextureCache::~TextureCache() {
+  clear();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+#include <string>
+
+#include "Texture.h"
+#include "TextureLoader.h"
+
+// Shares one Texture per (canonical path, RGB/RGBA) pair. acquire() hands
+// out a reference that has to be given back with release(); the texture
+// is deleted when its last reference goes.
+class TextureCache {
+public:
+  TextureCache();
+
+  void setTextureLoader(TextureLoader *loader) {textureLoader = loader;}
+  Texture *acquire(const std::string &fileLocation, bool alpha);
+  void release(Texture *texture);
+
+  unsigned int getHits() {return hits;}
+  unsigned int getMisses() {return misses;}
+  size_t getBytesSaved();
+  unsigned int getTextureCount() {return entries.size();}
+  void printStats();
+  void clear();
+
+  ~TextureCache();
+
+private:
+  struct Entry {
+    Texture *texture;
+    bool alpha;
+    unsigned int refCount;
+    unsigned int hits;
+  };
+
+  std::map<std::string, Entry> entries;
+  std::map<Texture*, std::string> keys;
+  TextureLoader *textureLoader;
+  unsigned int hits, misses;
+  size_t releasedBytesSaved;
+
+  static size_t entryBytes(const Entry &entry);
+  static std::string makeKey(const std::string &fileLocation, bool alpha);
+};
@@ -0,0 +1,102 @@
+#include "TextureLoader.h"
+
+#include <algorithm>
+
+TextureLoader::TextureLoader() {
+  
+}
+
+bool TextureLoader::init(const char *placeholderLocation, unsigned int threadCount) {
+  placeholder = Texture(placeholderLocation);
+  if (!placeholder.loadTextureAlpha()) {
+    return false;
+  }
+  pool.init(threadCount);
+  return true;
+}
+
+void TextureLoader::loadAsync(Texture *texture, bool alpha) {
+  texture->setPlaceholder(placeholder.getTextureID());
+
+  std::shared_ptr<Request> request(new Request());
+  request->texture = texture;
+  request->fileLocation = texture->getFileLocation();
+  request->alpha = alpha;
+  request->texData = nullptr;
+  request->width = request->height = request->bitDepth = 0;
+  pending.push_back(request);
+
+  pool.addTask(std::bind(&TextureLoader::decode, this, request));
+}
+
+// The decode still finishes, its pixels are just dropped in update()
+void TextureLoader::cancel(Texture *texture) {
+  for (size_t i = 0; i < pending.size(); i ++) {
+    if (pending[i]->texture == texture) {
+      pending[i]->texture = nullptr;
+    }
+  }
+}
+
+void TextureLoader::decode(std::shared_ptr<Request> request) {
+  request->texData = stbi_load(request->fileLocation.c_str(), &request->width, &request->height,
+			       &request->bitDepth, 0);
+
+  std::lock_guard<std::mutex> lock(decodedMutex);
+  decoded.push_back(request);
+}
+
+// Uploads whatever finished decoding since the last call; maxUploads of 0
+// means no limit. Returns the number of textures uploaded.
+unsigned int TextureLoader::update(unsigned int maxUploads) {
+  std::vector<std::shared_ptr<Request> > ready;
+  {
+    std::lock_guard<std::mutex> lock(decodedMutex);
+    size_t count = decoded.size();
+    if (maxUploads != 0 && count > maxUploads) {
+      count = maxUploads;
+    }
+    ready.assign(decoded.begin(), decoded.begin() + count);
+    decoded.erase(decoded.begin(), decoded.begin() + count);
+  }
+
+  unsigned int uploads = 0;
+  for (size_t i = 0; i < ready.size(); i ++) {
+    Request &request = *ready[i];
+    if (!request.texData) {
+      printf("Failed to find: \"%s\"\n", request.fileLocation.c_str());
+    } else {
+      if (request.texture) {
+	request.texture->createFromPixels(request.texData, request.width, request.height,
+					  request.bitDepth, request.alpha);
+	uploads ++;
+      }
+      stbi_image_free(request.texData);
+      request.texData = nullptr;
+    }
+    pending.erase(std::find(pending.begin(), pending.end(), ready[i]));
+  }
+
+  return uploads;
+}
+
+void TextureLoader::finish() {
+  pool.waitIdle();
+  update();
+}
+
+void TextureLoader::clear() {
+  pool.shutdown();
+  for (size_t i = 0; i < decoded.size(); i ++) {
+    if (decoded[i]->texData) {
+      stbi_image_free(decoded[i]->texData);
+    }
+  }
+  decoded.clear();
+  pending.clear();
+  placeholder.clearTexture();
+}
+
+TextureLoader::~TextureLoader() {
+  clear();
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Texture.h"
+#include "ThreadPool.h"
+
+// Decodes image files on a worker pool and uploads the pixels on the GL
+// thread from update(). Until its upload happens a texture binds the
+// placeholder instead.
+class TextureLoader {
+public:
+  TextureLoader();
+
+  bool init(const char *placeholderLocation, unsigned int threadCount = 0);
+  void loadAsync(Texture *texture, bool alpha);
+  void cancel(Texture *texture);
+  unsigned int update(unsigned int maxUploads = 0);
+  void finish();
+  unsigned int getPendingCount() {return pending.size();}
+  GLuint getPlaceholderID() {return placeholder.getTextureID();}
+  void clear();
+
+  ~TextureLoader();
+
+private:
+  struct Request {
+    Texture *texture;
+    std::string fileLocation;
+    bool alpha;
+
+    unsigned char *texData;
+    int width, height, bitDepth;
+  };
+
+  ThreadPool pool;
+  Texture placeholder;
+
+  std::vector<std::shared_ptr<Request> > pending;
+  std::vector<std::shared_ptr<Request> > decoded;
+  std::mutex decodedMutex;
+
+  void decode(std::shared_ptr<Request> request);
+};
@@ -0,0 +1,74 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool() {
+  busyCount = 0;
+  stopping = false;
+}
+
+void ThreadPool::init(unsigned int threadCount) {
+  shutdown();
+
+  if (threadCount == 0) {
+    threadCount = std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 1;
+  }
+  stopping = false;
+  for (unsigned int i = 0; i < threadCount; i ++) {
+    workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+  }
+}
+
+void ThreadPool::addTask(std::function<void()> task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    tasks.push_back(task);
+  }
+  taskReady.notify_one();
+}
+
+void ThreadPool::waitIdle() {
+  std::unique_lock<std::mutex> lock(mutex);
+  idle.wait(lock, [this] {return tasks.empty() && busyCount == 0;});
+}
+
+void ThreadPool::shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  taskReady.notify_all();
+  for (size_t i = 0; i < workers.size(); i ++) {
+    workers[i].join();
+  }
+  workers.clear();
+  tasks.clear();
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      taskReady.wait(lock, [this] {return stopping || !tasks.empty();});
+      if (stopping) {
+	return;
+      }
+      task = tasks.front();
+      tasks.pop_front();
+      busyCount ++;
+    }
+
+    task();
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      busyCount --;
+      if (tasks.empty() && busyCount == 0) {
+	idle.notify_all();
+      }
+    }
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  shutdown();
+}
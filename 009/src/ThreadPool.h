@@ -0,0 +1,32 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  ThreadPool();
+
+  void init(unsigned int threadCount);
+  void addTask(std::function<void()> task);
+  void waitIdle();
+  void shutdown();
+  unsigned int getThreadCount() {return workers.size();}
+
+  ~ThreadPool();
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()> > tasks;
+  std::mutex mutex;
+  std::condition_variable taskReady;
+  std::condition_variable idle;
+  unsigned int busyCount;
+  bool stopping;
+
+  void workerLoop();
+};
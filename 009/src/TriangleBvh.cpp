@@ -0,0 +1,410 @@
+#include "TriangleBvh.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+static const unsigned int SAH_BINS = 16;
+static const uint32_t MAX_LEAF_TRIANGLES = 8;
+// traversal step against one triangle test
+static const float TRAVERSAL_COST = 1.0f;
+static const uint32_t NO_CHILD = 0xffffffff;
+// traversal stack entries kept on the call stack; deeper trees use the heap
+static const unsigned int LOCAL_STACK_SIZE = 64;
+
+static float surfaceArea(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+  glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+TriangleBvh::TriangleBvh() {
+  stackSize = 0;
+}
+
+void TriangleBvh::build(const GLfloat *vertices, unsigned int stride, const unsigned int *indices, unsigned int indexCount) {
+  clear();
+  uint32_t triangleCount = indexCount / 3;
+  if (triangleCount == 0) {
+    return;
+  }
+
+  BuildState state;
+  state.order.resize(triangleCount);
+  state.centroids.resize(triangleCount);
+  state.triangleMin.resize(triangleCount);
+  state.triangleMax.resize(triangleCount);
+  std::vector<Triangle> input(triangleCount);
+  for (uint32_t i = 0; i < triangleCount; i ++) {
+    const GLfloat *p0 = vertices + indices[i * 3] * stride;
+    const GLfloat *p1 = vertices + indices[i * 3 + 1] * stride;
+    const GLfloat *p2 = vertices + indices[i * 3 + 2] * stride;
+    glm::vec3 v0(p0[0], p0[1], p0[2]), v1(p1[0], p1[1], p1[2]), v2(p2[0], p2[1], p2[2]);
+    input[i].v0 = v0;
+    input[i].e1 = v1 - v0;
+    input[i].e2 = v2 - v0;
+    input[i].index = i;
+    state.order[i] = i;
+    state.triangleMin[i] = glm::min(v0, glm::min(v1, v2));
+    state.triangleMax[i] = glm::max(v0, glm::max(v1, v2));
+    state.centroids[i] = (state.triangleMin[i] + state.triangleMax[i]) * 0.5f;
+  }
+
+  state.nodes.reserve(triangleCount * 2 / MAX_LEAF_TRIANGLES + 1);
+  uint32_t root = buildBinary(state, 0, triangleCount);
+
+  // leaves reference triangles in build order
+  triangles.resize(triangleCount);
+  for (uint32_t i = 0; i < triangleCount; i ++) {
+    triangles[i] = input[state.order[i]];
+  }
+
+  if (state.nodes[root].count > 0) {
+    // a single leaf still needs a node to hang from
+    Node node;
+    for (int i = 0; i < 4; i ++) {
+      node.minX[i] = node.minY[i] = node.minZ[i] = 0.0f;
+      node.maxX[i] = node.maxY[i] = node.maxZ[i] = 0.0f;
+      node.child[i] = NO_CHILD;
+      node.count[i] = 0;
+    }
+    const BuildNode &leaf = state.nodes[root];
+    node.minX[0] = leaf.boundsMin.x; node.minY[0] = leaf.boundsMin.y; node.minZ[0] = leaf.boundsMin.z;
+    node.maxX[0] = leaf.boundsMax.x; node.maxY[0] = leaf.boundsMax.y; node.maxZ[0] = leaf.boundsMax.z;
+    node.child[0] = leaf.first;
+    node.count[0] = leaf.count;
+    node.validMask = 1;
+    nodes.push_back(node);
+    stackSize = 4;
+  } else {
+    unsigned int depth = 0;
+    collapse(state, root, 1, depth);
+    // each level down leaves at most three siblings behind, the deepest
+    // node pushes four
+    stackSize = 3 * depth + 1;
+  }
+}
+
+uint32_t TriangleBvh::buildBinary(BuildState &state, uint32_t first, uint32_t count) {
+  uint32_t index = state.nodes.size();
+  state.nodes.push_back(BuildNode());
+
+  glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+  glm::vec3 centroidMin(FLT_MAX), centroidMax(-FLT_MAX);
+  for (uint32_t i = first; i < first + count; i ++) {
+    uint32_t t = state.order[i];
+    boundsMin = glm::min(boundsMin, state.triangleMin[t]);
+    boundsMax = glm::max(boundsMax, state.triangleMax[t]);
+    centroidMin = glm::min(centroidMin, state.centroids[t]);
+    centroidMax = glm::max(centroidMax, state.centroids[t]);
+  }
+  state.nodes[index].boundsMin = boundsMin;
+  state.nodes[index].boundsMax = boundsMax;
+  state.nodes[index].first = first;
+  state.nodes[index].count = count;
+  if (count <= 2) {
+    return index;
+  }
+
+  // binned SAH over centroids on every axis
+  float bestCost = FLT_MAX;
+  int bestAxis = -1;
+  unsigned int bestSplit = 0;
+  for (int axis = 0; axis < 3; axis ++) {
+    float extent = centroidMax[axis] - centroidMin[axis];
+    if (extent <= 0.0f) {
+      continue;
+    }
+    float scale = SAH_BINS / extent;
+    uint32_t binCount[SAH_BINS] = {0};
+    glm::vec3 binMin[SAH_BINS], binMax[SAH_BINS];
+    for (unsigned int b = 0; b < SAH_BINS; b ++) {
+      binMin[b] = glm::vec3(FLT_MAX);
+      binMax[b] = glm::vec3(-FLT_MAX);
+    }
+    for (uint32_t i = first; i < first + count; i ++) {
+      uint32_t t = state.order[i];
+      unsigned int b = std::min(SAH_BINS - 1, (unsigned int)((state.centroids[t][axis] - centroidMin[axis]) * scale));
+      binCount[b] ++;
+      binMin[b] = glm::min(binMin[b], state.triangleMin[t]);
+      binMax[b] = glm::max(binMax[b], state.triangleMax[t]);
+    }
+    // right to left sweep first, then left to right against it
+    float rightArea[SAH_BINS];
+    uint32_t rightCount[SAH_BINS];
+    glm::vec3 sweepMin(FLT_MAX), sweepMax(-FLT_MAX);
+    uint32_t sweepCount = 0;
+    for (unsigned int b = SAH_BINS - 1; b > 0; b --) {
+      sweepMin = glm::min(sweepMin, binMin[b]);
+      sweepMax = glm::max(sweepMax, binMax[b]);
+      sweepCount += binCount[b];
+      rightArea[b] = surfaceArea(sweepMin, sweepMax);
+      rightCount[b] = sweepCount;
+    }
+    sweepMin = glm::vec3(FLT_MAX);
+    sweepMax = glm::vec3(-FLT_MAX);
+    sweepCount = 0;
+    for (unsigned int b = 0; b < SAH_BINS - 1; b ++) {
+      sweepMin = glm::min(sweepMin, binMin[b]);
+      sweepMax = glm::max(sweepMax, binMax[b]);
+      sweepCount += binCount[b];
+      if (sweepCount == 0 || rightCount[b + 1] == 0) {
+	continue;
+      }
+      float cost = surfaceArea(sweepMin, sweepMax) * sweepCount + rightArea[b + 1] * rightCount[b + 1];
+      if (cost < bestCost) {
+	bestCost = cost;
+	bestAxis = axis;
+	bestSplit = b + 1;
+      }
+    }
+  }
+
+  float area = surfaceArea(boundsMin, boundsMax);
+  float splitCost = area > 0.0f ? TRAVERSAL_COST + bestCost / area : FLT_MAX;
+  if (count <= MAX_LEAF_TRIANGLES && (bestAxis < 0 || splitCost >= count)) {
+    return index;
+  }
+
+  uint32_t middle = first + count / 2;
+  if (bestAxis >= 0) {
+    float scale = SAH_BINS / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+    float axisMin = centroidMin[bestAxis];
+    uint32_t *split = std::partition(&state.order[first], &state.order[first] + count, [&](uint32_t t) {
+	unsigned int b = std::min(SAH_BINS - 1, (unsigned int)((state.centroids[t][bestAxis] - axisMin) * scale));
+	return b < bestSplit;
+      });
+    middle = split - &state.order[0];
+  }
+  if (middle == first || middle == first + count) {
+    // every centroid in one spot; any halving is as good as another
+    middle = first + count / 2;
+  }
+
+  uint32_t left = buildBinary(state, first, middle - first);
+  uint32_t right = buildBinary(state, middle, first + count - middle);
+  state.nodes[index].left = left;
+  state.nodes[index].right = right;
+  state.nodes[index].count = 0;
+  return index;
+}
+
+// Pulls up grandchildren, largest surface area first, until the node has
+// four children or only leaves are left. maxDepth is raised to the
+// deepest level of inner nodes below, this one at depth
+uint32_t TriangleBvh::collapse(const BuildState &state, uint32_t buildNode, unsigned int depth,
+			       unsigned int &maxDepth) {
+  maxDepth = depth > maxDepth ? depth : maxDepth;
+  uint32_t children[4] = {state.nodes[buildNode].left, state.nodes[buildNode].right, 0, 0};
+  unsigned int childCount = 2;
+  while (childCount < 4) {
+    int widest = -1;
+    float widestArea = -1.0f;
+    for (unsigned int i = 0; i < childCount; i ++) {
+      const BuildNode &candidate = state.nodes[children[i]];
+      float area = surfaceArea(candidate.boundsMin, candidate.boundsMax);
+      if (candidate.count == 0 && area > widestArea) {
+	widest = i;
+	widestArea = area;
+      }
+    }
+    if (widest < 0) {
+      break;
+    }
+    const BuildNode &opened = state.nodes[children[widest]];
+    children[widest] = opened.left;
+    children[childCount ++] = opened.right;
+  }
+
+  uint32_t index = nodes.size();
+  nodes.push_back(Node());
+  uint32_t childNodes[4];
+  for (unsigned int i = 0; i < childCount; i ++) {
+    const BuildNode &source = state.nodes[children[i]];
+    childNodes[i] = source.count > 0 ? source.first : collapse(state, children[i], depth + 1, maxDepth);
+  }
+
+  // nodes may have moved while building the children
+  Node &node = nodes[index];
+  node.validMask = 0;
+  for (unsigned int i = 0; i < 4; i ++) {
+    if (i >= childCount) {
+      node.minX[i] = node.minY[i] = node.minZ[i] = 0.0f;
+      node.maxX[i] = node.maxY[i] = node.maxZ[i] = 0.0f;
+      node.child[i] = NO_CHILD;
+      node.count[i] = 0;
+      continue;
+    }
+    const BuildNode &source = state.nodes[children[i]];
+    node.minX[i] = source.boundsMin.x; node.minY[i] = source.boundsMin.y; node.minZ[i] = source.boundsMin.z;
+    node.maxX[i] = source.boundsMax.x; node.maxY[i] = source.boundsMax.y; node.maxZ[i] = source.boundsMax.z;
+    node.child[i] = childNodes[i];
+    node.count[i] = source.count;
+    node.validMask |= 1 << i;
+  }
+  return index;
+}
+
+// Moller-Trumbore, accepting both windings
+static inline bool intersectTriangle(const glm::vec3 &origin, const glm::vec3 &direction,
+				     const glm::vec3 &v0, const glm::vec3 &e1, const glm::vec3 &e2,
+				     float maxDistance, float &distance, float &u, float &v) {
+  glm::vec3 p = glm::cross(direction, e2);
+  float determinant = glm::dot(e1, p);
+  if (fabsf(determinant) < 1e-12f) {
+    return false;
+  }
+  float inverse = 1.0f / determinant;
+  glm::vec3 s = origin - v0;
+  u = glm::dot(s, p) * inverse;
+  if (u < 0.0f || u > 1.0f) {
+    return false;
+  }
+  glm::vec3 q = glm::cross(s, e1);
+  v = glm::dot(direction, q) * inverse;
+  if (v < 0.0f || u + v > 1.0f) {
+    return false;
+  }
+  distance = glm::dot(e2, q) * inverse;
+  return distance >= 0.0f && distance <= maxDistance;
+}
+
+template <bool anyHit>
+bool TriangleBvh::traverse(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const {
+  if (nodes.empty()) {
+    return false;
+  }
+  // zero components become tiny so the slabs stay finite
+  glm::vec3 inverseDirection;
+  for (int axis = 0; axis < 3; axis ++) {
+    float d = direction[axis];
+    if (fabsf(d) < 1e-30f) {
+      d = d < 0.0f ? -1e-30f : 1e-30f;
+    }
+    inverseDirection[axis] = 1.0f / d;
+  }
+
+  float closest = maxDistance;
+  bool found = false;
+  uint32_t localStack[LOCAL_STACK_SIZE];
+  std::vector<uint32_t> deepStack;
+  uint32_t *stack = localStack;
+  if (stackSize > LOCAL_STACK_SIZE) {
+    deepStack.resize(stackSize);
+    stack = &deepStack[0];
+  }
+  unsigned int top = 0;
+  stack[top ++] = 0;
+
+#ifdef __SSE__
+  __m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+  __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+  __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+  __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+#endif
+
+  while (top > 0) {
+    const Node &node = nodes[stack[-- top]];
+
+    float nearDistance[4];
+    unsigned int hitMask;
+#ifdef __SSE__
+    __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+    __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+    __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+    __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+    __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+    __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+    __m128 nearT = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+			      _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+    __m128 farT = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+			     _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(closest)));
+    hitMask = _mm_movemask_ps(_mm_cmple_ps(nearT, farT)) & node.validMask;
+    _mm_storeu_ps(nearDistance, nearT);
+#else
+    hitMask = 0;
+    for (int i = 0; i < 4; i ++) {
+      float t0x = (node.minX[i] - origin.x) * inverseDirection.x, t1x = (node.maxX[i] - origin.x) * inverseDirection.x;
+      float t0y = (node.minY[i] - origin.y) * inverseDirection.y, t1y = (node.maxY[i] - origin.y) * inverseDirection.y;
+      float t0z = (node.minZ[i] - origin.z) * inverseDirection.z, t1z = (node.maxZ[i] - origin.z) * inverseDirection.z;
+      float nearT = fmaxf(fmaxf(fminf(t0x, t1x), fminf(t0y, t1y)), fmaxf(fminf(t0z, t1z), 0.0f));
+      float farT = fminf(fminf(fmaxf(t0x, t1x), fmaxf(t0y, t1y)), fminf(fmaxf(t0z, t1z), closest));
+      nearDistance[i] = nearT;
+      if (nearT <= farT) {
+	hitMask |= 1 << i;
+      }
+    }
+    hitMask &= node.validMask;
+#endif
+    if (!hitMask) {
+      continue;
+    }
+
+    // leaves now; inner children go on the stack farthest first so the
+    // nearest is popped next
+    uint32_t inner[4];
+    float innerDistance[4];
+    int innerCount = 0;
+    for (int i = 0; i < 4; i ++) {
+      if (!(hitMask & (1 << i))) {
+	continue;
+      }
+      if (node.count[i] == 0) {
+	int j = innerCount ++;
+	while (j > 0 && innerDistance[j - 1] < nearDistance[i]) {
+	  inner[j] = inner[j - 1];
+	  innerDistance[j] = innerDistance[j - 1];
+	  j --;
+	}
+	inner[j] = node.child[i];
+	innerDistance[j] = nearDistance[i];
+	continue;
+      }
+      // a closer hit in an earlier leaf of this node may have ruled it out
+      if (nearDistance[i] > closest) {
+	continue;
+      }
+      for (uint32_t t = node.child[i]; t < node.child[i] + node.count[i]; t ++) {
+	const Triangle &triangle = triangles[t];
+	float distance, u, v;
+	if (intersectTriangle(origin, direction, triangle.v0, triangle.e1, triangle.e2, closest, distance, u, v)) {
+	  if (anyHit) {
+	    return true;
+	  }
+	  closest = distance;
+	  found = true;
+	  hit.distance = distance;
+	  hit.triangle = triangle.index;
+	  hit.u = u;
+	  hit.v = v;
+	}
+      }
+    }
+    for (int i = 0; i < innerCount; i ++) {
+      stack[top ++] = inner[i];
+    }
+  }
+  return found;
+}
+
+bool TriangleBvh::intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const {
+  return traverse<false>(origin, direction, maxDistance, hit);
+}
+
+bool TriangleBvh::occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const {
+  RayHit unused;
+  return traverse<true>(origin, direction, maxDistance, unused);
+}
+
+void TriangleBvh::clear() {
+  stackSize = 0;
+  nodes.clear();
+  triangles.clear();
+}
+
+TriangleBvh::~TriangleBvh() {
+  
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+struct RayHit {
+  float distance;           // in units of the ray's direction
+  unsigned int mesh;        // submesh, for Model queries
+  unsigned int triangle;    // index into the mesh's triangles, in input order
+  float u, v;               // barycentric weights of the 2nd and 3rd vertex
+};
+
+// CPU bounding volume hierarchy over one mesh's triangles for ray and
+// segment queries. Built top down with binned SAH into a binary tree,
+// then collapsed into four-wide nodes whose child boxes are stored as
+// structure of arrays, so traversal tests all four with one SSE slab
+// test.
+//
+// Directions needn't be normalized; distances are in their units, so a
+// segment from a to b is direction b - a with maxDistance 1.
+class TriangleBvh {
+public:
+  TriangleBvh();
+
+  // positions are the first three floats of each stride-float vertex
+  void build(const GLfloat *vertices, unsigned int stride, const unsigned int *indices, unsigned int indexCount);
+
+  // closest hit with distance in [0, maxDistance]
+  bool intersect(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const;
+  // whether anything is hit, stopping at the first triangle found
+  bool occluded(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance) const;
+
+  bool isEmpty() const {return nodes.empty();}
+  unsigned int getTriangleCount() const {return triangles.size();}
+  unsigned int getNodeCount() const {return nodes.size();}
+
+  void clear();
+
+  ~TriangleBvh();
+
+private:
+  // child is a node index when count is 0 and the first triangle of a
+  // leaf otherwise; slots not in validMask are empty
+  struct Node {
+    float minX[4], minY[4], minZ[4];
+    float maxX[4], maxY[4], maxZ[4];
+    uint32_t child[4];
+    uint8_t count[4];
+    uint32_t validMask;
+  };
+
+  // edges precomputed for Moller-Trumbore
+  struct Triangle {
+    glm::vec3 v0, e1, e2;
+    uint32_t index;
+  };
+
+  struct BuildNode {
+    glm::vec3 boundsMin, boundsMax;
+    uint32_t left, right;
+    uint32_t first, count;    // count > 0 for leaves
+  };
+
+  struct BuildState {
+    std::vector<BuildNode> nodes;
+    std::vector<uint32_t> order;
+    std::vector<glm::vec3> centroids, triangleMin, triangleMax;
+  };
+
+  std::vector<Node> nodes;
+  std::vector<Triangle> triangles;
+  // traversal stack entries the deepest path can need
+  unsigned int stackSize;
+
+  uint32_t buildBinary(BuildState &state, uint32_t first, uint32_t count);
+  uint32_t collapse(const BuildState &state, uint32_t buildNode, unsigned int depth, unsigned int &maxDepth);
+  template <bool anyHit>
+  bool traverse(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, RayHit &hit) const;
+};
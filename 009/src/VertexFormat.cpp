@@ -0,0 +1,212 @@
+#include "VertexFormat.h"
+
+#include <math.h>
+#include <string.h>
+
+// Below this the savings are not worth the extra attribute setup
+static const unsigned int COMPACT_MIN_VERTICES = 256;
+
+GLsizei vertexFormatStride(VertexFormat format) {
+  switch (format) {
+  case VERTEX_FORMAT_COMPACT:
+    return 20;
+  case VERTEX_FORMAT_HALF:
+  case VERTEX_FORMAT_QUANTIZED:
+    return 16;
+  default:
+    return sizeof(GLfloat) * 8;
+  }
+}
+
+// Picks the smaller layout whose position error is lowest: 16-bit values
+// over the AABB step by extent / 65535 everywhere, half floats step by
+// 2^-10 of the largest coordinate, which is poor for models far from the
+// origin.
+VertexFormat chooseVertexFormat(const GLfloat *vertices, unsigned int vertexCount) {
+  if (vertexCount < COMPACT_MIN_VERTICES) {
+    return VERTEX_FORMAT_FLOAT;
+  }
+
+  glm::vec3 minPos(vertices[0], vertices[1], vertices[2]);
+  glm::vec3 maxPos = minPos;
+  for (size_t i = 1; i < vertexCount; i ++) {
+    const GLfloat *v = vertices + i * 8;
+    minPos = glm::min(minPos, glm::vec3(v[0], v[1], v[2]));
+    maxPos = glm::max(maxPos, glm::vec3(v[0], v[1], v[2]));
+  }
+  glm::vec3 extent = maxPos - minPos;
+  float maxExtent = fmaxf(extent.x, fmaxf(extent.y, extent.z));
+  glm::vec3 magnitude = glm::max(glm::abs(minPos), glm::abs(maxPos));
+  float maxAbs = fmaxf(magnitude.x, fmaxf(magnitude.y, magnitude.z));
+
+  float quantizedStep = maxExtent / 65535.0f;
+  if (maxAbs > 65504.0f) {
+    return VERTEX_FORMAT_QUANTIZED;
+  }
+  float halfStep = maxAbs > 0.0f ? ldexpf(1.0f, ilogbf(maxAbs) - 10) : 0.0f;
+  return halfStep <= quantizedStep ? VERTEX_FORMAT_HALF : VERTEX_FORMAT_QUANTIZED;
+}
+
+static inline uint16_t quantize16(float value, float minValue, float range) {
+  float t = range > 0.0f ? (value - minValue) / range : 0.0f;
+  t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+  return static_cast<uint16_t>(t * 65535.0f + 0.5f);
+}
+
+void packVertices(const GLfloat *vertices, unsigned int vertexCount, VertexFormat format,
+		  std::vector<unsigned char> &packed, VertexDequantization &dequantization) {
+  dequantization.positionScale = glm::vec3(1.0f, 1.0f, 1.0f);
+  dequantization.positionOffset = glm::vec3(0.0f, 0.0f, 0.0f);
+  dequantization.texCoordTransform = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+
+  if (format == VERTEX_FORMAT_FLOAT) {
+    const unsigned char *bytes = reinterpret_cast<const unsigned char*>(vertices);
+    packed.assign(bytes, bytes + sizeof(GLfloat) * 8 * vertexCount);
+    return;
+  }
+
+  glm::vec3 minPos(0.0f), maxPos(0.0f);
+  float minU = 0.0f, maxU = 0.0f, minV = 0.0f, maxV = 0.0f;
+  for (size_t i = 0; i < vertexCount; i ++) {
+    const GLfloat *v = vertices + i * 8;
+    glm::vec3 pos(v[0], v[1], v[2]);
+    minPos = i == 0 ? pos : glm::min(minPos, pos);
+    maxPos = i == 0 ? pos : glm::max(maxPos, pos);
+    minU = i == 0 ? v[3] : fminf(minU, v[3]);
+    maxU = i == 0 ? v[3] : fmaxf(maxU, v[3]);
+    minV = i == 0 ? v[4] : fminf(minV, v[4]);
+    maxV = i == 0 ? v[4] : fmaxf(maxV, v[4]);
+  }
+  glm::vec3 posRange = maxPos - minPos;
+  float rangeU = maxU - minU;
+  float rangeV = maxV - minV;
+  dequantization.texCoordTransform = glm::vec4(rangeU, rangeV, minU, minV);
+  if (format == VERTEX_FORMAT_QUANTIZED) {
+    dequantization.positionScale = posRange;
+    dequantization.positionOffset = minPos;
+  }
+
+  GLsizei stride = vertexFormatStride(format);
+  size_t uvOffset = format == VERTEX_FORMAT_COMPACT ? 12 : 8;
+  packed.assign(size_t(stride) * vertexCount, 0);
+  for (size_t i = 0; i < vertexCount; i ++) {
+    const GLfloat *v = vertices + i * 8;
+    unsigned char *out = &packed[i * stride];
+
+    if (format == VERTEX_FORMAT_COMPACT) {
+      memcpy(out, v, sizeof(GLfloat) * 3);
+    } else {
+      uint16_t pos[3];
+      for (size_t k = 0; k < 3; k ++) {
+	pos[k] = format == VERTEX_FORMAT_HALF ? floatToHalf(v[k]) : quantize16(v[k], minPos[k], posRange[k]);
+      }
+      memcpy(out, pos, sizeof(pos));
+    }
+
+    uint16_t uv[2] = {quantize16(v[3], minU, rangeU), quantize16(v[4], minV, rangeV)};
+    memcpy(out + uvOffset, uv, sizeof(uv));
+
+    uint32_t normal = packNormal(v[5], v[6], v[7]);
+    memcpy(out + uvOffset + 4, &normal, sizeof(normal));
+  }
+}
+
+// Expects the VBO to be bound; sets attributes 0-2 for the layout
+void setVertexFormatAttributes(VertexFormat format) {
+  GLsizei stride = vertexFormatStride(format);
+  if (format == VERTEX_FORMAT_FLOAT) {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 3));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 5));
+  } else {
+    size_t uvOffset = 8;
+    if (format == VERTEX_FORMAT_COMPACT) {
+      glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
+      uvOffset = 12;
+    } else if (format == VERTEX_FORMAT_HALF) {
+      glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, stride, 0);
+    } else {
+      glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, 0);
+    }
+    glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)uvOffset);
+    glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)(uvOffset + 4));
+  }
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+}
+
+// Expects the VAO to be bound; the buffer is attached later with
+// glBindVertexBuffer(binding, ...)
+void setVertexFormatBinding(VertexFormat format, GLuint binding) {
+  if (format == VERTEX_FORMAT_FLOAT) {
+    glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+    glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 3);
+    glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 5);
+  } else {
+    GLuint uvOffset = 8;
+    if (format == VERTEX_FORMAT_COMPACT) {
+      glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, 0);
+      uvOffset = 12;
+    } else if (format == VERTEX_FORMAT_HALF) {
+      glVertexAttribFormat(0, 3, GL_HALF_FLOAT, GL_FALSE, 0);
+    } else {
+      glVertexAttribFormat(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 0);
+    }
+    glVertexAttribFormat(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, uvOffset);
+    glVertexAttribFormat(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, uvOffset + 4);
+  }
+  for (GLuint attribute = 0; attribute < 3; attribute ++) {
+    glVertexAttribBinding(attribute, binding);
+    glEnableVertexAttribArray(attribute);
+  }
+}
+
+// Round-to-nearest-even float to IEEE half conversion
+uint16_t floatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  uint16_t sign = (bits >> 16) & 0x8000;
+  int32_t exponent = ((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff) {
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+  if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    uint32_t shift = 14 - exponent;
+    uint32_t halfMantissa = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (halfMantissa & 1))) {
+      halfMantissa ++;
+    }
+    return sign | halfMantissa;
+  }
+
+  uint32_t half = (exponent << 10) | (mantissa >> 13);
+  uint32_t remainder = mantissa & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    half ++;
+  }
+  return sign | half;
+}
+
+uint32_t packNormal(float x, float y, float z) {
+  float components[3] = {x, y, z};
+  uint32_t packed = 0;
+  for (size_t i = 0; i < 3; i ++) {
+    float c = components[i] < -1.0f ? -1.0f : (components[i] > 1.0f ? 1.0f : components[i]);
+    int32_t q = static_cast<int32_t>(roundf(c * 511.0f));
+    packed |= (static_cast<uint32_t>(q) & 0x3ff) << (i * 10);
+  }
+  return packed;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+// Attribute layouts Mesh can upload. Input is always the 8-float
+// position/uv/normal vertex; the compact layouts pack normals as
+// GL_INT_2_10_10_10_REV and uvs as normalized 16-bit values over the mesh's
+// uv range.
+enum VertexFormat {
+  VERTEX_FORMAT_FLOAT,      // 32 bytes: float pos, float uv, float normal
+  VERTEX_FORMAT_COMPACT,    // 20 bytes: float pos, packed uv and normal
+  VERTEX_FORMAT_HALF,       // 16 bytes: half-float pos, packed uv and normal
+  VERTEX_FORMAT_QUANTIZED   // 16 bytes: 16-bit pos over the mesh AABB, packed uv and normal
+};
+
+// Maps what the vertex shader reads back to mesh space:
+// pos * positionScale + positionOffset, uv * uvScale + uvOffset
+struct VertexDequantization {
+  glm::vec3 positionScale;
+  glm::vec3 positionOffset;
+  glm::vec4 texCoordTransform;   // xy scale, zw offset
+};
+
+GLsizei vertexFormatStride(VertexFormat format);
+VertexFormat chooseVertexFormat(const GLfloat *vertices, unsigned int vertexCount);
+void packVertices(const GLfloat *vertices, unsigned int vertexCount, VertexFormat format,
+		  std::vector<unsigned char> &packed, VertexDequantization &dequantization);
+void setVertexFormatAttributes(VertexFormat format);
+// Same layout through separate attribute formats (GL 4.3), sourced from
+// vertex buffer binding point binding
+void setVertexFormatBinding(VertexFormat format, GLuint binding);
+
+uint16_t floatToHalf(float value);
+uint32_t packNormal(float x, float y, float z);
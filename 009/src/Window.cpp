@@ -1,8 +1,10 @@
 #include "Window.h"
+#include "GLState.h"
 
 Window::Window() {
   width = 800;
   height = 600;
+  visible = true;
 
   for (size_t i = 0; i < 1024; i ++) {
     keys[i] = 0;
@@ -12,6 +14,7 @@ Window::Window() {
 Window::Window(GLint windowWidth, GLint windowHeight) {
   width = windowWidth;
   height = windowHeight;
+  visible = true;
 
   for (size_t i = 0; i < 1024; i ++) {
     keys[i] = 0;
@@ -34,6 +37,7 @@ int Window::initialize() {
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
   // Allow forward compatability
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+  glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
 
   mainWindow = glfwCreateWindow(width, height, "Test Window", NULL, NULL);
   if (!mainWindow) {
@@ -65,7 +69,7 @@ int Window::initialize() {
   glEnable(GL_DEPTH_TEST);
 
   // Setup Viewport size
-  glViewport(0, 0, bufferWidth, bufferHeight);
+  GLState::viewport(0, 0, bufferWidth, bufferHeight);
 
   glfwSetWindowUserPointer(mainWindow, this);
 }
@@ -9,6 +9,8 @@ public:
   Window();
   Window(GLint windowWidth, GLint windowHeight);
 
+  // before initialize(); a hidden window still renders, for benchmarks
+  void setVisible(bool isVisible) {visible = isVisible;}
   int initialize();
   GLfloat getBufferWidth() {return bufferWidth;}
   GLfloat getBufferHeight() {return bufferHeight;}
@@ -27,6 +29,7 @@ private:
   GLFWwindow *mainWindow;
   GLint width, height;
   GLint bufferWidth, bufferHeight;
+  bool visible;
 
   bool keys[1024];
   GLfloat lastX = 0.0f;
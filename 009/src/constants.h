@@ -6,3 +6,23 @@
 
 const int MAX_POINT_LIGHTS = 3;
 const int MAX_SPOT_LIGHTS = 3;
+const int MAX_INSTANCE_MATERIALS = 8;
+// layers of the directional light's shadow map array
+const int MAX_SHADOW_CASCADES = 4;
+// shadow atlas tiles the spot and point lights can hold at once
+const int MAX_SHADOW_TILES = 24;
+// near plane of the spot and point light shadow projections
+const float LIGHT_SHADOW_NEAR = 0.1f;
+
+// kernels basics.fsh can filter the directional shadow map with, picked
+// when the shader is built; the values match its SHADOW_FILTER defines
+enum ShadowFilter {
+  SHADOW_FILTER_SINGLE,   // one bilinear compare
+  SHADOW_FILTER_GATHER,   // four compare gathers, needs GL_ARB_gpu_shader5
+  SHADOW_FILTER_POISSON,  // eight bilinear compares on a Poisson disc
+  SHADOW_FILTER_PCF5X5,   // 5x5 tent from nine bilinear compares
+  SHADOW_FILTER_COUNT
+};
+
+// uniform buffer binding points shared by every program
+const unsigned int LIGHT_BLOCK_BINDING = 0;